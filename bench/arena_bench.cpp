@@ -0,0 +1,83 @@
+// GPU buffer arenas: the TLSF range allocator behind them, which runs on the CPU like it does in the app.
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bufferarena.h"
+#include "bench.h"
+
+// Fills the allocator to about half with ranges of mixed sizes, like meshes and instance ranges, then releases a
+// random one and allocates another per op. The same sequence every call.
+static void churn(RangeAllocator &allocator, std::vector<uint32_t> &live, size_t ranges)
+{
+    allocator.reset(ranges * 2048);
+    live.clear();
+    uint32_t seed = 5;
+    for (size_t i = 0; i < 2 * ranges; i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        // Mostly small ranges, every fourth one up to 4096 units
+        uint64_t units = 1 + (seed >> 8) % (seed & 3 ? 64 : 4096);
+        if (i >= ranges && !live.empty())
+        {
+            size_t victim = (seed >> 4) % live.size();
+            allocator.release(live[victim]);
+            live[victim] = live.back();
+            live.pop_back();
+        }
+        uint32_t range = allocator.allocate(units);
+        if (range != ARENA_NONE)
+            live.push_back(range);
+    }
+}
+
+// arena.<churn|compact>.<ranges>: churn times the allocations and releases, compact the defragmentation of the
+// churned arena down to one hole in a single pass
+bool runArenaWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3 || (fields[1] != "churn" && fields[1] != "compact"))
+        return false;
+    bool compact = fields[1] == "compact";
+    size_t ranges = strtoull(fields[2].c_str(), NULL, 10);
+    if (!ranges)
+        return false;
+
+    RangeAllocator allocator;
+    std::vector<uint32_t> live;
+    live.reserve(2 * ranges);
+    double compactSeconds = 0;
+    uint64_t moved = 0;
+    auto call = [&]() {
+        churn(allocator, live, ranges);
+        if (compact)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            moved = allocator.compact(~0ull, [](uint32_t, uint64_t, uint64_t, uint64_t) {});
+            compactSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+    };
+    // The first call sizes the allocator's tables, later ones reuse them
+    call();
+    compactSeconds = 0;
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, call, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+    ArenaStats stats = allocator.stats();
+
+    if (compact)
+    {
+        metrics["ms/compact"] = compactSeconds * 1e3 / iterations;
+        // Units copied per unit in use, what a full defragmentation costs in GPU copies
+        metrics["moved/used"] = (double)moved / stats.used;
+        metrics["holes"] = (double)stats.freeRanges;
+    }
+    else
+        metrics["ns/op"] = elapsed * 1e9 / ((double)iterations * 2 * ranges);
+    // Percent of the free space outside the largest hole, after the churn or its compaction
+    metrics["fragmentation"] = 100 * stats.fragmentation();
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
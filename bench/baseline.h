@@ -0,0 +1,123 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+
+// Baseline files hold one expectation per line, blank lines and lines starting with '#' are kept as they are:
+//     <workload> <metric> <baseline value> <tolerance>%
+// A metric regresses when it measures above baseline * (1 + tolerance). Values are stored with 3 decimals, so anything
+// within rounding of the limit passes.
+
+struct BaselineEntry
+{
+    std::string workload;
+    std::string metric;
+    double value;
+    double tolerance;
+    size_t line; // line in the file, so updates can rewrite it in place
+};
+
+struct Baseline
+{
+    std::vector<std::string> lines;
+    std::vector<BaselineEntry> entries;
+};
+
+inline bool readBaseline(const std::string &path, Baseline &baseline)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        printf("Failed to read baseline %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        baseline.lines.push_back(line);
+        std::istringstream in(line);
+        BaselineEntry e;
+        std::string tolerance;
+        if (!(in >> e.workload) || e.workload[0] == '#')
+            continue;
+        if (!(in >> e.metric >> e.value >> tolerance) || tolerance.empty() || tolerance[tolerance.size() - 1] != '%')
+        {
+            printf("%s:%zu: expected <workload> <metric> <value> <tolerance>%%\n", path.c_str(), baseline.lines.size());
+            return false;
+        }
+        e.tolerance = atof(tolerance.c_str()) / 100.0;
+        e.line = baseline.lines.size() - 1;
+        baseline.entries.push_back(e);
+    }
+    return true;
+}
+
+inline bool writeBaseline(const std::string &path, const Baseline &baseline)
+{
+    std::ofstream file(path.c_str());
+    for (size_t i = 0; i < baseline.lines.size(); i++)
+        file << baseline.lines[i] << "\n";
+    return (bool)file;
+}
+
+// Runs every workload the baseline mentions cfg.runs times and prints a table comparing the best of each metric against
+// its baseline, which keeps a stray slow run from failing the check and the tolerances close to the noise. Returns true
+// if nothing regressed. With update set the measured values replace the baseline values instead.
+inline bool checkBaseline(Baseline &baseline, const BenchConfig &cfg, bool update)
+{
+    std::map<std::string, Metrics> results;
+    std::map<std::string, bool> valid;
+    bool pass = true;
+    printf("%-40s %-12s %12s %12s %9s %9s  %s\n", "workload", "metric", "baseline", "measured", "change", "limit", "result");
+    for (size_t i = 0; i < baseline.entries.size(); i++)
+    {
+        BaselineEntry &e = baseline.entries[i];
+        if (cfg.exact && e.tolerance > 0)
+            continue;
+        if (!results.count(e.workload))
+        {
+            Metrics &best = results[e.workload];
+            valid[e.workload] = runWorkload(e.workload, cfg, best);
+            for (int run = 1; run < cfg.runs && valid[e.workload]; run++)
+            {
+                Metrics metrics;
+                valid[e.workload] = runWorkload(e.workload, cfg, metrics);
+                for (Metrics::const_iterator m = metrics.begin(); m != metrics.end(); ++m)
+                    if (!best.count(m->first) || m->second < best[m->first])
+                        best[m->first] = m->second;
+            }
+        }
+        const Metrics &metrics = results[e.workload];
+        Metrics::const_iterator m = metrics.find(e.metric);
+        if (!valid[e.workload] || m == metrics.end())
+        {
+            printf("%-40s %-12s %12.3f %12s %9s %+8.0f%%  UNKNOWN\n", e.workload.c_str(), e.metric.c_str(), e.value, "-", "-", e.tolerance * 100);
+            pass = false;
+            continue;
+        }
+        double measured = m->second;
+        double change = e.value != 0 ? (measured - e.value) / e.value * 100 : (measured != 0 ? 100.0 : 0.0);
+        bool ok = measured <= e.value * (1 + e.tolerance) + 0.0005;
+        printf("%-40s %-12s %12.3f %12.3f %+8.1f%% %+8.0f%%  %s\n", e.workload.c_str(), e.metric.c_str(), e.value, measured,
+               change, e.tolerance * 100, update ? "updated" : ok ? "ok" : "REGRESSION");
+        fflush(stdout);
+        pass = pass && ok;
+        if (update)
+        {
+            char line[256];
+            snprintf(line, sizeof(line), "%-40s %-12s %12.3f %6.0f%%", e.workload.c_str(), e.metric.c_str(), measured, e.tolerance * 100);
+            baseline.lines[e.line] = line;
+            e.value = measured;
+        }
+    }
+    return pass;
+}
+#endif
@@ -0,0 +1,122 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+struct BenchConfig
+{
+    size_t maxN = 100000000;
+    size_t maxBytes = (size_t)1 << 30;
+    double minSeconds = 0.05;
+    int runs = 3; // of each workload a baseline check keeps the best of
+    bool exact = false; // baseline checks skip the metrics with a tolerance, the timings
+};
+
+// Metrics a workload reports, by name. Every metric is lower-is-better so baselines can bound it from above.
+typedef std::map<std::string, double> Metrics;
+
+// Allocation counters, maintained by the replaced global operator new in main.cpp
+size_t benchAllocCount();
+size_t benchAllocBytes();
+
+// Workloads are named by dot separated fields, the first one picks the family:
+//     gen.<host|mapped>.<float|packed>.<unindexed|indexed>.<n>
+//     frame.<instances>
+//     raster.<n>.<threads>
+//     ray.<n>.<threads>
+//     sort.<n>.<threads>
+//     scene.<prisms>.<threads>
+//     matrix.<4x4|4x3>.<simd|scalar|glm>.<prisms>
+//     bvh.<build|refit|ray|frustum|aabb>.<prisms>.<threads>
+//     pick.<prisms>
+//     collide.<dense|sparse>.<prisms>.<threads>
+//     export.<ply|stl|glb>.<n>
+//     yuv.<simd|scalar>.<width>x<height>
+//     scenefile.<binary|text>.<prisms>
+//     arena.<churn|compact>.<ranges>
+// Each family returns false if it can't parse the rest of the name.
+bool runGenerateWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runFrameWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runRasterWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runRayWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runSortWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runSceneWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runMatrixWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runBvhWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runPickWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runCollisionWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runExportWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runYuvWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runSceneFileWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+bool runArenaWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics);
+
+// Prints the generator table swept over n, the default when the bench runs without a workload
+void generateTable(const BenchConfig &cfg);
+
+// Prints how the software rasterizer scales from one thread up to every hardware thread
+void rasterScaling(int n, const BenchConfig &cfg);
+
+inline std::vector<std::string> splitWorkload(const std::string &name)
+{
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t dot = name.find('.'); dot != std::string::npos; start = dot + 1, dot = name.find('.', start))
+        fields.push_back(name.substr(start, dot - start));
+    fields.push_back(name.substr(start));
+    return fields;
+}
+
+inline bool runWorkload(const std::string &name, const BenchConfig &cfg, Metrics &metrics)
+{
+    std::vector<std::string> fields = splitWorkload(name);
+    if (fields[0] == "gen")
+        return runGenerateWorkload(fields, cfg, metrics);
+    if (fields[0] == "frame")
+        return runFrameWorkload(fields, cfg, metrics);
+    if (fields[0] == "raster")
+        return runRasterWorkload(fields, cfg, metrics);
+    if (fields[0] == "ray")
+        return runRayWorkload(fields, cfg, metrics);
+    if (fields[0] == "sort")
+        return runSortWorkload(fields, cfg, metrics);
+    if (fields[0] == "scene")
+        return runSceneWorkload(fields, cfg, metrics);
+    if (fields[0] == "matrix")
+        return runMatrixWorkload(fields, cfg, metrics);
+    if (fields[0] == "bvh")
+        return runBvhWorkload(fields, cfg, metrics);
+    if (fields[0] == "pick")
+        return runPickWorkload(fields, cfg, metrics);
+    if (fields[0] == "collide")
+        return runCollisionWorkload(fields, cfg, metrics);
+    if (fields[0] == "export")
+        return runExportWorkload(fields, cfg, metrics);
+    if (fields[0] == "yuv")
+        return runYuvWorkload(fields, cfg, metrics);
+    if (fields[0] == "scenefile")
+        return runSceneFileWorkload(fields, cfg, metrics);
+    if (fields[0] == "arena")
+        return runArenaWorkload(fields, cfg, metrics);
+    return false;
+}
+
+// Calls f() until at least cfg.minSeconds have passed, returns the elapsed seconds and the number of calls
+template <class F>
+double repeatFor(const BenchConfig &cfg, F f, size_t &iterations)
+{
+    iterations = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        f();
+        iterations++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < cfg.minSeconds);
+    return elapsed;
+}
+#endif
@@ -0,0 +1,108 @@
+// Bounding volume hierarchy over the scene's prisms: build, refit after a frame of motion, and queries.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "scene.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// Queries per timed call of the query workloads
+const size_t BVH_BENCH_QUERIES = 1024;
+
+// bvh.<build|refit|ray|frustum|aabb>.<prisms>.<threads>, on a drifting grid with random rotation axes
+bool runBvhWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 4)
+        return false;
+    const std::string &op = fields[1];
+    if (op != "build" && op != "refit" && op != "ray" && op != "frustum" && op != "aabb")
+        return false;
+    size_t prisms = strtoull(fields[2].c_str(), NULL, 10);
+    unsigned threads = (unsigned)atoi(fields[3].c_str());
+    if (!prisms)
+        return false;
+
+    Scene scene;
+    scene.grid(prisms, 6, 1.5f, 1.0f);
+    uint32_t seed = 11;
+    for (size_t i = 0; i < prisms; i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        glm::vec3 axis = glm::normalize(glm::vec3((seed & 0xFF) / 128.0f - 1.0f, (seed >> 8 & 0xFF) / 128.0f - 1.0f,
+                                                  (seed >> 16 & 0xFF) / 128.0f - 0.9f));
+        scene.axisX[i] = axis.x, scene.axisY[i] = axis.y, scene.axisZ[i] = axis.z;
+    }
+    ThreadPool pool(threads);
+    Bvh bvh;
+    bvh.build(pool, scene.transforms(), prisms);
+
+    // Random points over the grid for the queries to aim at, drawn up front
+    std::vector<glm::vec3> points(BVH_BENCH_QUERIES);
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        points[i] = glm::vec3(((seed & 0xFFFF) / 32768.0f - 1.0f) * scene.extent,
+                              ((seed >> 16) / 32768.0f - 1.0f) * scene.extent, 0.0f);
+    }
+    glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f) *
+                               glm::lookAt(glm::vec3(0.0f, -20.0f, 60.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    size_t iterations = 0, found = 0, query = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        if (op == "build")
+            bvh.build(pool, scene.transforms(), prisms);
+        else if (op == "refit")
+        {
+            // The refit after a frame of the scene's own motion, which isn't timed separately
+            scene.update(pool, 1.0f / 60.0f, true);
+            bvh.refit(pool, scene.transforms());
+        }
+        else if (op == "ray")
+            for (size_t i = 0; i < BVH_BENCH_QUERIES; i++)
+            {
+                // Straight down onto the grid from above, the nearest box wins
+                glm::vec3 origin = points[i] + glm::vec3(0.3f, 0.2f, 30.0f);
+                glm::vec3 dir = glm::normalize(points[i] - origin);
+                float tMax = 100.0f;
+                bvh.raycast(origin, dir, tMax, [&](size_t prism, float &t) {
+                    const Aabb &box = bvh.bounds(prism);
+                    float enter = (box.hi.z - origin.z) / dir.z;
+                    if (enter < t)
+                        t = enter;
+                });
+                found += tMax < 100.0f;
+            }
+        else if (op == "frustum")
+            bvh.frustum(viewProjection, [&](size_t) { found++; });
+        else
+            for (size_t i = 0; i < BVH_BENCH_QUERIES; i++)
+            {
+                Aabb box(points[i] - glm::vec3(2.0f), points[i] + glm::vec3(2.0f));
+                bvh.overlap(box, [&](size_t) { found++; });
+            }
+        query++;
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    // Keep the results observable so the queries can't be optimized away
+    volatile size_t sink = found;
+    (void)sink;
+
+    if (op == "build" || op == "refit")
+    {
+        metrics["ms/" + op] = elapsed * 1e3 / iterations;
+        metrics["ns/prism"] = elapsed * 1e9 / ((double)iterations * prisms);
+    }
+    else
+        metrics["ns/query"] = elapsed * 1e9 / ((double)iterations * (op == "frustum" ? 1 : BVH_BENCH_QUERIES));
+    // Building allocates its own subtrees, the rest must not allocate
+    if (op != "build")
+        metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
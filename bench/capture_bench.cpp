@@ -0,0 +1,61 @@
+// Frame capture: the writer thread's RGBA to 4:2:0 YUV conversion, which has to keep up with the frame rate.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "capture.h"
+#include "bench.h"
+
+// Converts a whole frame, bottom up like a GL readback
+static void convertFrame(const std::vector<unsigned char> &rgba, int width, int height, std::vector<unsigned char> &planes, bool simd)
+{
+    size_t rowBytes = (size_t)width * 4;
+    int chromaWidth = (width + 1) / 2;
+    unsigned char *yPlane = planes.data(), *uPlane = yPlane + (size_t)width * height;
+    unsigned char *vPlane = uPlane + (size_t)chromaWidth * ((height + 1) / 2);
+    const unsigned char *top = rgba.data() + (height - 1) * rowBytes;
+    for (int y = 0; y < height; y += 2)
+    {
+        const unsigned char *row0 = top - y * rowBytes;
+        const unsigned char *row1 = y + 1 < height ? row0 - rowBytes : row0;
+        unsigned char *y1 = yPlane + (size_t)(y + 1 < height ? y + 1 : y) * width;
+        rgbaRowsToI420(row0, row1, width, yPlane + (size_t)y * width, y1, uPlane + (size_t)(y / 2) * chromaWidth,
+                       vPlane + (size_t)(y / 2) * chromaWidth, simd);
+    }
+}
+
+// yuv.<simd|scalar>.<width>x<height>, a frame of noise. mismatches counts the bytes that differ from the scalar path.
+bool runYuvWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    int width = 0, height = 0;
+    if (fields.size() != 3 || (fields[1] != "simd" && fields[1] != "scalar") ||
+        sscanf(fields[2].c_str(), "%dx%d", &width, &height) != 2 || width < 1 || height < 1)
+        return false;
+    bool simd = fields[1] == "simd";
+
+    std::vector<unsigned char> rgba((size_t)width * height * 4);
+    uint32_t seed = 5;
+    for (size_t i = 0; i < rgba.size(); i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        rgba[i] = (unsigned char)seed;
+    }
+    size_t planeBytes = (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+    std::vector<unsigned char> planes(planeBytes), reference(planeBytes);
+    convertFrame(rgba, width, height, reference, false);
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() { convertFrame(rgba, width, height, planes, simd); }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < planeBytes; i++)
+        mismatches += planes[i] != reference[i];
+    metrics["ms/frame"] = elapsed * 1e3 / iterations;
+    metrics["allocs"] = (double)allocs / iterations;
+    metrics["mismatches"] = (double)mismatches;
+    return true;
+}
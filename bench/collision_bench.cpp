@@ -0,0 +1,56 @@
+// Collision detection between the scene's prisms: spatial hash broadphase and separating axis narrowphase.
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "collision.h"
+#include "scene.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// collide.<dense|sparse>.<prisms>.<threads>, a grid of hexagonal prisms with random rotation axes. Dense packs them
+// 0.75 apart so most neighbors overlap, sparse spreads them 1.5 apart and jitters them so a few come close.
+bool runCollisionWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 4 || (fields[1] != "dense" && fields[1] != "sparse"))
+        return false;
+    bool dense = fields[1] == "dense";
+    size_t prisms = strtoull(fields[2].c_str(), NULL, 10);
+    unsigned threads = (unsigned)atoi(fields[3].c_str());
+    if (!prisms)
+        return false;
+
+    Scene scene;
+    scene.grid(prisms, 6, dense ? 0.75f : 1.5f);
+    uint32_t seed = 13;
+    for (size_t i = 0; i < prisms; i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        glm::vec3 axis = glm::normalize(glm::vec3((seed & 0xFF) / 128.0f - 1.0f, (seed >> 8 & 0xFF) / 128.0f - 1.0f,
+                                                  (seed >> 16 & 0xFF) / 128.0f - 0.9f));
+        scene.axisX[i] = axis.x, scene.axisY[i] = axis.y, scene.axisZ[i] = axis.z;
+        if (!dense)
+        {
+            scene.x[i] += ((seed >> 4 & 0xFF) / 128.0f - 1.0f) * 0.3f;
+            scene.y[i] += ((seed >> 12 & 0xFF) / 128.0f - 1.0f) * 0.3f;
+        }
+    }
+    ThreadPool pool(threads);
+    CollisionDetector detector;
+    // The first update sizes the buffers, later ones only reuse them
+    detector.update(pool, scene);
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() { detector.update(pool, scene); }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    metrics["ms/update"] = elapsed * 1e3 / iterations;
+    // Per candidate pair, the inverse of the pairs per second the detector gets through, broadphase included
+    metrics["ns/pair"] = elapsed * 1e9 / ((double)iterations * std::max<size_t>(detector.candidates(), 1));
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
@@ -0,0 +1,46 @@
+// Mesh export: the streaming writers of --export into the null device, so the disk stays out of the timing.
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "meshexport.h"
+#include "bench.h"
+
+#ifdef _WIN32
+static const char *nullDevice = "NUL";
+#else
+static const char *nullDevice = "/dev/null";
+#endif
+
+static const char *formatNames[] = {"ply", "stl", "glb"};
+
+// export.<ply|stl|glb>.<n>, a whole file per call, including opening and closing it
+bool runExportWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3)
+        return false;
+    int format = 0;
+    while (format < 3 && fields[1] != formatNames[format])
+        format++;
+    size_t n = strtoull(fields[2].c_str(), NULL, 10);
+    if (format == 3 || n < 3)
+        return false;
+
+    // The writer's blocks are allocated once, like a long running exporter would keep them
+    BlockWriter out;
+    uint64_t bytes = 0;
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        out.open(nullDevice);
+        exportMesh(n, (ExportFormat)format, out);
+        out.close();
+        bytes = out.size();
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    metrics["ns/side"] = elapsed * 1e9 / ((double)iterations * n);
+    metrics["bytes/side"] = (double)bytes / n;
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
@@ -0,0 +1,59 @@
+// Render loop workloads: the CPU work main() does every frame, for a number of prism instances, without any GL calls.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "bench.h"
+
+bool runFrameWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 2)
+        return false;
+    size_t instances = strtoull(fields[1].c_str(), NULL, 10);
+    if (!instances)
+        return false;
+
+    // Instances on a square grid, spinning at different phases
+    std::vector<glm::vec3> positions(instances);
+    std::vector<float> angles(instances);
+    size_t side = 1;
+    while (side * side < instances)
+        side++;
+    for (size_t i = 0; i < instances; i++)
+    {
+        positions[i] = glm::vec3((float)(i % side), (float)(i / side), 0.0f);
+        angles[i] = (float)(i % 360);
+    }
+    // Stands in for the instance buffer the matrices would be written to
+    std::vector<glm::mat4> models(instances);
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    glm::mat4 view, projection;
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        view = camera.GetViewMatrix();
+        projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+        for (size_t i = 0; i < instances; i++)
+        {
+            angles[i] += 0.4f;
+            glm::mat4 model = glm::mat4(1.0f);
+            model = glm::translate(model, positions[i]);
+            model = glm::rotate(model, glm::radians(angles[i]), glm::vec3(1.0f, 0, 0));
+            models[i] = model;
+        }
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    // Keep the matrices observable so the work can't be optimized away
+    volatile float sink = models[instances - 1][3][0] + view[3][2] + projection[0][0];
+    (void)sink;
+
+    metrics["ns/instance"] = elapsed * 1e9 / ((double)iterations * instances);
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
@@ -0,0 +1,176 @@
+// Prism generation workloads. The mapped buffer path is emulated with an anonymous memory mapping standing in
+// for glMapBufferRange(), so no GL context is needed.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "prism.h"
+#include "bench.h"
+
+// Destination buffers
+// ------------------------------------------------------------------------
+enum Bench_Target {
+    TARGET_HOST,  // std::vector allocated, filled and released every iteration, like a host staging copy
+    TARGET_MAPPED // Persistent mapping written in place, like glMapBufferRange()
+};
+
+struct MappedRegion
+{
+    void *ptr;
+    size_t size;
+    MappedRegion(size_t bytes) : ptr(NULL), size(bytes)
+    {
+#ifndef _WIN32
+        ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED)
+            ptr = NULL;
+#else
+        ptr = malloc(size);
+#endif
+    }
+    ~MappedRegion()
+    {
+#ifndef _WIN32
+        if (ptr)
+            munmap(ptr, size);
+#else
+        free(ptr);
+#endif
+    }
+};
+
+struct BenchResult
+{
+    double nsPerSide;
+    double bytesPerSec;
+    double allocsPerIter;
+    double allocBytesPerIter;
+    size_t chunks;
+};
+
+// Generates the mesh once into dst. Meshes larger than the destination are streamed through it in chunks of whole sides.
+static size_t generateInto(size_t n, Prism_Layout layout, bool indexed, unsigned char *dst, size_t dstBytes)
+{
+    size_t vsize = prismVertexSize(layout);
+    size_t sideBytes = indexed ? PRISM_INDEXED_VERTS_PER_SIDE * vsize + PRISM_INDICES_PER_SIDE * sizeof(uint32_t)
+                               : PRISM_VERTS_PER_SIDE * vsize;
+    size_t reserved = indexed ? 2 * vsize : 0;
+    size_t chunkSides = std::max<size_t>(1, std::min(n, (dstBytes - reserved) / sideBytes));
+    size_t chunks = 0;
+    for (size_t first = 0; first < n; first += chunkSides, chunks++)
+    {
+        size_t count = std::min(chunkSides, n - first);
+        if (indexed)
+        {
+            prismIndexedSides(n, first, count, layout, dst);
+            prismIndices(n, first, count, (uint32_t *)(dst + PRISM_INDEXED_VERTS_PER_SIDE * count * vsize));
+        }
+        else
+            prismSides(n, first, count, layout, dst);
+    }
+    if (indexed)
+        prismIndexedCenters(layout, dst + dstBytes - reserved);
+    return chunks;
+}
+
+static size_t meshBytes(size_t n, Prism_Layout layout, bool indexed)
+{
+    size_t bytes = prismVertexCount(n, indexed) * prismVertexSize(layout);
+    if (indexed)
+        bytes += prismIndexCount(n) * sizeof(uint32_t);
+    return bytes;
+}
+
+static BenchResult run(const BenchConfig &cfg, Bench_Target target, Prism_Layout layout, bool indexed, size_t n)
+{
+    size_t total = meshBytes(n, layout, indexed);
+    size_t bytes = std::min(total, cfg.maxBytes);
+    MappedRegion *region = target == TARGET_MAPPED ? new MappedRegion(bytes) : NULL;
+    if (region && !region->ptr)
+    {
+        fprintf(stderr, "mmap of %zu bytes failed\n", bytes);
+        exit(1);
+    }
+    // Warm up (touches the mapping so page faults are not billed to the first timed iteration)
+    if (region)
+        generateInto(n, layout, indexed, (unsigned char *)region->ptr, bytes);
+
+    size_t iterations = 0, chunks = 0;
+    size_t allocs0 = benchAllocCount(), allocBytes0 = benchAllocBytes();
+    double elapsed = repeatFor(cfg, [&]() {
+        if (target == TARGET_HOST)
+        {
+            std::vector<unsigned char> host(bytes);
+            chunks = generateInto(n, layout, indexed, host.data(), bytes);
+        }
+        else
+            chunks = generateInto(n, layout, indexed, (unsigned char *)region->ptr, bytes);
+    }, iterations);
+
+    BenchResult r;
+    r.nsPerSide = elapsed * 1e9 / ((double)iterations * n);
+    r.bytesPerSec = (double)total * iterations / elapsed;
+    r.allocsPerIter = (double)(benchAllocCount() - allocs0) / iterations;
+    r.allocBytesPerIter = (double)(benchAllocBytes() - allocBytes0) / iterations;
+    r.chunks = chunks;
+    delete region;
+    return r;
+}
+
+static const char *targetNames[] = {"host", "mapped"};
+static const char *layoutNames[] = {"float", "packed"};
+static const char *meshNames[] = {"unindexed", "indexed"};
+
+// returns the index of name in names, or -1
+static int lookup(const std::string &name, const char *const *names, int count)
+{
+    for (int i = 0; i < count; i++)
+        if (name == names[i])
+            return i;
+    return -1;
+}
+
+bool runGenerateWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 5)
+        return false;
+    int target = lookup(fields[1], targetNames, 2);
+    int layout = lookup(fields[2], layoutNames, 2);
+    int indexed = lookup(fields[3], meshNames, 2);
+    size_t n = strtoull(fields[4].c_str(), NULL, 10);
+    if (target < 0 || layout < 0 || indexed < 0 || n < 3)
+        return false;
+    BenchResult r = run(cfg, (Bench_Target)target, (Prism_Layout)layout, indexed, n);
+    metrics["ns/side"] = r.nsPerSide;
+    metrics["allocs"] = r.allocsPerIter;
+    metrics["bytes/side"] = (double)meshBytes(n, (Prism_Layout)layout, indexed) / n;
+    return true;
+}
+
+void generateTable(const BenchConfig &cfg)
+{
+    std::vector<size_t> sizes;
+    sizes.push_back(3);
+    for (size_t n = 10; n <= cfg.maxN; n *= 10)
+        sizes.push_back(n);
+
+    printf("%-7s %-7s %-9s %10s %10s %10s %10s %12s %7s\n",
+           "target", "layout", "mesh", "n", "ns/side", "MB/s", "allocs", "alloc bytes", "chunks");
+    for (int t = TARGET_HOST; t <= TARGET_MAPPED; t++)
+        for (int l = PRISM_FLOAT; l <= PRISM_PACKED; l++)
+            for (int indexed = 0; indexed < 2; indexed++)
+                for (size_t i = 0; i < sizes.size(); i++)
+                {
+                    BenchResult r = run(cfg, (Bench_Target)t, (Prism_Layout)l, indexed, sizes[i]);
+                    printf("%-7s %-7s %-9s %10zu %10.2f %10.1f %10.2f %12.0f %7zu\n",
+                           targetNames[t], layoutNames[l], meshNames[indexed], sizes[i],
+                           r.nsPerSide, r.bytesPerSec / 1e6, r.allocsPerIter, r.allocBytesPerIter, r.chunks);
+                    fflush(stdout);
+                }
+}
@@ -0,0 +1,160 @@
+// Benchmarks for the CPU side of the prism pipeline. Nothing here needs a GL context, so it runs on any CI machine.
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+#include "bench.h"
+#include "baseline.h"
+
+// Allocation counting
+// ------------------------------------------------------------------------
+static std::atomic<size_t> allocCount(0);
+static std::atomic<size_t> allocBytes(0);
+
+// Every form of new and delete is replaced, all backed by malloc and free so any pair matches. GCC can't tell the
+// freed pointers came from malloc through the replaced new and warns about the pairing anyway.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void *operator new(size_t size)
+{
+    allocCount++;
+    allocBytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    allocCount++;
+    allocBytes += size;
+    return malloc(size ? size : 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+size_t benchAllocCount()
+{
+    return allocCount;
+}
+
+size_t benchAllocBytes()
+{
+    return allocBytes;
+}
+
+static void usage()
+{
+    printf("Usage : ./bench [options]                    sweep the generator over n\n"
+           "        ./bench --run <workload> [options]   print the metrics of one workload\n"
+           "        ./bench --check <baseline> [options] fail if any workload regressed against the baseline\n"
+           "        ./bench --update <baseline> [options] replace the baseline values with new measurements\n"
+           "        ./bench --scaling <n> [options]      software rasterizer speedup over thread counts\n"
+           "Options:\n"
+           "  --max-n <n>        largest n of the sweep\n"
+           "  --max-mem <MiB>    larger meshes are streamed through a buffer of this size\n"
+           "  --min-time <ms>    minimum run time of each measurement\n"
+           "  --runs <n>         runs of each workload --check and --update keep the best of, default 3\n"
+           "  --exact <on|off>   --check and --update only the metrics of 0%% tolerance, which no machine changes\n"
+           "Workloads:\n"
+           "  gen.<host|mapped>.<float|packed>.<unindexed|indexed>.<n>\n"
+           "  frame.<instances>\n"
+           "  raster.<n>.<threads>               threads 0 uses every hardware thread\n"
+           "  ray.<n>.<threads>\n"
+           "  sort.<n>.<threads>                 back to front triangle order of --transparency sorted\n"
+           "  scene.<prisms>.<threads>           spin, motion and model matrices of the instanced prisms\n"
+           "  matrix.<4x4|4x3>.<path>.<prisms>   model matrices built by the simd, scalar or glm path, error against glm\n"
+           "  bvh.<op>.<prisms>.<threads>        build, refit, ray, frustum or aabb queries of the prism hierarchy\n"
+           "  pick.<prisms>                      mouse picks of the exact prism and face under random cursor positions\n"
+           "  collide.<field>.<prisms>.<threads> overlapping pairs of a dense or sparse field of prisms\n"
+           "  export.<ply|stl|glb>.<n>           --export of the prism streamed into the null device\n"
+           "  yuv.<simd|scalar>.<width>x<height> RGBA to Y4M's 4:2:0 conversion of --capture, a frame at a time\n"
+           "  scenefile.<binary|text>.<prisms>   loading a --scene file, the binary one mapped, the text one parsed\n"
+           "  arena.<churn|compact>.<ranges>     allocations and releases or full defragmentation of a GPU buffer arena\n");
+    exit(0);
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig cfg;
+    std::string run, check, update;
+    int scaling = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            usage();
+        if (arg == "--max-n")
+            cfg.maxN = strtoull(argv[++i], NULL, 10);
+        else if (arg == "--max-mem")
+            cfg.maxBytes = strtoull(argv[++i], NULL, 10) << 20;
+        else if (arg == "--min-time")
+            cfg.minSeconds = atof(argv[++i]) / 1000.0;
+        else if (arg == "--runs")
+            cfg.runs = std::max(1, atoi(argv[++i]));
+        else if (arg == "--exact")
+            cfg.exact = std::string(argv[++i]) == "on";
+        else if (arg == "--run")
+            run = argv[++i];
+        else if (arg == "--check")
+            check = argv[++i];
+        else if (arg == "--update")
+            update = argv[++i];
+        else if (arg == "--scaling")
+            scaling = atoi(argv[++i]);
+        else
+            usage();
+    }
+
+    if (!run.empty())
+    {
+        Metrics metrics;
+        if (!runWorkload(run, cfg, metrics))
+        {
+            printf("Unknown workload %s\n", run.c_str());
+            return 1;
+        }
+        for (Metrics::const_iterator m = metrics.begin(); m != metrics.end(); ++m)
+            printf("%-12s %12.3f\n", m->first.c_str(), m->second);
+        return 0;
+    }
+    if (!check.empty() || !update.empty())
+    {
+        const std::string &path = check.empty() ? update : check;
+        Baseline baseline;
+        if (!readBaseline(path, baseline))
+            return 1;
+        bool pass = checkBaseline(baseline, cfg, !update.empty());
+        if (!update.empty())
+            return writeBaseline(path, baseline) ? 0 : 1;
+        printf(pass ? "No regressions\n" : "Performance regressed beyond tolerance\n");
+        return pass ? 0 : 1;
+    }
+    if (scaling >= 3)
+    {
+        rasterScaling(scaling, cfg);
+        return 0;
+    }
+    generateTable(cfg);
+    return 0;
+}
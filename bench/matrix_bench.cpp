@@ -0,0 +1,92 @@
+// Model matrices of many prisms from structure of arrays transforms: the batched builder, its scalar reference and glm.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "matrixbatch.h"
+#include "scene.h"
+#include "bench.h"
+
+namespace
+{
+enum MatrixPath { PATH_SIMD, PATH_SCALAR, PATH_GLM };
+
+void buildWith(MatrixPath path, const TransformArrays &t, size_t count, MatrixLayout layout, float *out)
+{
+    if (path == PATH_SIMD)
+        buildMatrices(t, glm::vec3(0.0f), 0, count, layout, out);
+    else if (path == PATH_SCALAR)
+        buildMatricesScalar(t, glm::vec3(0.0f), 0, count, layout, out);
+    else
+        for (size_t i = 0; i < count; i++)
+        {
+            // What the render loop did per object before the scene store
+            glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(t.x[i], t.y[i], t.z[i]));
+            m = glm::rotate(m, t.angle[i], glm::vec3(t.axisX[i], t.axisY[i], t.axisZ[i]));
+            float *o = out + i * matrixFloats(layout);
+            for (int j = 0; j < (int)matrixFloats(layout); j++)
+                o[j] = layout == MATRIX_4X4 ? m[j / 4][j % 4] : m[j % 4][j / 4];
+        }
+}
+}
+
+// matrix.<4x4|4x3>.<simd|scalar|glm>.<prisms>, single threaded, with the largest deviation from glm in millionths
+bool runMatrixWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 4 || (fields[1] != "4x4" && fields[1] != "4x3"))
+        return false;
+    MatrixLayout layout = fields[1] == "4x4" ? MATRIX_4X4 : MATRIX_4X3;
+    MatrixPath path;
+    if (fields[2] == "simd")
+        path = PATH_SIMD;
+    else if (fields[2] == "scalar")
+        path = PATH_SCALAR;
+    else if (fields[2] == "glm")
+        path = PATH_GLM;
+    else
+        return false;
+    size_t prisms = strtoull(fields[3].c_str(), NULL, 10);
+    if (!prisms)
+        return false;
+
+    // Random axes and angles over the whole turn, a count that isn't a multiple of 8 exercises the tail
+    Scene scene;
+    scene.grid(prisms, 6, 1.5f);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < prisms; i++)
+    {
+        float v[4];
+        for (int j = 0; j < 4; j++)
+        {
+            seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+            v[j] = (seed & 0xFFFF) / 32768.0f - 1.0f;
+        }
+        glm::vec3 axis = glm::normalize(glm::vec3(v[0], v[1], v[2]) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        scene.axisX[i] = axis.x, scene.axisY[i] = axis.y, scene.axisZ[i] = axis.z;
+        scene.angle[i] = v[3] * 6.2831853f;
+    }
+    TransformArrays t = scene.transforms();
+    // Stands in for the mapped instance buffer
+    std::vector<float> out(prisms * matrixFloats(layout));
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() { buildWith(path, t, prisms, layout, out.data()); }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    std::vector<float> reference(out.size());
+    buildWith(PATH_GLM, t, prisms, layout, reference.data());
+    double error = 0;
+    for (size_t i = 0; i < out.size(); i++)
+        error = std::max(error, std::fabs((double)out[i] - reference[i]) / std::max(1.0, std::fabs((double)reference[i])));
+
+    metrics["ns/matrix"] = elapsed * 1e9 / ((double)iterations * prisms);
+    metrics["allocs"] = (double)allocs / iterations;
+    metrics["error.ppm"] = error * 1e6;
+    return true;
+}
@@ -0,0 +1,73 @@
+// Mouse picking: the ray under a cursor position through the hierarchy to the exact prism and face it hits.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bvh.h"
+#include "camera.h"
+#include "pick.h"
+#include "scene.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// Picks per timed call
+const size_t PICK_BENCH_CLICKS = 1024;
+
+// pick.<prisms>, clicks at random window positions on a rotated grid seen at an angle, like the camera of
+// scenarios/swarm.scn. The hierarchy is built once, outside the timing.
+bool runPickWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 2)
+        return false;
+    size_t prisms = strtoull(fields[1].c_str(), NULL, 10);
+    if (!prisms)
+        return false;
+
+    Scene scene;
+    scene.grid(prisms, 6, 1.5f, 1.0f);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < prisms; i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        glm::vec3 axis = glm::normalize(glm::vec3((seed & 0xFF) / 128.0f - 1.0f, (seed >> 8 & 0xFF) / 128.0f - 1.0f,
+                                                  (seed >> 16 & 0xFF) / 128.0f - 0.9f));
+        scene.axisX[i] = axis.x, scene.axisY[i] = axis.y, scene.axisZ[i] = axis.z;
+    }
+    ThreadPool pool;
+    Bvh bvh;
+    bvh.build(pool, scene.transforms(), prisms);
+
+    Camera camera(glm::vec3(2.0f, 20.0f, 20.0f));
+    camera.Target = glm::vec3(20.0f, 20.0f, 0.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+    // The rays are part of what a click costs, so only the cursor positions are drawn up front
+    std::vector<glm::vec2> cursors(PICK_BENCH_CLICKS);
+    for (size_t i = 0; i < cursors.size(); i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        cursors[i] = glm::vec2((seed & 0xFFFF) * (800.0f / 65536.0f), (seed >> 16) * (800.0f / 65536.0f));
+    }
+
+    size_t iterations = 0, hits = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        for (size_t i = 0; i < PICK_BENCH_CLICKS; i++)
+        {
+            glm::vec3 origin, dir;
+            pickRay(camera, projection, cursors[i].x, cursors[i].y, 800, 800, origin, dir);
+            hits += pickScene(bvh, scene, glm::vec3(0.0f), origin, dir).index >= 0;
+        }
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    // Keep the results observable so the picks can't be optimized away
+    volatile size_t sink = hits;
+    (void)sink;
+
+    metrics["ns/pick"] = elapsed * 1e9 / ((double)iterations * PICK_BENCH_CLICKS);
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
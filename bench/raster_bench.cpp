@@ -0,0 +1,123 @@
+// Software renderer workloads: one prism drawn into an 800x600 framebuffer by the --backend soft and ray pipelines.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camera.h"
+#include "prism.h"
+#include "raytrace.h"
+#include "softraster.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// The view main() starts with, turned a bit so the caps and the sides are all on screen
+static glm::mat4 rasterMVP()
+{
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), glm::vec3(1.0f, 0, 0));
+    model = glm::rotate(model, glm::radians(20.0f), glm::vec3(0, 1.0f, 0));
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+    return projection * camera.GetViewMatrix() * model;
+}
+
+// Draws the prism until cfg.minSeconds have passed, returning the seconds per frame
+static double rasterFrame(const std::vector<float> &vertices, size_t vertexCount, unsigned threads, const BenchConfig &cfg,
+                          size_t &allocs, size_t &triangles)
+{
+    ThreadPool pool(threads);
+    SoftRasterizer raster(pool);
+    Framebuffer fb(800, 600);
+    glm::mat4 mvp = rasterMVP();
+    // The first frame sizes the bins, after that a frame should not allocate
+    raster.draw(vertices.data(), vertexCount, mvp, fb);
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        raster.draw(vertices.data(), vertexCount, mvp, fb);
+    }, iterations);
+    allocs = (benchAllocCount() - allocs0) / iterations;
+    triangles = raster.trianglesDrawn();
+    return elapsed / iterations;
+}
+
+// raster.<n>.<threads>, threads 0 uses every hardware thread
+bool runRasterWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3)
+        return false;
+    int n = atoi(fields[1].c_str());
+    unsigned threads = (unsigned)atoi(fields[2].c_str());
+    if (n < 3)
+        return false;
+
+    size_t vertexCount = prismVertexCount(n, false);
+    std::vector<float> vertices(vertexCount * 6);
+    prismGenerate(n, PRISM_FLOAT, false, vertices.data(), NULL);
+    size_t allocs, triangles;
+    double seconds = rasterFrame(vertices, vertexCount, threads, cfg, allocs, triangles);
+
+    metrics["ms/frame"] = seconds * 1e3;
+    metrics["ns/triangle"] = seconds * 1e9 / (vertexCount / 3);
+    metrics["allocs"] = (double)allocs;
+    return true;
+}
+
+void rasterScaling(int n, const BenchConfig &cfg)
+{
+    size_t vertexCount = prismVertexCount(n, false);
+    std::vector<float> vertices(vertexCount * 6);
+    prismGenerate(n, PRISM_FLOAT, false, vertices.data(), NULL);
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    printf("Software rasterizer, n = %d, %zu triangles, 800x600\n", n, vertexCount / 3);
+    printf("%8s %12s %12s %10s %10s\n", "threads", "ms/frame", "visible", "speedup", "efficiency");
+    double single = 0;
+    for (unsigned threads = 1; threads <= maxThreads; threads++)
+    {
+        size_t allocs, triangles;
+        double seconds = rasterFrame(vertices, vertexCount, threads, cfg, allocs, triangles);
+        if (threads == 1)
+            single = seconds;
+        printf("%8u %12.3f %12zu %9.2fx %9.0f%%\n", threads, seconds * 1e3, triangles, single / seconds,
+               single / seconds / threads * 100);
+        fflush(stdout);
+    }
+}
+
+// ray.<n>.<threads>, the analytic ray tracer, which needs no mesh so n can go up to 10^9
+bool runRayWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3)
+        return false;
+    size_t n = strtoull(fields[1].c_str(), NULL, 10);
+    unsigned threads = (unsigned)atoi(fields[2].c_str());
+    if (n < 3)
+        return false;
+
+    ThreadPool pool(threads);
+    PrismTracer tracer(pool);
+    Framebuffer fb(800, 600);
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(30.0f), glm::vec3(1.0f, 0, 0));
+    model = glm::rotate(model, glm::radians(20.0f), glm::vec3(0, 1.0f, 0));
+    glm::mat4 view = camera.GetViewMatrix();
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        tracer.render(n, model, view, projection, fb);
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    metrics["ms/frame"] = elapsed * 1e3 / iterations;
+    metrics["ns/pixel"] = elapsed * 1e9 / ((double)iterations * fb.width * fb.height);
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
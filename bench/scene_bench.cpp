@@ -0,0 +1,44 @@
+// Per-frame update of the structure of arrays scene: spin and motion of every prism, then its model matrix.
+#include <glm/glm.hpp>
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// scene.<prisms>.<threads>, every prism spins and drifts, threads 0 uses every hardware thread
+bool runSceneWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3)
+        return false;
+    size_t prisms = strtoull(fields[1].c_str(), NULL, 10);
+    unsigned threads = (unsigned)atoi(fields[2].c_str());
+    if (!prisms)
+        return false;
+
+    Scene scene;
+    scene.grid(prisms, 6, 1.5f, 1.0f);
+    ThreadPool pool(threads);
+    // Stands in for the mapped instance buffer
+    std::vector<glm::mat4> models(prisms);
+
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        scene.update(pool, 1.0f / 60.0f, true);
+        scene.writeMatrices(pool, glm::vec3(0.0f), &models[0][0][0]);
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    // Keep the matrices observable so the work can't be optimized away
+    volatile float sink = models[prisms - 1][3][0];
+    (void)sink;
+
+    metrics["ms/frame"] = elapsed * 1e3 / iterations;
+    metrics["ns/prism"] = elapsed * 1e9 / ((double)iterations * prisms);
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
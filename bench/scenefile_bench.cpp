@@ -0,0 +1,109 @@
+// Scene files: mapping the binary format in place against parsing the text one, from a file in the working directory
+// that the page cache holds after the first load.
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "scene.h"
+#include "scenefile.h"
+#include "bench.h"
+
+// Reads a value from every page of the scene's arrays
+static uint32_t touchPages(const Scene &scene)
+{
+    uint32_t sum = 0;
+    for (int f = 0; f < SCENE_FIELDS; f++)
+        for (size_t i = 0; i < scene.size(); i += SCENE_FILE_ALIGNMENT / 4)
+            sum += ((const uint32_t *)scene.field(f))[i];
+    return sum;
+}
+
+// scenefile.<binary|text>.<prisms>, a whole load per call. For the binary file that is opening, mapping and checking
+// it, and ms/touch is reading a value from every page of the arrays afterwards, the page faults the load put off.
+bool runSceneFileWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3 || (fields[1] != "binary" && fields[1] != "text"))
+        return false;
+    bool binary = fields[1] == "binary";
+    size_t prisms = strtoull(fields[2].c_str(), NULL, 10);
+    if (!prisms)
+        return false;
+
+    Scene scene;
+    scene.grid(prisms, 6, 1.5f, 1.0f);
+    uint32_t seed = 7;
+    for (size_t i = 0; i < prisms; i++)
+    {
+        seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+        glm::vec3 axis = glm::normalize(glm::vec3((seed & 0xFF) / 128.0f - 1.0f, (seed >> 8 & 0xFF) / 128.0f - 1.0f,
+                                                  (seed >> 16 & 0xFF) / 128.0f - 0.9f));
+        scene.axisX[i] = axis.x, scene.axisY[i] = axis.y, scene.axisZ[i] = axis.z;
+        scene.sides[i] = 3 + seed % 8;
+        scene.color[i] = seed | 0xFF000000u;
+    }
+    std::string path = "scenefile_bench." + fields[1];
+    if (binary)
+    {
+        if (!writeSceneFile(scene, path))
+            return false;
+    }
+    else
+    {
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+        fprintf(file, "extent %.9g\n", scene.extent);
+        for (size_t i = 0; i < prisms; i++)
+        {
+            uint32_t c = scene.color[i];
+            fprintf(file, "prism %.9g %.9g %.9g %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %08X\n", scene.x[i],
+                    scene.y[i], scene.z[i], scene.sides[i], scene.axisX[i], scene.axisY[i], scene.axisZ[i],
+                    glm::degrees(scene.angle[i]), glm::degrees(scene.spin[i]), scene.vx[i], scene.vy[i], scene.vz[i],
+                    c << 24 | (c << 8 & 0xFF0000u) | (c >> 8 & 0xFF00u) | c >> 24);
+        }
+        fclose(file);
+    }
+
+    // The binary file was written past the page cache, the first load reads it in
+    Scene loaded;
+    loadScene(path, loaded);
+    uint32_t sum = touchPages(loaded);
+    double touchSeconds = 0;
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, [&]() {
+        if (binary)
+        {
+            mapSceneFile(path, loaded);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            sum += touchPages(loaded);
+            touchSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        else
+            readSceneText(path, loaded);
+    }, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    // The binary file holds exactly the scene's values. The text one rounds the angles through degrees and the axes
+    // get normalized again, the rest reads back exactly.
+    size_t mismatches = loaded.size() != prisms;
+    for (int f = 0; f < SCENE_FIELDS && !mismatches; f++)
+        if (binary || f < SCENE_AXIS_X || f >= SCENE_VX)
+            mismatches += memcmp(loaded.field(f), scene.field(f), prisms * 4) != 0;
+    volatile uint32_t sink = sum;
+    (void)sink;
+    loaded.clear();
+    remove(path.c_str());
+
+    metrics["ms/load"] = (elapsed - touchSeconds) * 1e3 / iterations;
+    if (binary)
+        metrics["ms/touch"] = touchSeconds * 1e3 / iterations;
+    metrics["mismatches"] = (double)mismatches;
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
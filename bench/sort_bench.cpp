@@ -0,0 +1,55 @@
+// Back to front triangle ordering of --transparency sorted: view depths, parallel radix sort and the index buffer.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "depthsort.h"
+#include "prism.h"
+#include "threadpool.h"
+#include "bench.h"
+
+// sort.<n>.<threads>, the model turns every frame so every frame sorts, threads 0 uses every hardware thread
+bool runSortWorkload(const std::vector<std::string> &fields, const BenchConfig &cfg, Metrics &metrics)
+{
+    if (fields.size() != 3)
+        return false;
+    size_t n = strtoull(fields[1].c_str(), NULL, 10);
+    unsigned threads = (unsigned)atoi(fields[2].c_str());
+    if (n < 3)
+        return false;
+
+    size_t vertexCount = prismVertexCount(n, false);
+    std::vector<float> vertices(vertexCount * 6);
+    prismGenerate(n, PRISM_FLOAT, false, vertices.data(), NULL);
+    ThreadPool pool(threads);
+    DepthSorter sorter(pool);
+    sorter.setMesh(vertices.data(), prismVertexSize(PRISM_FLOAT), vertexCount);
+    // Stands in for the mapped index buffer
+    std::vector<uint32_t> indices(vertexCount);
+
+    Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+    glm::mat4 view = camera.GetViewMatrix();
+    float angle = 0;
+    auto frame = [&]() {
+        angle += 1.0f;
+        glm::mat4 model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(1.0f, 0.3f, 0));
+        sorter.sort(view * model);
+        sorter.writeIndices(indices.data());
+    };
+    // The first frame sizes the sort buffers
+    frame();
+    size_t iterations = 0;
+    size_t allocs0 = benchAllocCount();
+    double elapsed = repeatFor(cfg, frame, iterations);
+    size_t allocs = benchAllocCount() - allocs0;
+
+    metrics["ms/frame"] = elapsed * 1e3 / iterations;
+    metrics["ns/triangle"] = elapsed * 1e9 / ((double)iterations * sorter.triangles());
+    metrics["allocs"] = (double)allocs / iterations;
+    return true;
+}
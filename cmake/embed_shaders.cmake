@@ -0,0 +1,23 @@
+# Writes every *.shader of SHADER_DIR into OUTPUT as constexpr raw string literals, so the app needs no shader files at
+# run time. Runs in script mode at build time: cmake -DSHADER_DIR=<dir> -DOUTPUT=<header> -P embed_shaders.cmake
+file(GLOB SHADERS "${SHADER_DIR}/*.shader")
+list(SORT SHADERS)
+
+set(CONTENT "// Generated from src/*.shader by cmake/embed_shaders.cmake, do not edit\n")
+set(CONTENT "${CONTENT}#ifndef EMBEDDED_SHADERS_H\n#define EMBEDDED_SHADERS_H\n\n")
+set(CONTENT "${CONTENT}struct EmbeddedShader\n{\n    const char *name;\n    const char *source;\n};\n\n")
+set(CONTENT "${CONTENT}constexpr EmbeddedShader embeddedShaders[] = {\n")
+foreach(SHADER ${SHADERS})
+  get_filename_component(NAME "${SHADER}" NAME)
+  file(READ "${SHADER}" SOURCE)
+  if (SOURCE MATCHES "\\)SHADER\"")
+    message(FATAL_ERROR "${SHADER} contains the raw string delimiter )SHADER\"")
+  endif()
+  set(CONTENT "${CONTENT}    {\"${NAME}\", R\"SHADER(${SOURCE})SHADER\"},\n")
+endforeach()
+set(CONTENT "${CONTENT}};\n#endif\n")
+
+# Only touch the header when a shader changed, so unrelated builds don't recompile main.cpp
+file(WRITE "${OUTPUT}.tmp" "${CONTENT}")
+configure_file("${OUTPUT}.tmp" "${OUTPUT}" COPYONLY)
+file(REMOVE "${OUTPUT}.tmp")
@@ -0,0 +1,29 @@
+#ifndef ANALYTIC_H
+#define ANALYTIC_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+#include "prism.h"
+
+// NDC rectangle (min x, min y, max x, max y) covering the prism under mvp, from the corners of its bounding box. When the
+// box reaches behind the near plane the projection of the corners says nothing, so the whole screen is returned. The
+// rectangle is empty (min > max) when the prism is off screen.
+inline glm::vec4 prismScreenBounds(const glm::mat4 &mvp)
+{
+    glm::vec2 lo(1e30f), hi(-1e30f);
+    for (int i = 0; i < 8; i++)
+    {
+        glm::vec4 corner((i & 1) ? prismRadius : -prismRadius, (i & 2) ? prismRadius : -prismRadius,
+                         (i & 4) ? prismLen : -prismLen, 1.0f);
+        glm::vec4 clip = mvp * corner;
+        if (clip.z < -clip.w || clip.w <= 0.0f)
+            return glm::vec4(-1.0f, -1.0f, 1.0f, 1.0f);
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+    return glm::vec4(glm::max(lo, glm::vec2(-1.0f)), glm::min(hi, glm::vec2(1.0f)));
+}
+#endif
@@ -0,0 +1,442 @@
+#ifndef BUFFERARENA_H
+#define BUFFERARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Handle of no range
+const uint32_t ARENA_NONE = 0xFFFFFFFFu;
+// Free lists per power of two of size, the second level splits each into this many size classes
+const int ARENA_SL_BITS = 4;
+const int ARENA_SL_COUNT = 1 << ARENA_SL_BITS;
+const int ARENA_FL_COUNT = 64 - ARENA_SL_BITS + 1;
+// Bytes an idle frame may move to defragment an arena, and the scratch buffer moves go through
+const size_t ARENA_DEFRAG_BYTES = 1 << 20;
+
+inline int arenaLowestBit(uint64_t bits)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(bits);
+#else
+    int i = 0;
+    while (!(bits >> i & 1))
+        i++;
+    return i;
+#endif
+}
+
+inline int arenaLog2(uint64_t value)
+{
+#ifdef __GNUC__
+    return 63 - __builtin_clzll(value);
+#else
+    int i = 63;
+    while (!(value >> i))
+        i--;
+    return i;
+#endif
+}
+
+// What an arena holds, in units
+struct ArenaStats
+{
+    uint64_t capacity;
+    uint64_t used;
+    uint64_t largestFree;
+    size_t ranges;     // allocated
+    size_t freeRanges; // holes between them and the free tail
+
+    // Share of the free space outside its largest block, what an allocation of all of it would fail on
+    double fragmentation() const
+    {
+        uint64_t free = capacity - used;
+        return free ? 1.0 - (double)largestFree / free : 0.0;
+    }
+};
+
+// Hands out ranges of [0, capacity) units, a TLSF allocator: free blocks sit in segregated lists of size classes,
+// found in constant time through two levels of bitmaps, and a released range merges with its free neighbours right
+// away. The bookkeeping lives on the CPU, apart from the memory it describes, so it can manage a GPU buffer. Handles
+// stay valid until released, compact() moves ranges down over the holes without changing them.
+class RangeAllocator
+{
+public:
+    RangeAllocator()
+    {
+        reset(0);
+    }
+
+    // Forgets every range, [0, units) becomes one free block
+    void reset(uint64_t units)
+    {
+        blocks.clear();
+        unusedBlocks.clear();
+        std::fill(&heads[0][0], &heads[0][0] + ARENA_FL_COUNT * ARENA_SL_COUNT, ARENA_NONE);
+        std::fill(slBitmap, slBitmap + ARENA_FL_COUNT, 0u);
+        flBitmap = 0;
+        capacity = units;
+        used = 0;
+        live = 0;
+        first = ARENA_NONE;
+        if (!units)
+            return;
+        first = newBlock(0, units, ARENA_NONE, ARENA_NONE);
+        insertFree(first);
+    }
+
+    // A range of units, ARENA_NONE when no free block is that large
+    uint32_t allocate(uint64_t units)
+    {
+        if (!units || units > capacity - used)
+            return ARENA_NONE;
+        // Round up to the next size class, so any block of the class found is large enough
+        uint64_t rounded = units;
+        if (units >= (uint64_t)ARENA_SL_COUNT)
+            rounded += (1ull << (arenaLog2(units) - ARENA_SL_BITS)) - 1;
+        int fl, sl;
+        mapping(rounded, fl, sl);
+        uint32_t slMap = slBitmap[fl] & (~0u << sl);
+        if (!slMap)
+        {
+            uint64_t flMap = fl + 1 < 64 ? flBitmap & (~0ull << (fl + 1)) : 0;
+            if (flMap)
+            {
+                fl = arenaLowestBit(flMap);
+                slMap = slBitmap[fl];
+            }
+        }
+        uint32_t b = slMap ? heads[fl][arenaLowestBit(slMap)] : ARENA_NONE;
+        // Nothing of a larger class, a block of the request's own class may still fit it
+        if (b == ARENA_NONE)
+        {
+            mapping(units, fl, sl);
+            for (b = heads[fl][sl]; b != ARENA_NONE && blocks[b].size < units; b = blocks[b].nextFree)
+                ;
+            if (b == ARENA_NONE)
+                return ARENA_NONE;
+        }
+        removeFree(b);
+        if (blocks[b].size > units)
+        {
+            uint32_t rest = newBlock(blocks[b].offset + units, blocks[b].size - units, b, blocks[b].next);
+            if (blocks[rest].next != ARENA_NONE)
+                blocks[blocks[rest].next].prev = rest;
+            blocks[b].next = rest;
+            blocks[b].size = units;
+            insertFree(rest);
+        }
+        blocks[b].free = false;
+        used += units;
+        live++;
+        return b;
+    }
+
+    void release(uint32_t range)
+    {
+        used -= blocks[range].size;
+        live--;
+        blocks[range].free = true;
+        uint32_t prev = blocks[range].prev, next = blocks[range].next;
+        if (next != ARENA_NONE && blocks[next].free)
+        {
+            removeFree(next);
+            absorbNext(range);
+        }
+        if (prev != ARENA_NONE && blocks[prev].free)
+        {
+            removeFree(prev);
+            absorbNext(prev);
+            range = prev;
+        }
+        insertFree(range);
+    }
+
+    uint64_t offset(uint32_t range) const
+    {
+        return blocks[range].offset;
+    }
+
+    uint64_t size(uint32_t range) const
+    {
+        return blocks[range].size;
+    }
+
+    // Slides allocated ranges down over the free blocks before them, lowest first, until about budget units have
+    // moved, calling move(range, from, to, units) for each. Returns the units moved, 0 once there are no holes left.
+    template <class F>
+    uint64_t compact(uint64_t budget, F move)
+    {
+        uint64_t moved = 0;
+        uint32_t b = first;
+        while (b != ARENA_NONE)
+        {
+            uint32_t next = blocks[b].next;
+            if (!blocks[b].free || next == ARENA_NONE || blocks[next].free)
+            {
+                b = next;
+                continue;
+            }
+            if (moved && moved + blocks[next].size > budget)
+                break;
+            // Swap the hole b with the range after it, then let the hole merge with whatever is free past it
+            uint64_t from = blocks[next].offset, to = blocks[b].offset;
+            blocks[next].offset = to;
+            blocks[b].offset = to + blocks[next].size;
+            uint32_t prev = blocks[b].prev, after = blocks[next].next;
+            blocks[next].prev = prev;
+            blocks[next].next = b;
+            blocks[b].prev = next;
+            blocks[b].next = after;
+            if (prev != ARENA_NONE)
+                blocks[prev].next = next;
+            else
+                first = next;
+            if (after != ARENA_NONE)
+                blocks[after].prev = b;
+            if (after != ARENA_NONE && blocks[after].free)
+            {
+                removeFree(b);
+                removeFree(after);
+                absorbNext(b);
+                insertFree(b);
+            }
+            move(next, from, to, blocks[next].size);
+            moved += blocks[next].size;
+        }
+        return moved;
+    }
+
+    ArenaStats stats() const
+    {
+        ArenaStats s = {capacity, used, 0, live, 0};
+        for (uint32_t b = first; b != ARENA_NONE; b = blocks[b].next)
+            if (blocks[b].free)
+            {
+                s.largestFree = std::max(s.largestFree, blocks[b].size);
+                s.freeRanges++;
+            }
+        return s;
+    }
+
+private:
+    struct Block
+    {
+        uint64_t offset;
+        uint64_t size;
+        uint32_t prev, next;         // neighbours in memory
+        uint32_t prevFree, nextFree; // in the free list of its size class
+        bool free;
+    };
+    std::vector<Block> blocks;
+    std::vector<uint32_t> unusedBlocks; // entries of blocks merged away, reused first
+    uint32_t heads[ARENA_FL_COUNT][ARENA_SL_COUNT];
+    uint32_t slBitmap[ARENA_FL_COUNT]; // bit sl set when heads[fl][sl] has a block
+    uint64_t flBitmap;                 // bit fl set when any of slBitmap[fl] is
+    uint64_t capacity;
+    uint64_t used;
+    size_t live;
+    uint32_t first; // block at offset 0
+
+    // Size class of a block: below ARENA_SL_COUNT one class per size, above it the power of two and the next
+    // ARENA_SL_BITS bits
+    static void mapping(uint64_t size, int &fl, int &sl)
+    {
+        if (size < (uint64_t)ARENA_SL_COUNT)
+        {
+            fl = 0;
+            sl = (int)size;
+            return;
+        }
+        int l = arenaLog2(size);
+        fl = l - ARENA_SL_BITS + 1;
+        sl = (int)(size >> (l - ARENA_SL_BITS)) - ARENA_SL_COUNT;
+    }
+
+    uint32_t newBlock(uint64_t offset, uint64_t size, uint32_t prev, uint32_t next)
+    {
+        Block block = {offset, size, prev, next, ARENA_NONE, ARENA_NONE, true};
+        if (!unusedBlocks.empty())
+        {
+            uint32_t b = unusedBlocks.back();
+            unusedBlocks.pop_back();
+            blocks[b] = block;
+            return b;
+        }
+        blocks.push_back(block);
+        return (uint32_t)blocks.size() - 1;
+    }
+
+    void insertFree(uint32_t b)
+    {
+        int fl, sl;
+        mapping(blocks[b].size, fl, sl);
+        blocks[b].free = true;
+        blocks[b].prevFree = ARENA_NONE;
+        blocks[b].nextFree = heads[fl][sl];
+        if (heads[fl][sl] != ARENA_NONE)
+            blocks[heads[fl][sl]].prevFree = b;
+        heads[fl][sl] = b;
+        slBitmap[fl] |= 1u << sl;
+        flBitmap |= 1ull << fl;
+    }
+
+    void removeFree(uint32_t b)
+    {
+        int fl, sl;
+        mapping(blocks[b].size, fl, sl);
+        uint32_t prev = blocks[b].prevFree, next = blocks[b].nextFree;
+        if (prev != ARENA_NONE)
+            blocks[prev].nextFree = next;
+        else
+            heads[fl][sl] = next;
+        if (next != ARENA_NONE)
+            blocks[next].prevFree = prev;
+        if (heads[fl][sl] == ARENA_NONE)
+        {
+            slBitmap[fl] &= ~(1u << sl);
+            if (!slBitmap[fl])
+                flBitmap &= ~(1ull << fl);
+        }
+    }
+
+    // Grows b over the free block after it, which goes away
+    void absorbNext(uint32_t b)
+    {
+        uint32_t next = blocks[b].next;
+        blocks[b].size += blocks[next].size;
+        blocks[b].next = blocks[next].next;
+        if (blocks[b].next != ARENA_NONE)
+            blocks[blocks[b].next].prev = b;
+        unusedBlocks.push_back(next);
+    }
+};
+
+// One GL buffer suballocated by a RangeAllocator in units of a vertex, an index or an instance's attributes, so a range's
+// offset in units is the base vertex or first element of the draws that read it. Ranges are written through
+// GL_COPY_WRITE_BUFFER, which leaves the bindings of the VAO alone. defragment() closes the holes releases leave behind
+// a little at a time, copying the ranges it moves through a scratch buffer because a buffer can't copy onto an
+// overlapping part of itself; the offsets of the moved ranges change, so draws look them up every frame.
+class GpuArena
+{
+public:
+    GpuArena() : buffer(0), scratch(0), unitBytes(1) {}
+
+    void create(size_t unitBytes, uint64_t units, GLenum usage)
+    {
+        this->unitBytes = unitBytes;
+        ranges.reset(units);
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, units * unitBytes, NULL, usage);
+    }
+
+    // A range of at least bytes, ARENA_NONE when there isn't room
+    uint32_t allocate(size_t bytes)
+    {
+        return ranges.allocate((bytes + unitBytes - 1) / unitBytes);
+    }
+
+    void release(uint32_t range)
+    {
+        ranges.release(range);
+    }
+
+    // Offset of a range in units, the base vertex of a mesh
+    GLint first(uint32_t range) const
+    {
+        return (GLint)ranges.offset(range);
+    }
+
+    size_t offset(uint32_t range) const
+    {
+        return ranges.offset(range) * unitBytes;
+    }
+
+    size_t bytes(uint32_t range) const
+    {
+        return ranges.size(range) * unitBytes;
+    }
+
+    // The first bytes of a range to write, NULL if the driver can't map them
+    void *map(uint32_t range, size_t bytes)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset(range), bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    }
+
+    void unmap()
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+
+    void upload(uint32_t range, const void *data, size_t bytes)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset(range), bytes, data);
+    }
+
+    // Moves ranges down over the holes, about budget bytes of them, true if any moved
+    bool defragment(size_t budget)
+    {
+        return ranges.compact((budget + unitBytes - 1) / unitBytes, [&](uint32_t, uint64_t from, uint64_t to, uint64_t units) {
+            copy(from * unitBytes, to * unitBytes, units * unitBytes);
+        }) > 0;
+    }
+
+    ArenaStats stats() const
+    {
+        return ranges.stats();
+    }
+
+    size_t unit() const
+    {
+        return unitBytes;
+    }
+
+    // One line of what the arena holds, for --stats
+    void print(const char *name) const
+    {
+        ArenaStats s = stats();
+        printf("%s arena: %.1f of %.1f MB in %zu ranges, %zu holes, %.0f%% fragmented\n", name,
+               s.used * unitBytes / 1e6, s.capacity * unitBytes / 1e6, s.ranges, s.freeRanges, s.fragmentation() * 100);
+    }
+
+    GLuint id() const
+    {
+        return buffer;
+    }
+
+private:
+    RangeAllocator ranges;
+    GLuint buffer;
+    GLuint scratch; // ARENA_DEFRAG_BYTES, made on the first move
+    size_t unitBytes;
+
+    // Down the buffer in pieces of the scratch buffer's size. A piece may only overwrite the part of the source it
+    // came from, which is in the scratch buffer by then.
+    void copy(size_t from, size_t to, size_t bytes)
+    {
+        if (!scratch)
+        {
+            glGenBuffers(1, &scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glBufferData(GL_COPY_WRITE_BUFFER, ARENA_DEFRAG_BYTES, NULL, GL_STREAM_COPY);
+        }
+        for (size_t done = 0; done < bytes; done += ARENA_DEFRAG_BYTES)
+        {
+            size_t piece = std::min(bytes - done, ARENA_DEFRAG_BYTES);
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from + done, 0, piece);
+            glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, to + done, piece);
+        }
+    }
+};
+#endif
@@ -0,0 +1,596 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "matrixbatch.h"
+#include "prism.h"
+#include "threadpool.h"
+
+// Bins the surface area heuristic evaluates along the split axis
+const int BVH_BINS = 16;
+// Prisms a leaf may hold no matter what the heuristic says, and the node depth where every range becomes a leaf
+const uint32_t BVH_MAX_LEAF = 16;
+const uint32_t BVH_MAX_DEPTH = 60;
+// Prisms per chunk of the parallel loops
+const size_t BVH_GRAIN = 16384;
+
+// Axis aligned box
+struct Aabb
+{
+    glm::vec3 lo, hi;
+
+    Aabb() : lo(1e30f), hi(-1e30f) {} // empty, grows into anything
+    Aabb(const glm::vec3 &lo, const glm::vec3 &hi) : lo(lo), hi(hi) {}
+
+    void grow(const Aabb &b)
+    {
+        lo = glm::min(lo, b.lo);
+        hi = glm::max(hi, b.hi);
+    }
+    void grow(const glm::vec3 &p)
+    {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    // Half the surface area, 0 when empty
+    float area() const
+    {
+        glm::vec3 d = glm::max(hi - lo, glm::vec3(0.0f));
+        return d.x * d.y + d.y * d.z + d.z * d.x;
+    }
+    bool overlaps(const Aabb &b) const
+    {
+        return lo.x <= b.hi.x && b.lo.x <= hi.x && lo.y <= b.hi.y && b.lo.y <= hi.y && lo.z <= b.hi.z && b.lo.z <= hi.z;
+    }
+};
+
+// Box around prism i of the transforms: the exact box of the cylinder the prism fits in, whose axis is the rotated z
+inline Aabb prismBounds(const TransformArrays &t, size_t i)
+{
+    float c = std::cos(t.angle[i]), s = std::sin(t.angle[i]), k = 1.0f - c;
+    float ax = t.axisX[i], ay = t.axisY[i], az = t.axisZ[i];
+    // Third column of the rotation, see buildMatricesScalar
+    glm::vec3 d(k * ax * az + s * ay, k * ay * az - s * ax, k * az * az + c);
+    glm::vec3 r = prismLen * glm::abs(d) + prismRadius * glm::sqrt(glm::max(glm::vec3(1.0f) - d * d, glm::vec3(0.0f)));
+    glm::vec3 p(t.x[i], t.y[i], t.z[i]);
+    return Aabb(p - r, p + r);
+}
+
+// Leaves have a count, their prisms are order[first, first + count). Internal nodes have count 0 and their children at
+// first and first + 1. 32 bytes, two to a cache line.
+struct BvhNode
+{
+    glm::vec3 lo;
+    uint32_t first;
+    glm::vec3 hi;
+    uint32_t count;
+};
+
+// Bounding volume hierarchy over the prisms of structure of arrays transforms, for queries that would otherwise test
+// every prism.
+//
+// build() computes every prism's box in parallel, splits the top levels with binned SAH while binning in parallel and
+// then builds the subtrees below them concurrently. When the prisms move, refit() recomputes the boxes without touching
+// the tree, each subtree on its own thread, and update() rebuilds instead once the SAH cost of the refitted tree has
+// grown by rebuildRatio over the freshly built one.
+//
+// The queries call visit with the index of every prism whose box passes, in front to back order of the boxes for rays.
+class Bvh
+{
+public:
+    Bvh() : rebuildRatio(1.5f), builtCost(0), currentCost(0), topNodes(0) {}
+
+    // How much the SAH cost may grow before update() rebuilds
+    float rebuildRatio;
+
+    void build(ThreadPool &pool, const TransformArrays &t, size_t count)
+    {
+        order.resize(count);
+        boxes.resize(count);
+        centroids.resize(count);
+        pool.parallelFor(count, BVH_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                order[i] = (uint32_t)i;
+                boxes[i] = prismBounds(t, i);
+                centroids[i] = 0.5f * (boxes[i].lo + boxes[i].hi);
+            }
+        });
+
+        nodes.clear();
+        subtrees.clear();
+        if (count == 0)
+        {
+            builtCost = currentCost = 0;
+            topNodes = 0;
+            return;
+        }
+        nodes.push_back(BvhNode());
+        // Top levels one node at a time with parallel binning, until there are enough subtrees to keep every thread busy
+        size_t serialBelow = std::max<size_t>(count / (pool.size() * 8), BVH_GRAIN);
+        std::vector<Range> stack(1, Range(0, 0, (uint32_t)count, 0));
+        while (!stack.empty())
+        {
+            Range r = stack.back();
+            stack.pop_back();
+            if (r.end - r.begin <= serialBelow)
+            {
+                subtrees.push_back(r);
+                continue;
+            }
+            Range left(0, 0, 0, 0), right(0, 0, 0, 0);
+            if (!split(&pool, r, nodes[r.node], left, right))
+                continue;
+            left.node = (uint32_t)nodes.size();
+            right.node = left.node + 1;
+            nodes[r.node].first = left.node;
+            nodes[r.node].count = 0;
+            nodes.push_back(BvhNode());
+            nodes.push_back(BvhNode());
+            stack.push_back(right);
+            stack.push_back(left);
+        }
+        topNodes = nodes.size();
+
+        // Subtrees into nodes of their own, largest first, then appended with their indices moved
+        std::sort(subtrees.begin(), subtrees.end(), [](const Range &a, const Range &b) {
+            return a.end - a.begin > b.end - b.begin;
+        });
+        std::vector<std::vector<BvhNode> > local(subtrees.size());
+        pool.parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                buildSubtree(subtrees[i], local[i]);
+        });
+        for (size_t i = 0; i < subtrees.size(); i++)
+        {
+            // local[0] is the subtree's root, already allocated in the top levels
+            uint32_t base = (uint32_t)nodes.size() - 1;
+            for (size_t j = 0; j < local[i].size(); j++)
+                if (local[i][j].count == 0)
+                    local[i][j].first += base;
+            nodes[subtrees[i].node] = local[i][0];
+            subtrees[i].firstNode = base + 1;
+            subtrees[i].lastNode = base + (uint32_t)local[i].size();
+            nodes.insert(nodes.end(), local[i].begin() + 1, local[i].end());
+        }
+        builtCost = currentCost = cost();
+    }
+
+    // Moves the boxes to where the prisms are now, keeping the tree
+    void refit(ThreadPool &pool, const TransformArrays &t)
+    {
+        pool.parallelFor(boxes.size(), BVH_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                boxes[i] = prismBounds(t, i);
+        });
+        // Children come after their parents, so walking backwards refits bottom up
+        pool.parallelFor(subtrees.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                for (uint32_t n = subtrees[i].lastNode; n > subtrees[i].firstNode; n--)
+                    refitNode(n - 1);
+                refitNode(subtrees[i].node);
+            }
+        });
+        for (size_t n = topNodes; n > 0; n--)
+            refitNode(n - 1);
+        currentCost = nodes.empty() ? 0 : cost();
+    }
+
+    // Refits, or rebuilds when the count changed or the tree degraded. Returns true when it rebuilt.
+    bool update(ThreadPool &pool, const TransformArrays &t, size_t count)
+    {
+        if (count != order.size() || nodes.empty())
+        {
+            build(pool, t, count);
+            return true;
+        }
+        refit(pool, t);
+        if (currentCost > rebuildRatio * builtCost)
+        {
+            build(pool, t, count);
+            return true;
+        }
+        return false;
+    }
+
+    size_t size() const
+    {
+        return order.size();
+    }
+    size_t nodeCount() const
+    {
+        return nodes.size();
+    }
+    // SAH cost of the current boxes over the cost right after the last build, 1 when fresh
+    float quality() const
+    {
+        return builtCost > 0 ? currentCost / builtCost : 1.0f;
+    }
+    // Box of prism i as of the last build or refit
+    const Aabb &bounds(size_t i) const
+    {
+        return boxes[i];
+    }
+
+    // Calls visit(i, tMax) for the prisms whose box the ray origin + t dir, t in [0, tMax), passes through, nearest box
+    // first. tMax may be INFINITY. visit may lower it to the distance of an exact hit, which prunes every box behind it.
+    template <class F>
+    void raycast(const glm::vec3 &origin, const glm::vec3 &dir, float &tMax, F visit) const
+    {
+        if (nodes.empty())
+            return;
+        glm::vec3 inv = 1.0f / dir;
+        // Nodes left to visit with the distance the ray enters them, checked again when popped as tMax may have shrunk
+        uint32_t stack[BVH_MAX_DEPTH + 4];
+        float entry[BVH_MAX_DEPTH + 4];
+        int top = 0;
+        stack[top] = 0;
+        entry[top++] = slab(nodes[0], origin, inv, tMax);
+        while (top > 0)
+        {
+            top--;
+            if (entry[top] >= tMax)
+                continue;
+            const BvhNode &node = nodes[stack[top]];
+            if (node.count)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (slab(boxes[order[i]], origin, inv, tMax) < tMax)
+                        visit((size_t)order[i], tMax);
+                continue;
+            }
+            float near0 = slab(nodes[node.first], origin, inv, tMax);
+            float near1 = slab(nodes[node.first + 1], origin, inv, tMax);
+            uint32_t a = node.first, b = node.first + 1;
+            if (near1 < near0)
+                std::swap(a, b), std::swap(near0, near1);
+            // The nearer child on top
+            if (near1 < tMax)
+                stack[top] = b, entry[top++] = near1;
+            if (near0 < tMax)
+                stack[top] = a, entry[top++] = near0;
+        }
+    }
+
+    // Calls visit(i) for the prisms whose box isn't entirely outside the frustum of the view-projection matrix
+    template <class F>
+    void frustum(const glm::mat4 &viewProjection, F visit) const
+    {
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; i++)
+        {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[2 * i] = w + row;
+            planes[2 * i + 1] = w - row;
+        }
+        if (nodes.empty())
+            return;
+        uint32_t stack[BVH_MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            uint32_t index = stack[--top];
+            const BvhNode &node = nodes[index];
+            bool inside = true;
+            if (!classify(node.lo, node.hi, planes, inside))
+                continue;
+            if (inside)
+                visitAll(index, visit); // no plane cuts the node, everything below is in
+            else if (node.count)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (classify(boxes[order[i]].lo, boxes[order[i]].hi, planes, inside))
+                        visit((size_t)order[i]);
+            }
+            else
+            {
+                stack[top++] = node.first + 1;
+                stack[top++] = node.first;
+            }
+        }
+    }
+
+    // Calls visit(i) for the prisms whose box overlaps box
+    template <class F>
+    void overlap(const Aabb &box, F visit) const
+    {
+        if (nodes.empty())
+            return;
+        uint32_t stack[BVH_MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const BvhNode &node = nodes[stack[--top]];
+            if (!box.overlaps(Aabb(node.lo, node.hi)))
+                continue;
+            if (node.count)
+            {
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    if (box.overlaps(boxes[order[i]]))
+                        visit((size_t)order[i]);
+            }
+            else
+            {
+                stack[top++] = node.first + 1;
+                stack[top++] = node.first;
+            }
+        }
+    }
+
+private:
+    // A node and the range of order below it, with its boxes when the parent's split already knows them. For subtrees,
+    // also the nodes they were appended as.
+    struct Range
+    {
+        uint32_t node, begin, end, depth;
+        bool bounded;
+        Aabb box, centroidBox;
+        uint32_t firstNode, lastNode;
+        Range(uint32_t node, uint32_t begin, uint32_t end, uint32_t depth)
+            : node(node), begin(begin), end(end), depth(depth), bounded(false), firstNode(0), lastNode(0) {}
+    };
+
+    struct Bins
+    {
+        Aabb box[BVH_BINS];
+        Aabb centroidBox[BVH_BINS];
+        uint32_t count[BVH_BINS];
+    };
+
+    // Sets node's box over the range and picks the binned SAH split, partitioning the range into the two children. Returns
+    // false, leaving node a leaf of the range, when splitting doesn't pay. Bins in parallel over pool when given.
+    bool split(ThreadPool *pool, const Range &r, BvhNode &node, Range &left, Range &right)
+    {
+        Aabb box = r.box, centroidBox = r.centroidBox;
+        if (!r.bounded)
+            boundRange(pool, r.begin, r.end, box, centroidBox);
+        left = Range(0, r.begin, r.end, r.depth + 1);
+        right = Range(0, r.begin, r.end, r.depth + 1);
+        node.lo = box.lo;
+        node.hi = box.hi;
+        node.first = r.begin;
+        node.count = r.end - r.begin;
+        if (node.count <= 2 || r.depth >= BVH_MAX_DEPTH)
+            return false;
+
+        glm::vec3 extent = centroidBox.hi - centroidBox.lo;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+        if (!(extent[axis] > 0))
+        {
+            // Every centroid in one point, halve the range if it's too big for a leaf
+            if (node.count <= BVH_MAX_LEAF)
+                return false;
+            left.end = right.begin = r.begin + node.count / 2;
+            return true;
+        }
+        float lo = centroidBox.lo[axis], scale = BVH_BINS / extent[axis] * 0.99999f;
+        Bins bins;
+        binRange(pool, r.begin, r.end, axis, lo, scale, bins);
+
+        // Sweep from the right for the right hand areas, then from the left evaluating every split
+        float rightArea[BVH_BINS];
+        uint32_t rightCount[BVH_BINS];
+        Aabb grown;
+        uint32_t n = 0;
+        for (int i = BVH_BINS - 1; i > 0; i--)
+        {
+            grown.grow(bins.box[i]);
+            n += bins.count[i];
+            rightArea[i] = grown.area();
+            rightCount[i] = n;
+        }
+        grown = Aabb();
+        n = 0;
+        float best = 1e30f;
+        int bestBin = 0;
+        for (int i = 1; i < BVH_BINS; i++)
+        {
+            grown.grow(bins.box[i - 1]);
+            n += bins.count[i - 1];
+            if (n == 0 || rightCount[i] == 0)
+                continue;
+            float c = grown.area() * n + rightArea[i] * rightCount[i];
+            if (c < best)
+            {
+                best = c;
+                bestBin = i;
+            }
+        }
+        // A traversal step costs about one box test
+        float leafCost = box.area() * node.count;
+        if (bestBin == 0 || (best + box.area() >= leafCost && node.count <= BVH_MAX_LEAF))
+            return false;
+        std::vector<uint32_t>::iterator middle = std::partition(order.begin() + r.begin, order.begin() + r.end,
+            [&](uint32_t i) { return (int)((centroids[i][axis] - lo) * scale) < bestBin; });
+        left.end = right.begin = (uint32_t)(middle - order.begin());
+        // The bins hold the children's boxes, no need to go over their ranges again
+        left.bounded = right.bounded = true;
+        for (int i = 0; i < BVH_BINS; i++)
+        {
+            Range &child = i < bestBin ? left : right;
+            child.box.grow(bins.box[i]);
+            child.centroidBox.grow(bins.centroidBox[i]);
+        }
+        return true;
+    }
+
+    void boundRange(ThreadPool *pool, uint32_t begin, uint32_t end, Aabb &box, Aabb &centroidBox)
+    {
+        if (!pool || end - begin <= BVH_GRAIN)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                box.grow(boxes[order[i]]);
+                centroidBox.grow(centroids[order[i]]);
+            }
+            return;
+        }
+        // One partial result per chunk, chunks start at multiples of the grain
+        chunkBins.resize((end - begin + BVH_GRAIN - 1) / BVH_GRAIN);
+        pool->parallelFor(end - begin, BVH_GRAIN, [&](size_t b, size_t e) {
+            Bins &partial = chunkBins[b / BVH_GRAIN];
+            partial.box[0] = partial.centroidBox[0] = Aabb();
+            boundRange(NULL, begin + (uint32_t)b, begin + (uint32_t)e, partial.box[0], partial.centroidBox[0]);
+        });
+        for (size_t i = 0; i < chunkBins.size(); i++)
+        {
+            box.grow(chunkBins[i].box[0]);
+            centroidBox.grow(chunkBins[i].centroidBox[0]);
+        }
+    }
+
+    void binRange(ThreadPool *pool, uint32_t begin, uint32_t end, int axis, float lo, float scale, Bins &bins)
+    {
+        for (int i = 0; i < BVH_BINS; i++)
+        {
+            bins.box[i] = bins.centroidBox[i] = Aabb();
+            bins.count[i] = 0;
+        }
+        if (!pool || end - begin <= BVH_GRAIN)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                uint32_t prism = order[i];
+                int bin = (int)((centroids[prism][axis] - lo) * scale);
+                bins.box[bin].grow(boxes[prism]);
+                bins.centroidBox[bin].grow(centroids[prism]);
+                bins.count[bin]++;
+            }
+            return;
+        }
+        chunkBins.resize((end - begin + BVH_GRAIN - 1) / BVH_GRAIN);
+        pool->parallelFor(end - begin, BVH_GRAIN, [&](size_t b, size_t e) {
+            binRange(NULL, begin + (uint32_t)b, begin + (uint32_t)e, axis, lo, scale, chunkBins[b / BVH_GRAIN]);
+        });
+        for (size_t c = 0; c < chunkBins.size(); c++)
+            for (int i = 0; i < BVH_BINS; i++)
+            {
+                bins.box[i].grow(chunkBins[c].box[i]);
+                bins.centroidBox[i].grow(chunkBins[c].centroidBox[i]);
+                bins.count[i] += chunkBins[c].count[i];
+            }
+    }
+
+    // Builds below r into out, out[0] being r's node and every index local to out
+    void buildSubtree(const Range &r, std::vector<BvhNode> &out)
+    {
+        out.assign(1, BvhNode());
+        Range root = r;
+        root.node = 0;
+        std::vector<Range> stack(1, root);
+        while (!stack.empty())
+        {
+            Range s = stack.back();
+            stack.pop_back();
+            Range left(0, 0, 0, 0), right(0, 0, 0, 0);
+            if (!split(NULL, s, out[s.node], left, right))
+                continue;
+            left.node = (uint32_t)out.size();
+            right.node = left.node + 1;
+            out[s.node].first = left.node;
+            out[s.node].count = 0;
+            out.push_back(BvhNode());
+            out.push_back(BvhNode());
+            stack.push_back(right);
+            stack.push_back(left);
+        }
+    }
+
+    void refitNode(uint32_t index)
+    {
+        BvhNode &node = nodes[index];
+        Aabb box;
+        if (node.count)
+            for (uint32_t i = node.first; i < node.first + node.count; i++)
+                box.grow(boxes[order[i]]);
+        else
+        {
+            box = Aabb(nodes[node.first].lo, nodes[node.first].hi);
+            box.grow(Aabb(nodes[node.first + 1].lo, nodes[node.first + 1].hi));
+        }
+        node.lo = box.lo;
+        node.hi = box.hi;
+    }
+
+    // SAH cost of the tree relative to the root's area: one per traversal step plus one per prism box tested
+    float cost() const
+    {
+        float rootArea = std::max(Aabb(nodes[0].lo, nodes[0].hi).area(), 1e-30f);
+        double sum = 0;
+        for (size_t i = 0; i < nodes.size(); i++)
+            sum += (double)Aabb(nodes[i].lo, nodes[i].hi).area() * (nodes[i].count ? nodes[i].count : 1);
+        return (float)(sum / rootArea);
+    }
+
+    template <class F>
+    void visitAll(uint32_t index, F &visit) const
+    {
+        uint32_t stack[BVH_MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = index;
+        while (top > 0)
+        {
+            const BvhNode &node = nodes[stack[--top]];
+            if (node.count)
+                for (uint32_t i = node.first; i < node.first + node.count; i++)
+                    visit((size_t)order[i]);
+            else
+            {
+                stack[top++] = node.first + 1;
+                stack[top++] = node.first;
+            }
+        }
+    }
+
+    // Entry distance of the ray into the box, infinite when it misses so that an unbounded ray skips it too
+    static float slab(const BvhNode &node, const glm::vec3 &origin, const glm::vec3 &inv, float tMax)
+    {
+        return slab(Aabb(node.lo, node.hi), origin, inv, tMax);
+    }
+    static float slab(const Aabb &box, const glm::vec3 &origin, const glm::vec3 &inv, float tMax)
+    {
+        glm::vec3 t0 = (box.lo - origin) * inv, t1 = (box.hi - origin) * inv;
+        glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+        float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+        float exit = std::min(std::min(far.x, far.y), std::min(far.z, tMax));
+        return enter <= exit ? enter : INFINITY;
+    }
+
+    // false when the box is outside a plane, inside stays true only when it is inside all of them
+    static bool classify(const glm::vec3 &lo, const glm::vec3 &hi, const glm::vec4 *planes, bool &inside)
+    {
+        inside = true;
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 n(planes[i]);
+            glm::vec3 far(n.x > 0 ? hi.x : lo.x, n.y > 0 ? hi.y : lo.y, n.z > 0 ? hi.z : lo.z);
+            glm::vec3 near(n.x > 0 ? lo.x : hi.x, n.y > 0 ? lo.y : hi.y, n.z > 0 ? lo.z : hi.z);
+            if (glm::dot(n, far) + planes[i].w < 0)
+                return false;
+            if (glm::dot(n, near) + planes[i].w < 0)
+                inside = false;
+        }
+        return true;
+    }
+
+    std::vector<BvhNode> nodes; // the root first, then the top levels, then every subtree
+    std::vector<uint32_t> order; // prism indices, grouped by leaf
+    std::vector<Aabb> boxes;     // per prism
+    std::vector<glm::vec3> centroids;
+    std::vector<Range> subtrees; // built and refitted in parallel
+    std::vector<Bins> chunkBins; // partial results of the parallel binning
+    float builtCost;
+    float currentCost;
+    size_t topNodes; // nodes[0, topNodes) are refitted after the subtrees
+};
+#endif
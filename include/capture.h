@@ -0,0 +1,391 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define CAPTURE_SSE2 1
+#endif
+
+#include "trace.h"
+
+// Pixel buffers a capture cycles through. A frame holds one from its readback until the writer is done with it, so
+// this covers the GPU running a couple of frames behind plus the writer's queue.
+const int CAPTURE_SLOTS = 6;
+
+// One pair of RGBA rows to 4:2:0 YUV with BT.601 limited range coefficients, what Y4M players assume: a row of Y for
+// each and one row of U and V from the 2x2 averages. row1 may be row0 for the last row of an odd height, and an odd
+// width repeats its last column. With SSE2 and simd set, 8 pixels at a time go through 16 bit multiply-adds in the same
+// integer arithmetic as the scalar path, so both give the same bytes.
+inline void rgbaRowsToI420(const unsigned char *row0, const unsigned char *row1, int width, unsigned char *y0,
+                           unsigned char *y1, unsigned char *u, unsigned char *v, bool simd = true)
+{
+    int x = 0;
+#ifdef CAPTURE_SSE2
+    if (simd)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i lumaCoeffs = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+        const __m128i uCoeffs = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+        const __m128i vCoeffs = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+        const __m128i lumaBias = _mm_set1_epi32(128), chromaBias = _mm_set1_epi32(512 + (128 << 10));
+        // Sums the two halves of each pixel's or block's multiply-add: lanes (x0, y0, x1, y1) of a and b to four sums
+        auto pairs = [](__m128i a, __m128i b) {
+            __m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+            return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0))),
+                                 _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1))));
+        };
+        auto luma = [&](__m128i p) {
+            __m128i sum = pairs(_mm_madd_epi16(_mm_unpacklo_epi8(p, zero), lumaCoeffs),
+                                _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), lumaCoeffs));
+            return _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(sum, lumaBias), 8), _mm_set1_epi32(16));
+        };
+        // The RGBA sums of the two 2x2 blocks under 4 pixels of both rows, as 16 bit lanes
+        auto blocks = [&](__m128i p, __m128i q) {
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(q, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(q, zero));
+            return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+        };
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i p0 = _mm_loadu_si128((const __m128i *)(row0 + 4 * x));
+            __m128i p1 = _mm_loadu_si128((const __m128i *)(row0 + 4 * x + 16));
+            __m128i q0 = _mm_loadu_si128((const __m128i *)(row1 + 4 * x));
+            __m128i q1 = _mm_loadu_si128((const __m128i *)(row1 + 4 * x + 16));
+            __m128i lumaP = _mm_packs_epi32(luma(p0), luma(p1)), lumaQ = _mm_packs_epi32(luma(q0), luma(q1));
+            _mm_storel_epi64((__m128i *)(y0 + x), _mm_packus_epi16(lumaP, lumaP));
+            _mm_storel_epi64((__m128i *)(y1 + x), _mm_packus_epi16(lumaQ, lumaQ));
+
+            __m128i b0 = blocks(p0, q0), b1 = blocks(p1, q1);
+            __m128i us = pairs(_mm_madd_epi16(b0, uCoeffs), _mm_madd_epi16(b1, uCoeffs));
+            __m128i vs = pairs(_mm_madd_epi16(b0, vCoeffs), _mm_madd_epi16(b1, vCoeffs));
+            us = _mm_srai_epi32(_mm_add_epi32(us, chromaBias), 10);
+            vs = _mm_srai_epi32(_mm_add_epi32(vs, chromaBias), 10);
+            __m128i chroma = _mm_packs_epi32(us, vs);
+            chroma = _mm_packus_epi16(chroma, chroma);
+            int32_t uv[2] = {_mm_cvtsi128_si32(chroma), _mm_cvtsi128_si32(_mm_srli_si128(chroma, 4))};
+            memcpy(u + x / 2, &uv[0], 4);
+            memcpy(v + x / 2, &uv[1], 4);
+        }
+    }
+#else
+    (void)simd;
+#endif
+    for (; x < width; x += 2)
+    {
+        const unsigned char *p[4] = {row0 + 4 * x, row0 + 4 * std::min(x + 1, width - 1), row1 + 4 * x,
+                                     row1 + 4 * std::min(x + 1, width - 1)};
+        for (int i = 0; i < 4; i++)
+        {
+            unsigned char luma = (unsigned char)(((66 * p[i][0] + 129 * p[i][1] + 25 * p[i][2] + 128) >> 8) + 16);
+            if (i % 2 == 0 || x + 1 < width)
+                (i < 2 ? y0 : y1)[x + i % 2] = luma;
+        }
+        int r = p[0][0] + p[1][0] + p[2][0] + p[3][0];
+        int g = p[0][1] + p[1][1] + p[2][1] + p[3][1];
+        int b = p[0][2] + p[1][2] + p[2][2] + p[3][2];
+        u[x / 2] = (unsigned char)((-38 * r - 74 * g + 112 * b + 512 + (128 << 10)) >> 10);
+        v[x / 2] = (unsigned char)((112 * r - 94 * g - 18 * b + 512 + (128 << 10)) >> 10);
+    }
+}
+
+// Writes every frame the gl backend renders to a video without stalling the render thread.
+//
+// capture() only queues a glReadPixels into the next pixel buffer object of a ring, which the GPU fills when it gets
+// there, and a fence behind it. Later calls poll the fences without waiting and map the buffers whose readback is
+// done, in frame order, and a writer thread converts and writes the mapped pixels straight from the mapping. The render
+// thread unmaps a buffer once the writer is done with it. Only when every buffer is still busy, because the writer or
+// the disk can't keep up, does capture() wait, so no frame is lost.
+//
+// The output is Y4M, 4:2:0 from rgbaRowsToI420(), or raw RGBA frames with the top row first for names ending in .rgba
+// or .raw. A target starting with | is a command the Y4M is piped into instead of a file, for example
+// "|ffmpeg -i - out.mp4". Frames keep the size of the first one.
+class FrameCapture
+{
+public:
+    FrameCapture() : width(0), height(0), y4m(false), pipe(false), out(NULL), frames(0), stopping(false), failed(false),
+                     writerMs(0), waitMs(0) {}
+    ~FrameCapture()
+    {
+        close();
+    }
+
+    bool open(const std::string &target, int frameWidth, int frameHeight, int fps)
+    {
+        name = target;
+        width = frameWidth;
+        height = frameHeight;
+        pipe = !target.empty() && target[0] == '|';
+        size_t dot = target.rfind('.');
+        std::string extension = pipe || dot == std::string::npos ? "" : target.substr(dot);
+        y4m = extension != ".rgba" && extension != ".raw";
+        if (pipe)
+        {
+#ifdef _WIN32
+            out = _popen(target.c_str() + 1, "wb");
+#else
+            // A command that exits early should fail the writes, not kill the app
+            signal(SIGPIPE, SIG_IGN);
+            out = popen(target.c_str() + 1, "w");
+#endif
+        }
+        else
+            out = fopen(target.c_str(), "wb");
+        if (!out)
+            return false;
+        if (y4m)
+        {
+            fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps);
+            planes.resize((size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2));
+        }
+
+        size_t bytes = (size_t)width * height * 4;
+        for (int i = 0; i < CAPTURE_SLOTS; i++)
+        {
+            Slot &s = slots[i];
+            glGenBuffers(1, &s.pbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+            s.fence = 0;
+            s.pixels = NULL;
+            s.state = FREE;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        writer = std::thread(&FrameCapture::write, this);
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return out != NULL;
+    }
+
+    // Queues the readback of the default framebuffer's back buffer. Call after drawing, before swapping buffers.
+    void capture()
+    {
+        if (!out)
+            return;
+        TRACE_SCOPE("capture");
+        collect(false);
+        int slot = freeSlot();
+        if (slot < 0)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            while ((slot = freeSlot()) < 0)
+                collect(true);
+            waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        Slot &s = slots[slot];
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glReadBuffer(GL_BACK);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        s.state = READING;
+        reading.push_back(slot);
+        frames++;
+    }
+
+    // Writes out every frame captured so far, then closes the output. Needs the GL context still current.
+    void close()
+    {
+        if (!out)
+            return;
+        while (!reading.empty() || busy())
+            collect(true);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+#ifdef _WIN32
+        bool ok = (pipe ? _pclose(out) : fclose(out)) == 0 && !failed;
+#else
+        bool ok = (pipe ? pclose(out) : fclose(out)) == 0 && !failed;
+#endif
+        out = NULL;
+        if (ok)
+            printf("Captured %ld frames of %dx%d to %s, the writer took %.2f ms a frame and drawing waited %.1f ms for it\n",
+                   frames, width, height, name.c_str(), frames ? writerMs / frames : 0.0, waitMs);
+        else
+            printf("Failed to write the capture to %s\n", name.c_str());
+    }
+
+private:
+    enum SlotState {
+        FREE,
+        READING, // readback queued, fence pending
+        WRITING, // mapped, with the writer
+        WRITTEN  // still mapped, the writer is done with it
+    };
+    struct Slot
+    {
+        GLuint pbo;
+        GLsync fence;
+        const unsigned char *pixels;
+        SlotState state;
+    };
+
+    int freeSlot()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < CAPTURE_SLOTS; i++)
+            if (slots[i].state == FREE)
+                return i;
+        return -1;
+    }
+
+    bool busy()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i = 0; i < CAPTURE_SLOTS; i++)
+            if (slots[i].state == WRITING || slots[i].state == WRITTEN)
+                return true;
+        return false;
+    }
+
+    // Unmaps the buffers the writer is done with and hands over the oldest readbacks that completed, in order. With
+    // wait set it blocks until at least one of those happens.
+    void collect(bool wait)
+    {
+        std::vector<int> done;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Only waits on the writer when the GPU has nothing left for us
+            if (wait && reading.empty())
+                wake.wait(lock, [&]() { return writtenCount() > 0; });
+            for (int i = 0; i < CAPTURE_SLOTS; i++)
+                if (slots[i].state == WRITTEN)
+                    done.push_back(i);
+        }
+        for (size_t i = 0; i < done.size(); i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slots[done[i]].pbo);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            std::lock_guard<std::mutex> lock(mutex);
+            slots[done[i]].state = FREE;
+        }
+        wait = wait && done.empty();
+
+        while (!reading.empty())
+        {
+            Slot &s = slots[reading.front()];
+            GLenum status = glClientWaitSync(s.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? 1000000000ull : 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            wait = false;
+            glDeleteSync(s.fence);
+            s.fence = 0;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo);
+            s.pixels = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (size_t)width * height * 4, GL_MAP_READ_BIT);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                s.state = WRITING;
+                queue.push_back(reading.front());
+            }
+            wake.notify_all();
+            reading.pop_front();
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    int writtenCount() const
+    {
+        int count = 0;
+        for (int i = 0; i < CAPTURE_SLOTS; i++)
+            count += slots[i].state == WRITTEN;
+        return count;
+    }
+
+    // The writer thread: converts and writes the frames in the order they were handed over
+    void write()
+    {
+        Tracer::get().nameThread("capture");
+        size_t rowBytes = (size_t)width * 4;
+        for (;;)
+        {
+            int slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                slot = queue.front();
+                queue.pop_front();
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            {
+                TRACE_SCOPE("write frame");
+                // GL's rows go bottom up, the video's top down
+                const unsigned char *pixels = slots[slot].pixels;
+                const unsigned char *top = pixels + (height - 1) * rowBytes;
+                if (failed || !pixels)
+                    failed = true;
+                else if (y4m)
+                {
+                    int chromaWidth = (width + 1) / 2;
+                    unsigned char *yPlane = planes.data(), *uPlane = yPlane + (size_t)width * height;
+                    unsigned char *vPlane = uPlane + (size_t)chromaWidth * ((height + 1) / 2);
+                    for (int y = 0; y < height; y += 2)
+                    {
+                        const unsigned char *row0 = top - y * rowBytes;
+                        const unsigned char *row1 = y + 1 < height ? row0 - rowBytes : row0;
+                        unsigned char *y1 = y + 1 < height ? yPlane + (size_t)(y + 1) * width : yPlane + (size_t)y * width;
+                        rgbaRowsToI420(row0, row1, width, yPlane + (size_t)y * width, y1,
+                                       uPlane + (size_t)(y / 2) * chromaWidth, vPlane + (size_t)(y / 2) * chromaWidth);
+                    }
+                    failed = fwrite("FRAME\n", 1, 6, out) != 6 || fwrite(planes.data(), 1, planes.size(), out) != planes.size();
+                }
+                else
+                    for (int y = 0; y < height && !failed; y++)
+                        failed = fwrite(top - y * rowBytes, 1, rowBytes, out) != rowBytes;
+            }
+            writerMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slots[slot].state = WRITTEN;
+            }
+            wake.notify_all();
+        }
+    }
+
+    std::string name;
+    int width, height;
+    bool y4m, pipe;
+    FILE *out;
+    Slot slots[CAPTURE_SLOTS];
+    std::deque<int> reading; // slots waiting for their fence, oldest first, only touched by the render thread
+    std::vector<unsigned char> planes; // the writer's Y, U and V of a frame
+    long frames;
+
+    // Shared with the writer
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<int> queue; // mapped slots waiting for the writer, oldest first
+    bool stopping;
+    std::atomic<bool> failed;
+    double writerMs; // written by the writer, read after it joined
+    double waitMs;
+};
+#endif
@@ -0,0 +1,392 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "bvh.h"
+#include "prism.h"
+#include "scene.h"
+#include "simd8.h"
+#include "threadpool.h"
+
+// Prisms per chunk of the broadphase loops and candidate pairs per chunk of the narrowphase
+const size_t COLLISION_GRAIN = 4096;
+const size_t COLLISION_PAIR_GRAIN = 1024;
+
+// Where a prism is for the narrowphase: its center and its object axes in world space, z along the prism
+struct PrismPose
+{
+    glm::vec3 center;
+    glm::vec3 axis[3];
+    int sides;
+};
+
+inline PrismPose prismPose(const Scene &scene, size_t i)
+{
+    PrismPose p;
+    glm::mat3 rotation(glm::rotate(glm::mat4(1.0f), scene.angle[i], glm::vec3(scene.axisX[i], scene.axisY[i], scene.axisZ[i])));
+    p.center = glm::vec3(scene.x[i], scene.y[i], scene.z[i]);
+    p.axis[0] = rotation[0], p.axis[1] = rotation[1], p.axis[2] = rotation[2];
+    p.sides = scene.sides[i];
+    return p;
+}
+
+// How far the prism reaches from its center along eight axes u at once, scaled by |u|. The caps add prismLen |u.z|
+// and the n-gon the vertex nearest u's angle in the cap plane, so it costs the same for any n instead of a pass over
+// the vertices. The approximate atan2 only picks the vertex, which is then projected exactly.
+inline float8 prismSupport(const PrismPose &p, float8 ux, float8 uy, float8 uz)
+{
+    const float pi = 3.14159265359f;
+    const glm::vec3 *a = p.axis;
+    float8 ox = ux * float8(a[0].x) + uy * float8(a[0].y) + uz * float8(a[0].z);
+    float8 oy = ux * float8(a[1].x) + uy * float8(a[1].y) + uz * float8(a[1].z);
+    float8 oz = ux * float8(a[2].x) + uy * float8(a[2].y) + uz * float8(a[2].z);
+    float step = 2 * pi / p.sides;
+    float8 vertex = floor(atan2(oy, ox) * float8(1.0f / step) + float8(0.5f)) * float8(step);
+    vertex = select(vertex > float8(pi), vertex - float8(2 * pi), vertex);
+    float8 s, c;
+    sincos(vertex, s, c);
+    return float8(prismLen) * abs(oz) + float8(prismRadius) * (ox * c + oy * s);
+}
+
+// Radius of the ball inside an n sided prism and of the one around any of them, both about its center
+inline float prismInnerRadius(int sides)
+{
+    return std::min(prismLen, prismRadius * std::cos(3.14159265f / sides));
+}
+const float prismOuterRadius = std::sqrt(prismLen * prismLen + prismRadius * prismRadius);
+
+// Calls f(normal, edge) for the sides first to last of the prism, wrapping around, with the side's outward normal
+// and the direction of its cap edges. Stops and returns true as soon as f does. The normal is turned a side at a time
+// and recomputed every 16 sides so long runs don't drift.
+template <class F>
+bool forSides(const PrismPose &p, long first, long last, F f)
+{
+    float step = 6.2831853f / p.sides, turnC = std::cos(step), turnS = std::sin(step);
+    float c = 0, s = 0;
+    for (long k = first; k <= last; k++)
+    {
+        if ((k - first) % 16 == 0)
+            c = std::cos((k + 0.5f) * step), s = std::sin((k + 0.5f) * step);
+        if (f(c * p.axis[0] + s * p.axis[1], c * p.axis[1] - s * p.axis[0]))
+            return true;
+        float turned = c * turnC - s * turnS;
+        s = s * turnC + c * turnS;
+        c = turned;
+    }
+    return false;
+}
+
+// Separating axis test of two prisms, true when they overlap or touch.
+//
+// The candidate axes of two convex polyhedra are the face normals of both and the cross products of their edge
+// directions, 2 + n + m normals and about (n + 1)(m + 1) crossings. Because every side of a regular prism is as far
+// from its center, an axis can only separate when the other prism's center is far enough along it, which leaves a
+// window of sides around the direction to the other prism. Only those side normals are tested, and only the edges of
+// the sides that pass the same kind of bound for their edge's normal cone are crossed. Pruning only drops axes that
+// can't separate, so the result is exact. Axes are tested eight at a time, the line between the centers first as any
+// axis that separates will do.
+inline bool prismsOverlap(const PrismPose &a, const PrismPose &b)
+{
+    glm::vec3 d = b.center - a.center;
+    float distance2 = glm::dot(d, d);
+    float innerA = prismInnerRadius(a.sides), innerB = prismInnerRadius(b.sides);
+    if (distance2 > 4.0f * prismOuterRadius * prismOuterRadius)
+        return false;
+    if (distance2 < (innerA + innerB) * (innerA + innerB))
+        return true;
+
+    // Axes waiting to be tested. flush() is true when one of them separates: the centers are further apart along it
+    // than the prisms reach towards each other, which odd n-gons do further one way than the other.
+    float batch[3][8];
+    int batched = 0;
+    auto flush = [&]() {
+        if (!batched)
+            return false;
+        for (int i = batched; i < 8; i++)
+            batch[0][i] = batch[0][0], batch[1][i] = batch[1][0], batch[2][i] = batch[2][0];
+        batched = 0;
+        float8 ux = float8::load(batch[0]), uy = float8::load(batch[1]), uz = float8::load(batch[2]);
+        float8 along = ux * float8(d.x) + uy * float8(d.y) + uz * float8(d.z);
+        float8 toward = select(along < float8(0.0f), float8(-1.0f), float8(1.0f));
+        float8 reach = prismSupport(a, ux * toward, uy * toward, uz * toward) +
+                       prismSupport(b, -ux * toward, -uy * toward, -uz * toward);
+        return any(abs(along) > reach);
+    };
+    auto test = [&](const glm::vec3 &u) {
+        batch[0][batched] = u.x, batch[1][batched] = u.y, batch[2][batched] = u.z;
+        return ++batched == 8 && flush();
+    };
+    if (test(d) || test(a.axis[2]) || test(b.axis[2]) || test(glm::cross(a.axis[2], b.axis[2])) || flush())
+        return false;
+
+    // Sides and cap edges of p worth testing against the prism at offset from it. Side k's normal separates only if
+    // offset . n_k exceeds p's apothem plus the other prism's inner radius. An edge between side k and a cap only if,
+    // along some direction of its normal cone, between n_k and the cap normal, the offset exceeds p's reach there plus
+    // that radius. Both leave a window of consecutive sides centered on offset's angle in p's cap plane.
+    struct Window
+    {
+        long first, last;         // side normals, last < first for none
+        long edgeFirst, edgeLast; // cap edges
+        bool lateral;             // edges along the prism, all parallel to its axis
+        float exit;               // where the line to the other center leaves p, as a fraction of the offset
+    };
+    auto window = [](const PrismPose &p, const glm::vec3 &offset, float otherInner) {
+        Window w;
+        float step = 6.2831853f / p.sides;
+        float apothem = prismRadius * std::cos(0.5f * step);
+        float ox = glm::dot(offset, p.axis[0]), oy = glm::dot(offset, p.axis[1]), oz = glm::dot(offset, p.axis[2]);
+        float radial = std::sqrt(ox * ox + oy * oy), angle = std::atan2(oy, ox);
+        float nearest = (std::floor(angle / step) + 0.5f) * step;
+        w.exit = std::min(prismLen / std::abs(oz), apothem / (radial * std::cos(angle - nearest)));
+        // Sides whose normal angle (k + 1/2) step is within acos(reach / radial) of the offset's angle
+        auto sides = [&](float reach, long &first, long &last) {
+            if (radial <= reach)
+            {
+                first = 0, last = -1;
+                return;
+            }
+            float spread = std::acos(reach / radial);
+            first = (long)std::ceil((angle - spread) / step - 0.5f);
+            last = (long)std::floor((angle + spread) / step - 0.5f);
+        };
+        sides(apothem + otherInner, w.first, w.last);
+        // The lateral edge at vertex k is reached between n_(k-1) and n_k, every direction of the cap plane is in one
+        w.lateral = radial > apothem + otherInner;
+        float above = std::max(std::abs(oz) - prismLen, 0.0f);
+        if (above >= otherInner)
+            w.edgeFirst = 0, w.edgeLast = p.sides - 1;
+        else
+            sides(apothem + std::sqrt(otherInner * otherInner - above * above), w.edgeFirst, w.edgeLast);
+        return w;
+    };
+    Window wa = window(a, d, innerB), wb = window(b, -d, innerA);
+    // The line between the centers is inside both all the way
+    if (wa.exit + wb.exit >= 1.0f)
+        return true;
+
+    auto normal = [&](const glm::vec3 &n, const glm::vec3 &) { return test(n); };
+    if (forSides(a, wa.first, wa.last, normal) || forSides(b, wb.first, wb.last, normal) || flush())
+        return false;
+
+    // Edge crossings: the lateral edges of each prism with the cap edges of the other, then the cap edges of both
+    auto lateralB = [&](const glm::vec3 &, const glm::vec3 &edge) { return test(glm::cross(edge, b.axis[2])); };
+    auto lateralA = [&](const glm::vec3 &, const glm::vec3 &edge) { return test(glm::cross(a.axis[2], edge)); };
+    if ((wb.lateral && forSides(a, wa.edgeFirst, wa.edgeLast, lateralB)) ||
+        (wa.lateral && forSides(b, wb.edgeFirst, wb.edgeLast, lateralA)))
+        return false;
+    auto caps = [&](const glm::vec3 &, const glm::vec3 &edgeA) {
+        return forSides(b, wb.edgeFirst, wb.edgeLast, [&](const glm::vec3 &, const glm::vec3 &edgeB) {
+            return test(glm::cross(edgeA, edgeB));
+        });
+    };
+    return !forSides(a, wa.edgeFirst, wa.edgeLast, caps) && !flush();
+}
+
+// Pair of prism indices, a < b
+struct CollisionPair
+{
+    uint32_t a, b;
+};
+
+// Finds the overlapping prisms of a scene, from scratch every update.
+//
+// The broadphase puts every prism in a uniform grid cell by its center. Every prism fits in a ball of
+// prismOuterRadius, so with cells twice that size two boxes can only overlap if their cells are neighbors, and each
+// prism looks through its own cell and the 13 neighbors ahead of it for boxes that overlap its box. The cells are
+// hashed into a table with a counting sort, entries of a cell stored together with their boxes. When the occupied
+// cells span at most a few per prism they are numbered row by row instead, so neighbors sit close together. The
+// candidate pairs are then split over the pool for the narrowphase, prismsOverlap(). Buffers are kept between
+// updates, so a scene of steady size doesn't allocate.
+class CollisionDetector
+{
+public:
+    CollisionDetector() : rowMajor(false), width(0), height(0), mask(0) {}
+
+    void update(ThreadPool &pool, const Scene &scene)
+    {
+        size_t count = scene.size();
+        size_t chunks = (count + COLLISION_GRAIN - 1) / COLLISION_GRAIN;
+        poses.resize(count);
+        unsorted.resize(count);
+        bucketOf.resize(count);
+        chunkCells.resize(chunks);
+        if (chunkPairs.size() < chunks)
+            chunkPairs.resize(chunks);
+
+        // Poses, boxes and cells, and the range of cells each chunk covers
+        const float cellSize = 2.0f * prismOuterRadius;
+        pool.parallelFor(count, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+            CellRange &range = chunkCells[begin / COLLISION_GRAIN];
+            for (size_t i = begin; i < end; i++)
+            {
+                const PrismPose &p = poses[i] = prismPose(scene, i);
+                Entry &e = unsorted[i];
+                // The box of the cylinder around the prism
+                glm::vec3 z = glm::abs(p.axis[2]);
+                glm::vec3 reach = prismLen * z + prismRadius * glm::sqrt(glm::max(glm::vec3(1.0f) - z * z, glm::vec3(0.0f)));
+                e.box = Aabb(p.center - reach, p.center + reach);
+                e.cell.x = (int32_t)std::floor(p.center.x / cellSize);
+                e.cell.y = (int32_t)std::floor(p.center.y / cellSize);
+                e.cell.z = (int32_t)std::floor(p.center.z / cellSize);
+                e.index = (uint32_t)i;
+                if (i == begin)
+                    range.lo = range.hi = e.cell;
+                range.grow(e.cell);
+            }
+        });
+        CellRange all = chunkCells.empty() ? CellRange() : chunkCells[0];
+        for (size_t i = 1; i < chunks; i++)
+            all.grow(chunkCells[i]);
+        range = all;
+        width = (int64_t)all.hi.x - all.lo.x + 1;
+        height = (int64_t)all.hi.y - all.lo.y + 1;
+        int64_t cells = width * height * ((int64_t)all.hi.z - all.lo.z + 1);
+        size_t buckets = 1;
+        while (buckets < 2 * count)
+            buckets *= 2;
+        rowMajor = cells <= 4 * (int64_t)count;
+        mask = (uint32_t)(buckets - 1);
+        if (rowMajor)
+            buckets = (size_t)cells;
+        pool.parallelFor(count, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                bucket(unsorted[i].cell, bucketOf[i]);
+        });
+
+        // Counting sort by bucket
+        bucketStart.assign(buckets + 1, 0);
+        for (size_t i = 0; i < count; i++)
+            bucketStart[bucketOf[i] + 1]++;
+        for (size_t i = 0; i < buckets; i++)
+            bucketStart[i + 1] += bucketStart[i];
+        entries.resize(count);
+        fill.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for (size_t i = 0; i < count; i++)
+            entries[fill[bucketOf[i]]++] = unsorted[i];
+
+        // Candidates, each chunk of entries into its own list
+        pool.parallelFor(count, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+            std::vector<CollisionPair> &out = chunkPairs[begin / COLLISION_GRAIN];
+            out.clear();
+            for (size_t i = begin; i < end; i++)
+            {
+                const Entry &self = entries[i];
+                // The own cell from the entries after this one on, then the cells ahead of it
+                for (int neighbor = 13; neighbor < 27; neighbor++)
+                {
+                    Cell c = {self.cell.x + neighbor % 3 - 1, self.cell.y + neighbor / 3 % 3 - 1, self.cell.z + neighbor / 9 - 1};
+                    uint32_t b;
+                    if (!bucket(c, b))
+                        continue;
+                    for (uint32_t j = neighbor == 13 ? (uint32_t)i + 1 : bucketStart[b]; j < bucketStart[b + 1]; j++)
+                    {
+                        // Buckets can hold several cells, only take the entries of this one
+                        const Entry &other = entries[j];
+                        if (other.cell.x == c.x && other.cell.y == c.y && other.cell.z == c.z && self.box.overlaps(other.box))
+                        {
+                            CollisionPair pair = {std::min(self.index, other.index), std::max(self.index, other.index)};
+                            out.push_back(pair);
+                        }
+                    }
+                }
+            }
+        });
+        candidatePairs.clear();
+        for (size_t i = 0; i < chunks; i++)
+            candidatePairs.insert(candidatePairs.end(), chunkPairs[i].begin(), chunkPairs[i].end());
+
+        // Narrowphase over the candidates, whatever prisms they came from
+        overlapping.resize(candidatePairs.size());
+        pool.parallelFor(candidatePairs.size(), COLLISION_PAIR_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                overlapping[i] = prismsOverlap(poses[candidatePairs[i].a], poses[candidatePairs[i].b]);
+        });
+        contacts.clear();
+        for (size_t i = 0; i < candidatePairs.size(); i++)
+            if (overlapping[i])
+                contacts.push_back(candidatePairs[i]);
+    }
+
+    // Overlapping prisms found by the last update
+    const std::vector<CollisionPair> &pairs() const
+    {
+        return contacts;
+    }
+
+    // Pairs whose boxes overlap, the ones the narrowphase tested
+    size_t candidates() const
+    {
+        return candidatePairs.size();
+    }
+
+private:
+    struct Cell
+    {
+        int32_t x, y, z;
+    };
+    struct CellRange
+    {
+        Cell lo, hi;
+
+        CellRange()
+        {
+            lo.x = lo.y = lo.z = hi.x = hi.y = hi.z = 0;
+        }
+        void grow(const Cell &c)
+        {
+            lo.x = std::min(lo.x, c.x), lo.y = std::min(lo.y, c.y), lo.z = std::min(lo.z, c.z);
+            hi.x = std::max(hi.x, c.x), hi.y = std::max(hi.y, c.y), hi.z = std::max(hi.z, c.z);
+        }
+        void grow(const CellRange &r)
+        {
+            grow(r.lo);
+            grow(r.hi);
+        }
+    };
+    struct Entry
+    {
+        Aabb box;
+        Cell cell;
+        uint32_t index;
+    };
+
+    // The cell's bucket, false when it is numbered row by row and lies outside the occupied range, so holds nothing
+    bool bucket(const Cell &c, uint32_t &b) const
+    {
+        if (rowMajor)
+        {
+            if (c.x < range.lo.x || c.x > range.hi.x || c.y < range.lo.y || c.y > range.hi.y || c.z < range.lo.z ||
+                c.z > range.hi.z)
+                return false;
+            b = (uint32_t)((c.x - range.lo.x) + width * ((c.y - range.lo.y) + height * (int64_t)(c.z - range.lo.z)));
+            return true;
+        }
+        b = ((uint32_t)c.x * 73856093u ^ (uint32_t)c.y * 19349663u ^ (uint32_t)c.z * 83492791u) & mask;
+        return true;
+    }
+
+    std::vector<PrismPose> poses;
+    std::vector<Entry> unsorted; // by prism
+    std::vector<uint32_t> bucketOf;
+    std::vector<CellRange> chunkCells;
+    std::vector<uint32_t> bucketStart; // entries of bucket b are [bucketStart[b], bucketStart[b + 1])
+    std::vector<uint32_t> fill;
+    std::vector<Entry> entries; // by bucket
+    std::vector<std::vector<CollisionPair> > chunkPairs;
+    std::vector<CollisionPair> candidatePairs;
+    std::vector<uint8_t> overlapping;
+    std::vector<CollisionPair> contacts;
+    // Cells numbered row by row over the occupied range when there are few enough of them, hashed otherwise
+    bool rowMajor;
+    CellRange range;
+    int64_t width, height;
+    uint32_t mask;
+};
+#endif
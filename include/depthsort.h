@@ -0,0 +1,102 @@
+#ifndef DEPTHSORT_H
+#define DEPTHSORT_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "radixsort.h"
+#include "threadpool.h"
+
+// Orders the triangles of an unindexed mesh back to front, for blending translucent faces exactly.
+//
+// Triangles are ordered by the view depth of their centroids, which composites them exactly wherever overlapping
+// triangles are separated in depth, as the faces of the prism are unless seen nearly edge on. Depths are recomputed
+// and sorted only when the model-view matrix changes.
+class DepthSorter
+{
+public:
+    explicit DepthSorter(ThreadPool &pool) : pool(pool), radix(pool), order(NULL), valid(false) {}
+
+    // Takes the centroids of the mesh's triangles. vertices holds vertexCount vertices of vertexSize bytes, each
+    // starting with its float position.
+    void setMesh(const void *vertices, size_t vertexSize, size_t vertexCount)
+    {
+        size_t count = vertexCount / 3;
+        for (int i = 0; i < 3; i++)
+            centroid[i].resize(count);
+        depth.resize(count);
+        const unsigned char *base = (const unsigned char *)vertices;
+        pool.parallelFor(count, RADIX_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++)
+            {
+                float sum[3] = {0, 0, 0};
+                for (int v = 0; v < 3; v++)
+                {
+                    float p[3];
+                    memcpy(p, base + (3 * t + v) * vertexSize, sizeof(p));
+                    for (int i = 0; i < 3; i++)
+                        sum[i] += p[i];
+                }
+                for (int i = 0; i < 3; i++)
+                    centroid[i][t] = sum[i] * (1.0f / 3.0f);
+            }
+        });
+        valid = false;
+    }
+
+    // Sorts for modelView, farthest first. Returns false, keeping the previous order, when the matrix didn't change.
+    bool sort(const glm::mat4 &modelView)
+    {
+        if (valid && memcmp(&modelView, &lastModelView, sizeof(modelView)) == 0)
+            return false;
+        lastModelView = modelView;
+        valid = true;
+        // Only the eye space z of the centroids is needed, it is negative in front of the camera so ascending is far
+        // to near
+        const float a = modelView[0][2], b = modelView[1][2], c = modelView[2][2], d = modelView[3][2];
+        const float *x = centroid[0].data(), *y = centroid[1].data(), *z = centroid[2].data();
+        float *out = depth.data();
+        pool.parallelFor(depth.size(), RADIX_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++)
+                out[t] = a * x[t] + b * y[t] + c * z[t] + d;
+        });
+        order = radix.sortIndices(out, depth.size());
+        return true;
+    }
+
+    // Writes the 3 vertex indices of every triangle in the last sorted order, e.g. into a mapped index buffer
+    void writeIndices(uint32_t *dst)
+    {
+        const uint32_t *sorted = order;
+        pool.parallelFor(depth.size(), RADIX_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t first = 3 * sorted[i];
+                dst[3 * i] = first;
+                dst[3 * i + 1] = first + 1;
+                dst[3 * i + 2] = first + 2;
+            }
+        });
+    }
+
+    size_t triangles() const
+    {
+        return depth.size();
+    }
+
+private:
+    DepthSorter(const DepthSorter &);
+    DepthSorter &operator=(const DepthSorter &);
+
+    ThreadPool &pool;
+    RadixSort radix;
+    std::vector<float> centroid[3]; // object space x, y and z of each triangle's centroid
+    std::vector<float> depth;
+    const uint32_t *order;
+    glm::mat4 lastModelView;
+    bool valid;
+};
+#endif
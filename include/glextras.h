@@ -0,0 +1,147 @@
+#ifndef GLEXTRAS_H
+#define GLEXTRAS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad is generated for the GL 3.2 core profile only. Entry points from newer versions and extensions are loaded here
+// after gladLoadGLLoader(), and every feature gets a flag so callers can fall back when the driver lacks it.
+
+// GL 3.3 / ARB_timer_query
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_PROGRAM_BINARY_FORMATS
+#define GL_PROGRAM_BINARY_FORMATS 0x87FF
+#endif
+
+typedef void (APIENTRYP PFNGLQUERYCOUNTERPROC)(GLuint id, GLenum target);
+typedef void (APIENTRYP PFNGLGETQUERYOBJECTUI64VPROC)(GLuint id, GLenum pname, GLuint64 *params);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLVERTEXATTRIBDIVISORPROC)(GLuint index, GLuint divisor);
+typedef void (APIENTRYP PFNGLVIEWPORTINDEXEDFPROC)(GLuint index, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+
+struct GLExtras
+{
+    // features
+    bool timerQuery;
+    bool instancedArrays;       // attributes can advance per instance instead of per vertex
+    bool parallelShaderCompile; // GL_COMPLETION_STATUS_KHR can be polled without blocking
+    bool programBinary;         // linked programs can be saved and reloaded, in at least one binary format
+    bool viewportIndex;         // viewport arrays the vertex shader can pick from with gl_ViewportIndex
+    // entry points
+    PFNGLQUERYCOUNTERPROC QueryCounter;
+    PFNGLGETQUERYOBJECTUI64VPROC GetQueryObjectui64v;
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC MaxShaderCompilerThreadsKHR;
+    PFNGLGETPROGRAMBINARYPROC GetProgramBinary;
+    PFNGLPROGRAMBINARYPROC ProgramBinary;
+    PFNGLPROGRAMPARAMETERIPROC ProgramParameteri;
+    PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
+    PFNGLVIEWPORTINDEXEDFPROC ViewportIndexedf;
+};
+
+inline GLExtras &glExtras()
+{
+    static GLExtras extras;
+    return extras;
+}
+
+#define glQueryCounter (glExtras().QueryCounter)
+#define glGetQueryObjectui64v (glExtras().GetQueryObjectui64v)
+#define glMaxShaderCompilerThreadsKHR (glExtras().MaxShaderCompilerThreadsKHR)
+#define glGetProgramBinary (glExtras().GetProgramBinary)
+#define glProgramBinary (glExtras().ProgramBinary)
+#define glProgramParameteri (glExtras().ProgramParameteri)
+#define glVertexAttribDivisor (glExtras().VertexAttribDivisor)
+#define glViewportIndexedf (glExtras().ViewportIndexedf)
+
+// returns true if the current context advertises the extension
+inline bool hasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *ext = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (ext && strcmp(ext, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// returns true if the current context is at least the given GL version
+inline bool hasGLVersion(int major, int minor)
+{
+    return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+// loads everything above GL 3.2, must be called with the context current and after gladLoadGLLoader()
+inline void loadGLExtras(GLADloadproc load)
+{
+    GLExtras &ext = glExtras();
+    memset(&ext, 0, sizeof(ext));
+
+    if (hasGLVersion(3, 3) || hasGLExtension("GL_ARB_timer_query"))
+    {
+        ext.QueryCounter = (PFNGLQUERYCOUNTERPROC)load("glQueryCounter");
+        ext.GetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VPROC)load("glGetQueryObjectui64v");
+        ext.timerQuery = ext.QueryCounter && ext.GetQueryObjectui64v;
+    }
+    if (hasGLVersion(3, 3))
+        ext.VertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)load("glVertexAttribDivisor");
+    else if (hasGLExtension("GL_ARB_instanced_arrays"))
+        ext.VertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC)load("glVertexAttribDivisorARB");
+    ext.instancedArrays = ext.VertexAttribDivisor != NULL;
+    // The ARB version shares the enums, only the entry point is named differently
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+        ext.MaxShaderCompilerThreadsKHR = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)load("glMaxShaderCompilerThreadsARB");
+    ext.parallelShaderCompile = ext.MaxShaderCompilerThreadsKHR != NULL;
+
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        ext.GetProgramBinary = (PFNGLGETPROGRAMBINARYPROC)load("glGetProgramBinary");
+        ext.ProgramBinary = (PFNGLPROGRAMBINARYPROC)load("glProgramBinary");
+        ext.ProgramParameteri = (PFNGLPROGRAMPARAMETERIPROC)load("glProgramParameteri");
+        // Drivers may expose the entry points with no format to save in
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        ext.programBinary = ext.GetProgramBinary && ext.ProgramBinary && ext.ProgramParameteri && formats > 0;
+    }
+
+    // Core GL 4.1 only writes gl_ViewportIndex from geometry shaders, the vertex shader needs one of the extensions
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_viewport_array"))
+    {
+        ext.ViewportIndexedf = (PFNGLVIEWPORTINDEXEDFPROC)load("glViewportIndexedf");
+        ext.viewportIndex = ext.ViewportIndexedf && (hasGLExtension("GL_ARB_shader_viewport_layer_array") ||
+                                                     hasGLExtension("GL_AMD_vertex_shader_viewport_index"));
+    }
+}
+#endif
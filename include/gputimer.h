@@ -0,0 +1,97 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+#include <string>
+
+#include "glextras.h"
+#include "stats.h"
+
+// Number of frames a timer can have in flight. Results are read back this many frames late, by which time the GPU has
+// long finished with them, so reading never waits on the pipeline.
+const int GPU_TIMER_FRAMES = 4;
+
+// Measures GPU time between begin() and end() with a pair of timestamp queries per frame.
+// Timestamps rather than GL_TIME_ELAPSED are used so timers can nest and overlap.
+// Does nothing when the driver has no timer queries. Like the rest of the GL objects the queries live until the context is destroyed.
+class GpuTimer
+{
+public:
+    GpuTimer(Stats &stats, const std::string &name) : stats(stats), channel(stats.channel(name)), head(0), pending(0), active(false)
+    {
+        enabled = glExtras().timerQuery;
+        if (enabled)
+            glGenQueries(2 * GPU_TIMER_FRAMES, &queries[0][0]);
+    }
+
+    void begin()
+    {
+        if (!enabled)
+            return;
+        // All slots still in flight: drop this sample instead of waiting for the oldest one
+        if (pending == GPU_TIMER_FRAMES)
+            collect();
+        active = pending < GPU_TIMER_FRAMES;
+        if (active)
+            glQueryCounter(queries[head][0], GL_TIMESTAMP);
+    }
+
+    void end()
+    {
+        if (!active)
+            return;
+        glQueryCounter(queries[head][1], GL_TIMESTAMP);
+        head = (head + 1) % GPU_TIMER_FRAMES;
+        pending++;
+        active = false;
+    }
+
+    // moves every finished result into the stats, oldest first, without blocking
+    void collect()
+    {
+        while (pending > 0)
+        {
+            int slot = (head - pending + GPU_TIMER_FRAMES) % GPU_TIMER_FRAMES;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+            GLuint64 start = 0, stop = 0;
+            glGetQueryObjectui64v(queries[slot][0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[slot][1], GL_QUERY_RESULT, &stop);
+            stats.add(channel, (stop - start) / 1e6);
+            pending--;
+        }
+    }
+
+private:
+    GpuTimer(const GpuTimer &);
+    GpuTimer &operator=(const GpuTimer &);
+
+    Stats &stats;
+    int channel;
+    bool enabled;
+    unsigned int queries[GPU_TIMER_FRAMES][2];
+    int head;
+    int pending;
+    bool active;
+};
+
+// Times the enclosing scope on the GPU
+class GpuScope
+{
+public:
+    GpuScope(GpuTimer &timer) : timer(timer)
+    {
+        timer.begin();
+    }
+    ~GpuScope()
+    {
+        timer.end();
+    }
+
+private:
+    GpuTimer &timer;
+};
+#endif
@@ -0,0 +1,120 @@
+#ifndef MATRIXBATCH_H
+#define MATRIXBATCH_H
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+#include "simd8.h"
+
+// How a model matrix is laid out in an instance buffer
+enum MatrixLayout {
+    MATRIX_4X4, // 16 floats, the columns of a glm::mat4
+    MATRIX_4X3  // 12 floats, the top three rows of the affine matrix, a quarter less to write and upload
+};
+
+inline size_t matrixFloats(MatrixLayout layout)
+{
+    return layout == MATRIX_4X4 ? 16 : 12;
+}
+
+// Structure of arrays transforms: position and rotation of every object about a unit axis
+struct TransformArrays
+{
+    const float *x, *y, *z;
+    const float *axisX, *axisY, *axisZ;
+    const float *angle; // radians, |angle| < 3 pi
+};
+
+// Reference path: writes translate(origin + position) * rotate(angle, axis) of objects [begin, end) the way glm computes
+// it, object i at out + i * matrixFloats(layout)
+inline void buildMatricesScalar(const TransformArrays &t, const glm::vec3 &origin, size_t begin, size_t end,
+                                MatrixLayout layout, float *out)
+{
+    size_t stride = matrixFloats(layout);
+    for (size_t i = begin; i < end; i++)
+    {
+        float c = std::cos(t.angle[i]), s = std::sin(t.angle[i]), k = 1.0f - c;
+        float ax = t.axisX[i], ay = t.axisY[i], az = t.axisZ[i];
+        // Columns of the rotation, then the translation
+        float m[4][3] = {{k * ax * ax + c, k * ax * ay + s * az, k * ax * az - s * ay},
+                         {k * ax * ay - s * az, k * ay * ay + c, k * ay * az + s * ax},
+                         {k * ax * az + s * ay, k * ay * az - s * ax, k * az * az + c},
+                         {origin.x + t.x[i], origin.y + t.y[i], origin.z + t.z[i]}};
+        float *o = out + i * stride;
+        if (layout == MATRIX_4X4)
+            for (int column = 0; column < 4; column++)
+            {
+                o[4 * column] = m[column][0];
+                o[4 * column + 1] = m[column][1];
+                o[4 * column + 2] = m[column][2];
+                o[4 * column + 3] = column == 3 ? 1.0f : 0.0f;
+            }
+        else
+            for (int row = 0; row < 3; row++)
+                for (int column = 0; column < 4; column++)
+                    o[4 * row + column] = m[column][row];
+    }
+}
+
+// Same result as buildMatricesScalar, eight objects at a time: every element of the matrix is computed for eight objects
+// in one float8, then 8x8 transposes turn them into whole matrices stored in order, so a write combined mapped buffer
+// sees sequential full writes. sin and cos come from a polynomial, within 1e-6 of glm.
+inline void buildMatrices(const TransformArrays &t, const glm::vec3 &origin, size_t begin, size_t end,
+                          MatrixLayout layout, float *out)
+{
+    const float pi = 3.14159265359f;
+    size_t stride = matrixFloats(layout);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        // Fold the angles into [-pi, pi] for sincos
+        float8 a = float8::load(t.angle + i);
+        a = select(a > float8(pi), a - float8(2 * pi), a);
+        a = select(a < float8(-pi), a + float8(2 * pi), a);
+        float8 s, c;
+        sincos(a, s, c);
+        float8 k = float8(1.0f) - c;
+        float8 ax = float8::load(t.axisX + i), ay = float8::load(t.axisY + i), az = float8::load(t.axisZ + i);
+        float8 kx = k * ax, ky = k * ay, kz = k * az;
+        float8 sx = s * ax, sy = s * ay, sz = s * az;
+        float8 m00 = kx * ax + c, m01 = kx * ay + sz, m02 = kx * az - sy; // column 0
+        float8 m10 = kx * ay - sz, m11 = ky * ay + c, m12 = ky * az + sx; // column 1
+        float8 m20 = kx * az + sy, m21 = ky * az - sx, m22 = kz * az + c; // column 2
+        float8 tx = float8(origin.x) + float8::load(t.x + i);
+        float8 ty = float8(origin.y) + float8::load(t.y + i);
+        float8 tz = float8(origin.z) + float8::load(t.z + i);
+        float8 zero(0.0f), one(1.0f);
+
+        float *o = out + i * stride;
+        if (layout == MATRIX_4X4)
+        {
+            // Each object's first and last eight floats
+            float8 front[8] = {m00, m01, m02, zero, m10, m11, m12, zero};
+            float8 back[8] = {m20, m21, m22, zero, tx, ty, tz, one};
+            transpose8(front);
+            transpose8(back);
+            for (int j = 0; j < 8; j++)
+            {
+                front[j].store(o + 16 * j);
+                back[j].store(o + 16 * j + 8);
+            }
+        }
+        else
+        {
+            // Rows 0 and 1 of each object, then row 2
+            float8 front[8] = {m00, m10, m20, tx, m01, m11, m21, ty};
+            float8 back[8] = {m02, m12, m22, tz, zero, zero, zero, zero};
+            transpose8(front);
+            transpose8(back);
+            for (int j = 0; j < 8; j++)
+            {
+                front[j].store(o + 12 * j);
+                back[j].store4(o + 12 * j + 8);
+            }
+        }
+    }
+    buildMatricesScalar(t, origin, i, end, layout, out);
+}
+#endif
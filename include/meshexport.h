@@ -0,0 +1,436 @@
+#ifndef MESHEXPORT_H
+#define MESHEXPORT_H
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "prism.h"
+
+// Bytes per write of an export, the alignment its buffer and file offsets keep, and sides generated at a time. A chunk
+// of sides in any of the formats is far smaller than a block.
+const size_t EXPORT_BLOCK_BYTES = 4 << 20;
+const size_t EXPORT_ALIGNMENT = 4096;
+const size_t EXPORT_CHUNK_SIDES = 4096;
+
+// Sequential output in whole blocks: every write but the last is EXPORT_BLOCK_BYTES from an aligned buffer at an
+// aligned file offset. That is what O_DIRECT asks for, so on Linux the file is opened with it where the file system
+// allows and a huge export doesn't push everything else out of the page cache. The last, partial block is written with
+// O_DIRECT cleared.
+//
+// append() hands out room for the generator to write into in place. The buffer holds a block and a spill as large,
+// whatever spilled past the block moves to the front once the block is written.
+class BlockWriter
+{
+public:
+    BlockWriter() : storage(2 * EXPORT_BLOCK_BYTES + EXPORT_ALIGNMENT), used(0), written(0), failed(false)
+    {
+        buffer = &storage[0] + (EXPORT_ALIGNMENT - (uintptr_t)&storage[0] % EXPORT_ALIGNMENT) % EXPORT_ALIGNMENT;
+#ifdef _WIN32
+        file = NULL;
+#else
+        fd = -1;
+        direct = false;
+#endif
+    }
+    ~BlockWriter()
+    {
+        close();
+    }
+
+    bool open(const std::string &path)
+    {
+        used = written = 0;
+        failed = false;
+#ifdef _WIN32
+        file = fopen(path.c_str(), "wb");
+        return file != NULL;
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+        direct = fd >= 0;
+#endif
+        if (fd < 0)
+            fd = ::open(path.c_str(), flags, 0644);
+        return fd >= 0;
+#endif
+    }
+
+    // Room for bytes, at most EXPORT_BLOCK_BYTES, to fill before the next call
+    unsigned char *append(size_t bytes)
+    {
+        if (used >= EXPORT_BLOCK_BYTES)
+        {
+            flush(EXPORT_BLOCK_BYTES);
+            used -= EXPORT_BLOCK_BYTES;
+            memcpy(buffer, buffer + EXPORT_BLOCK_BYTES, used);
+        }
+        unsigned char *room = buffer + used;
+        used += bytes;
+        return room;
+    }
+
+    void write(const void *data, size_t bytes)
+    {
+        const unsigned char *in = (const unsigned char *)data;
+        while (bytes)
+        {
+            size_t piece = std::min(bytes, EXPORT_BLOCK_BYTES);
+            memcpy(append(piece), in, piece);
+            in += piece;
+            bytes -= piece;
+        }
+    }
+
+    // Writes what is left and closes the file, false if any write failed
+    bool close()
+    {
+#ifdef _WIN32
+        if (!file)
+            return !failed;
+#else
+        if (fd < 0)
+            return !failed;
+#endif
+        append(0);
+        setDirect(false);
+        flush(used);
+        used = 0;
+#ifdef _WIN32
+        failed |= fclose(file) != 0;
+        file = NULL;
+#else
+        failed |= ::close(fd) != 0;
+        fd = -1;
+#endif
+        return !failed;
+    }
+
+    // Bytes written to the file so far
+    uint64_t size() const
+    {
+        return written;
+    }
+
+private:
+    void flush(size_t bytes)
+    {
+        if (failed || !bytes)
+            return;
+        written += bytes;
+#ifdef _WIN32
+        failed = fwrite(buffer, 1, bytes, file) != bytes;
+#else
+        const unsigned char *data = buffer;
+        while (bytes)
+        {
+            ssize_t n = ::write(fd, data, bytes);
+            if (n < 0 && errno == EINTR)
+                continue;
+            // Some file systems accept O_DIRECT when opening and only refuse it when writing
+            if (n < 0 && errno == EINVAL && direct)
+            {
+                setDirect(false);
+                continue;
+            }
+            if (n <= 0)
+            {
+                failed = true;
+                return;
+            }
+            data += n;
+            bytes -= n;
+        }
+#endif
+    }
+
+    void setDirect(bool on)
+    {
+#if !defined(_WIN32) && defined(O_DIRECT)
+        if (direct == on)
+            return;
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, on ? flags | O_DIRECT : flags & ~O_DIRECT);
+        direct = on;
+#else
+        (void)on;
+#endif
+    }
+
+    std::vector<unsigned char> storage;
+    unsigned char *buffer; // aligned start of storage
+    size_t used;
+    uint64_t written;
+    bool failed;
+#ifdef _WIN32
+    FILE *file;
+#else
+    int fd;
+    bool direct;
+#endif
+};
+
+// prismIndices() wound counterclockwise seen from outside, as the formats expect. The generator's bottom caps and
+// second halves of the side quads face in, which drawing without culling never shows.
+inline void exportIndices(size_t n, size_t first, size_t count, uint32_t *dst)
+{
+    prismIndices(n, first, count, dst);
+    for (size_t t = 1; t < 4 * count; t += 2)
+        std::swap(dst[3 * t + 1], dst[3 * t + 2]);
+}
+
+// Exact extremes of the mesh's positions, which glTF wants for POSITION. The vertices are prismRadius times the cosine
+// and sine of k step rounded to float, so only the k next to each quarter turn need evaluating, not all n.
+inline void prismMeshBounds(size_t n, float lo[3], float hi[3])
+{
+    const double step = 2 * M_PI / n;
+    lo[0] = lo[1] = hi[0] = hi[1] = 0; // the cap centers
+    lo[2] = -prismLen;
+    hi[2] = prismLen;
+    for (size_t quarter = 0; quarter < 4; quarter++)
+        for (long k = (long)(quarter * n / 4) - 2; k <= (long)(quarter * n / 4) + 2; k++)
+        {
+            size_t v = (size_t)((k % (long)n + (long)n) % (long)n);
+            float x = prismRadius * cos(v * step), y = prismRadius * sin(v * step);
+            lo[0] = std::min(lo[0], x), hi[0] = std::max(hi[0], x);
+            lo[1] = std::min(lo[1], y), hi[1] = std::max(hi[1], y);
+        }
+}
+
+// Binary PLY of the indexed mesh. Its vertex element, float x, y, z and uchar RGBA, is the PRISM_PACKED layout byte for
+// byte, so the generator writes straight into the output; the faces are its indices behind a count of 3. Little
+// endian, like every machine the app runs on.
+inline void exportPly(size_t n, BlockWriter &out)
+{
+    char header[512];
+    int length = snprintf(header, sizeof(header),
+                          "ply\nformat binary_little_endian 1.0\ncomment %zu sided prism\nelement vertex %zu\n"
+                          "property float x\nproperty float y\nproperty float z\nproperty uchar red\n"
+                          "property uchar green\nproperty uchar blue\nproperty uchar alpha\nelement face %zu\n"
+                          "property list uchar uint vertex_indices\nend_header\n",
+                          n, prismVertexCount(n, true), 4 * n);
+    out.write(header, length);
+
+    size_t vsize = prismVertexSize(PRISM_PACKED);
+    for (size_t first = 0; first < n; first += EXPORT_CHUNK_SIDES)
+    {
+        size_t count = std::min(EXPORT_CHUNK_SIDES, n - first);
+        prismIndexedSides(n, first, count, PRISM_PACKED, out.append(count * PRISM_INDEXED_VERTS_PER_SIDE * vsize));
+    }
+    prismIndexedCenters(PRISM_PACKED, out.append(2 * vsize));
+
+    std::vector<uint32_t> indices(EXPORT_CHUNK_SIDES * PRISM_INDICES_PER_SIDE);
+    for (size_t first = 0; first < n; first += EXPORT_CHUNK_SIDES)
+    {
+        size_t count = std::min(EXPORT_CHUNK_SIDES, n - first);
+        exportIndices(n, first, count, indices.data());
+        unsigned char *face = out.append(count * 4 * (1 + 3 * sizeof(uint32_t)));
+        for (size_t t = 0; t < 4 * count; t++)
+        {
+            *face++ = 3;
+            memcpy(face, &indices[3 * t], 3 * sizeof(uint32_t));
+            face += 3 * sizeof(uint32_t);
+        }
+    }
+}
+
+// Binary STL, 4 triangles a side. Each side of the indexed generator holds both of its edges, the far one wrapping
+// exactly onto side 0, so the triangles are read from the side's own vertices and the caps' centers. The normals come
+// from the side's angle rather than from the vertices, which at large n are closer together than float can tell apart.
+inline void exportStl(size_t n, BlockWriter &out)
+{
+    unsigned char header[84] = {0};
+    snprintf((char *)header, 80, "%zu sided prism", n); // anything but "solid", which marks ASCII STL
+    uint32_t triangles = (uint32_t)(4 * n);
+    memcpy(header + 80, &triangles, sizeof(triangles));
+    out.write(header, sizeof(header));
+
+    const size_t vsize = prismVertexSize(PRISM_PACKED), recordBytes = 50;
+    const double step = 2 * M_PI / n;
+    const float centers[2][3] = {{0, 0, prismLen}, {0, 0, -prismLen}};
+    // The side's vertices of each triangle in counterclockwise order, -1 and -2 for the top and bottom centers
+    const int order[4][3] = {{-1, 0, 4}, {-2, 5, 1}, {2, 3, 5}, {5, 4, 2}};
+    std::vector<unsigned char> sides(EXPORT_CHUNK_SIDES * PRISM_INDEXED_VERTS_PER_SIDE * vsize);
+    for (size_t first = 0; first < n; first += EXPORT_CHUNK_SIDES)
+    {
+        size_t count = std::min(EXPORT_CHUNK_SIDES, n - first);
+        prismIndexedSides(n, first, count, PRISM_PACKED, sides.data());
+        unsigned char *record = out.append(count * 4 * recordBytes);
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char *side = &sides[i * PRISM_INDEXED_VERTS_PER_SIDE * vsize];
+            float normals[4][3] = {{0, 0, 1},
+                                   {0, 0, -1},
+                                   {(float)cos((first + i + 0.5) * step), (float)sin((first + i + 0.5) * step), 0}};
+            memcpy(normals[3], normals[2], sizeof(normals[2]));
+            for (int t = 0; t < 4; t++)
+            {
+                memcpy(record, normals[t], 12);
+                for (int v = 0; v < 3; v++)
+                {
+                    int k = order[t][v];
+                    memcpy(record + 12 + 12 * v, k < 0 ? (const void *)centers[-k - 1] : side + k * vsize, 12);
+                }
+                memset(record + 48, 0, 2);
+                record += recordBytes;
+            }
+        }
+    }
+}
+
+// The glTF 2.0 document of the indexed mesh in one buffer: the PRISM_PACKED vertices, interleaving POSITION and
+// normalized COLOR_0, followed by the indices. uri names the buffer's file, empty for the one inside a .glb.
+inline std::string gltfJson(size_t n, const std::string &uri)
+{
+    size_t vertices = prismVertexCount(n, true), indices = prismIndexCount(n);
+    size_t vertexBytes = vertices * prismVertexSize(PRISM_PACKED), indexBytes = indices * sizeof(uint32_t);
+    float lo[3], hi[3];
+    prismMeshBounds(n, lo, hi);
+    char json[2048];
+    snprintf(json, sizeof(json),
+             "{\"asset\":{\"version\":\"2.0\",\"generator\":\"prismGL\"},\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+             "\"nodes\":[{\"mesh\":0,\"name\":\"%zu sided prism\"}],"
+             "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1},\"indices\":2}]}],"
+             "\"accessors\":["
+             "{\"bufferView\":0,\"componentType\":5126,\"count\":%zu,\"type\":\"VEC3\","
+             "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+             "{\"bufferView\":0,\"byteOffset\":12,\"componentType\":5121,\"normalized\":true,\"count\":%zu,\"type\":\"VEC4\"},"
+             "{\"bufferView\":1,\"componentType\":5125,\"count\":%zu,\"type\":\"SCALAR\"}],"
+             "\"bufferViews\":["
+             "{\"buffer\":0,\"byteLength\":%zu,\"byteStride\":%zu,\"target\":34962},"
+             "{\"buffer\":0,\"byteOffset\":%zu,\"byteLength\":%zu,\"target\":34963}],"
+             "\"buffers\":[{%s%s%s\"byteLength\":%zu}]}",
+             n, vertices, lo[0], lo[1], lo[2], hi[0], hi[1], hi[2], vertices, indices, vertexBytes,
+             prismVertexSize(PRISM_PACKED), vertexBytes, indexBytes, uri.empty() ? "" : "\"uri\":\"", uri.c_str(),
+             uri.empty() ? "" : "\",", vertexBytes + indexBytes);
+    return json;
+}
+
+// The buffer of gltfJson(), vertices straight from the generator and then the indices
+inline void exportGltfBuffer(size_t n, BlockWriter &out)
+{
+    size_t vsize = prismVertexSize(PRISM_PACKED);
+    for (size_t first = 0; first < n; first += EXPORT_CHUNK_SIDES)
+    {
+        size_t count = std::min(EXPORT_CHUNK_SIDES, n - first);
+        prismIndexedSides(n, first, count, PRISM_PACKED, out.append(count * PRISM_INDEXED_VERTS_PER_SIDE * vsize));
+    }
+    prismIndexedCenters(PRISM_PACKED, out.append(2 * vsize));
+    for (size_t first = 0; first < n; first += EXPORT_CHUNK_SIDES)
+    {
+        size_t count = std::min(EXPORT_CHUNK_SIDES, n - first);
+        exportIndices(n, first, count, (uint32_t *)out.append(count * PRISM_INDICES_PER_SIDE * sizeof(uint32_t)));
+    }
+}
+
+// .glb: a 12 byte header, the JSON chunk padded with spaces and the binary chunk. The vertex and index bytes are both
+// multiples of 4, so the binary chunk needs no padding.
+inline void exportGlb(size_t n, BlockWriter &out)
+{
+    std::string json = gltfJson(n, "");
+    json.resize((json.size() + 3) & ~(size_t)3, ' ');
+    uint64_t binary = prismVertexCount(n, true) * prismVertexSize(PRISM_PACKED) + prismIndexCount(n) * sizeof(uint32_t);
+    uint32_t header[5] = {0x46546C67, 2, (uint32_t)(12 + 8 + json.size() + 8 + binary), (uint32_t)json.size(), 0x4E4F534A};
+    out.write(header, sizeof(header));
+    out.write(json.data(), json.size());
+    uint32_t chunk[2] = {(uint32_t)binary, 0x004E4942};
+    out.write(chunk, sizeof(chunk));
+    exportGltfBuffer(n, out);
+}
+
+// Formats of --export, by file extension
+enum ExportFormat {
+    EXPORT_PLY,
+    EXPORT_STL,
+    EXPORT_GLB,
+    EXPORT_GLTF // JSON with the buffer in a .bin next to it, for meshes over the 4 GiB of a .glb
+};
+
+// Writes the n sided prism in format to out, for a .gltf only the buffer
+inline void exportMesh(size_t n, ExportFormat format, BlockWriter &out)
+{
+    if (format == EXPORT_PLY)
+        exportPly(n, out);
+    else if (format == EXPORT_STL)
+        exportStl(n, out);
+    else if (format == EXPORT_GLB)
+        exportGlb(n, out);
+    else
+        exportGltfBuffer(n, out);
+}
+
+// Writes the n sided prism to path as binary .ply, .stl, .glb or .gltf, by its extension, and sets bytes to the size
+// written. Memory stays at two blocks and a chunk of sides for any n. Prints what went wrong and returns false on
+// failure.
+inline bool exportPrism(size_t n, const std::string &path, uint64_t &bytes)
+{
+    const char *extensions[] = {"ply", "stl", "glb", "gltf"};
+    size_t dot = path.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); i++)
+        extension[i] = (char)tolower((unsigned char)extension[i]);
+    int format = 0;
+    while (format < 4 && extension != extensions[format])
+        format++;
+    if (format == 4)
+    {
+        printf("Can't export to %s: the extension must be .ply, .stl, .glb or .gltf\n", path.c_str());
+        return false;
+    }
+    // 32 bit counts and indices
+    uint64_t limit = format == EXPORT_STL ? 0xFFFFFFFFull / 4 : (0xFFFFFFFFull - 2) / PRISM_INDEXED_VERTS_PER_SIDE;
+    if (n < 3 || n > limit)
+    {
+        printf("Can't export %zu sides to .%s, which holds 3 to %llu\n", n, extension.c_str(), (unsigned long long)limit);
+        return false;
+    }
+    uint64_t glbBytes = 12 + 8 + gltfJson(n, "").size() + 3 + 8 + (uint64_t)prismVertexCount(n, true) *
+                        prismVertexSize(PRISM_PACKED) + (uint64_t)prismIndexCount(n) * sizeof(uint32_t);
+    if (format == EXPORT_GLB && glbBytes > 0xFFFFFFFFull)
+    {
+        printf("%zu sides are over the 4 GiB a .glb can hold, export to .gltf instead\n", n);
+        return false;
+    }
+
+    std::string binaryPath = format == EXPORT_GLTF ? path.substr(0, dot) + ".bin" : path;
+    bytes = 0;
+    if (format == EXPORT_GLTF)
+    {
+        size_t slash = binaryPath.find_last_of("/\\");
+        std::string json = gltfJson(n, slash == std::string::npos ? binaryPath : binaryPath.substr(slash + 1));
+        FILE *file = fopen(path.c_str(), "wb");
+        bool ok = file && fwrite(json.data(), 1, json.size(), file) == json.size();
+        if (!file || fclose(file) != 0 || !ok)
+        {
+            printf("Failed to write %s\n", path.c_str());
+            return false;
+        }
+        bytes += json.size();
+    }
+
+    BlockWriter out;
+    if (!out.open(binaryPath))
+    {
+        printf("Failed to open %s\n", binaryPath.c_str());
+        return false;
+    }
+    exportMesh(n, (ExportFormat)format, out);
+    bool ok = out.close();
+    bytes += out.size();
+    if (!ok)
+        printf("Failed to write %s\n", binaryPath.c_str());
+    return ok;
+}
+#endif
@@ -0,0 +1,141 @@
+#ifndef MULTIVIEW_H
+#define MULTIVIEW_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "camera.h"
+#include "glextras.h"
+#include "options.h"
+#include "shader.h"
+#include "shadervariants.h"
+
+// Views one frame can draw, the uniform arrays of src/vertex.shader and the minimum GL_MAX_VIEWPORTS
+const int MAX_VIEWS = 16;
+
+// Several cameras drawn side by side in a grid of tiles, like GLFW's splitview example.
+//
+// View 0 is the main camera, the others look at the prism from its position turned about the world up axis in equal
+// steps, so they all follow the input. VIEWS_INDEX and VIEWS_CLIP upload every view-projection matrix as one uniform
+// array and draw the mesh once, instanced once per view with the MULTIVIEW shader feature: the draw calls and state
+// changes stay those of a single view and only the vertex work grows with the count. VIEWS_PASSES is the baseline of
+// one viewport, uniform upload and draw per view.
+class MultiView
+{
+public:
+    // mode must be resolved, VIEWS_INDEX needs glExtras().viewportIndex
+    MultiView(int count, ViewMode mode) : cameras(count), views(count), projections(count), tiles(count), mode(mode),
+                                          width(0), height(0)
+    {
+        columns = (int)std::ceil(std::sqrt((float)count));
+        rows = (count + columns - 1) / columns;
+    }
+
+    // Shader features the mode draws with
+    unsigned features() const
+    {
+        if (mode == VIEWS_INDEX)
+            return SHADER_MULTIVIEW | SHADER_VIEWPORT_INDEX;
+        return mode == VIEWS_CLIP ? SHADER_MULTIVIEW : 0;
+    }
+
+    // Places the cameras around the main one and lays the tiles out over the framebuffer
+    void update(const Camera &main, int framebufferWidth, int framebufferHeight)
+    {
+        width = framebufferWidth;
+        height = framebufferHeight;
+        float aspect = (float)std::max(width / columns, 1) / (float)std::max(height / rows, 1);
+        for (size_t i = 0; i < cameras.size(); i++)
+        {
+            glm::mat4 turn = glm::rotate(glm::mat4(1.0f), glm::radians(360.0f * i / cameras.size()), main.WorldUp);
+            cameras[i] = main;
+            cameras[i].Position = glm::vec3(turn * glm::vec4(main.Position, 1.0f));
+            views[i] = cameras[i].GetViewMatrix();
+            projections[i] = glm::perspective(glm::radians(cameras[i].Zoom), aspect, 0.1f, 100.0f);
+
+            // Normalized device coordinates of the tile, rows from the top
+            glm::ivec4 v = viewport(i);
+            glm::vec2 scale((float)v.z / width, (float)v.w / height);
+            glm::vec2 lower(2.0f * v.x / width - 1.0f, 2.0f * v.y / height - 1.0f);
+            tiles[i] = glm::vec4(scale, lower + scale);
+        }
+    }
+
+    // Tile of view i in pixels: x, y, width, height
+    glm::ivec4 viewport(size_t i) const
+    {
+        int w = width / columns, h = height / rows;
+        int column = i % columns, row = i / columns;
+        return glm::ivec4(column * w, height - (row + 1) * h, w, h);
+    }
+
+    // Draws vertexCount vertices of the bound vertex array from first in every view, the shader must have been built
+    // with features()
+    void draw(Shader &shader, GLint first, GLsizei vertexCount)
+    {
+        if (mode == VIEWS_PASSES)
+        {
+            for (size_t i = 0; i < views.size(); i++)
+            {
+                glm::ivec4 v = viewport(i);
+                glViewport(v.x, v.y, v.z, v.w);
+                shader.setMat4("view", views[i]);
+                shader.setMat4("projection", projections[i]);
+                glDrawArrays(GL_TRIANGLES, first, vertexCount);
+            }
+            glViewport(0, 0, width, height);
+            return;
+        }
+
+        glm::mat4 viewProjections[MAX_VIEWS];
+        for (size_t i = 0; i < views.size(); i++)
+            viewProjections[i] = projections[i] * views[i];
+        glUniformMatrix4fv(glGetUniformLocation(shader.ID, "viewProjection"), views.size(), GL_FALSE,
+                           glm::value_ptr(viewProjections[0]));
+        if (mode == VIEWS_INDEX)
+        {
+            for (size_t i = 0; i < views.size(); i++)
+            {
+                glm::ivec4 v = viewport(i);
+                glViewportIndexedf(i, v.x, v.y, v.z, v.w);
+            }
+        }
+        else
+        {
+            glUniform4fv(glGetUniformLocation(shader.ID, "tiles"), tiles.size(), glm::value_ptr(tiles[0]));
+            for (int i = 0; i < 4; i++)
+                glEnable(GL_CLIP_DISTANCE0 + i);
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLES, first, vertexCount, views.size());
+
+        if (mode == VIEWS_INDEX)
+            glViewport(0, 0, width, height); // resets every viewport of the array
+        else
+            for (int i = 0; i < 4; i++)
+                glDisable(GL_CLIP_DISTANCE0 + i);
+    }
+
+    size_t count() const
+    {
+        return views.size();
+    }
+
+private:
+    std::vector<Camera> cameras;
+    std::vector<glm::mat4> views;
+    std::vector<glm::mat4> projections;
+    std::vector<glm::vec4> tiles; // clip space to tile scale in xy and offset in zw, for VIEWS_CLIP
+    ViewMode mode;
+    int columns;
+    int rows;
+    int width;
+    int height;
+};
+#endif
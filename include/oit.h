@@ -0,0 +1,97 @@
+#ifndef OIT_H
+#define OIT_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <string>
+
+#include "shader.h"
+
+// Weighted blended order-independent transparency (McGuire and Bavoil, 2013).
+//
+// Translucent geometry is drawn once, in any order, into two targets: an RGBA16F one summing color * alpha * weight in
+// rgb while multiplying (1 - alpha) into alpha (the revealage, how much background shows through), and an R16F one
+// summing alpha * weight. A single glBlendFuncSeparate does both, so GL 3.3 is enough without per-target blend
+// functions. composite() then divides the sums into an average color and blends it over the framebuffer with coverage
+// 1 - revealage. The cost is fixed at one extra fullscreen pass, with no sorting; the weight, which favours fragments
+// near the camera, is an approximation of the true back to front result.
+//
+// Draw with the OIT feature of src/fragment.shader between begin() and composite().
+class WeightedOIT
+{
+public:
+    WeightedOIT(const std::string &compositeVertex, const std::string &compositeFragment, ProgramCache *cache = NULL)
+        : compositeShader(Shader::fromSource(compositeVertex, compositeFragment, cache)), width(0), height(0)
+    {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(2, textures);
+        glGenVertexArrays(1, &vao);
+        compositeShader.use();
+        compositeShader.setInt("accumTexture", 0);
+        compositeShader.setInt("weightTexture", 1);
+    }
+
+    // Binds and clears the targets, resized to the framebuffer, and sets up blending. Depth testing is off: with nothing
+    // opaque in the scene every translucent fragment contributes.
+    void begin(int framebufferWidth, int framebufferHeight)
+    {
+        if (framebufferWidth != width || framebufferHeight != height)
+            resize(framebufferWidth, framebufferHeight);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        const GLfloat accumClear[4] = {0, 0, 0, 1}, weightClear[4] = {0, 0, 0, 0};
+        glClearBufferfv(GL_COLOR, 0, accumClear);
+        glClearBufferfv(GL_COLOR, 1, weightClear);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    // Blends the resolved transparency over the default framebuffer and restores the opaque state
+    void composite()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        compositeShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        glBindVertexArray(vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glActiveTexture(GL_TEXTURE0);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    void resize(int w, int h)
+    {
+        width = w;
+        height = h;
+        const GLenum formats[2] = {GL_RGBA16F, GL_R16F};
+        const GLenum layouts[2] = {GL_RGBA, GL_RED};
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, formats[i], w, h, 0, layouts[i], GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+        }
+        const GLenum buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, buffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Transparency targets are not complete" << std::endl;
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    Shader compositeShader;
+    GLuint fbo;
+    GLuint textures[2]; // accumulation, weight
+    GLuint vao;         // empty, the composite triangle is made up in the vertex shader
+    int width;
+    int height;
+};
+#endif
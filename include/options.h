@@ -0,0 +1,223 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// Renderers the app can draw with
+enum Backend {
+    BACKEND_GL,   // OpenGL in a window
+    BACKEND_SOFT, // built-in multithreaded rasterizer into an in-memory framebuffer, no window or GL needed
+    BACKEND_RAY   // analytic ray tracer into the same framebuffer, cost independent of n
+};
+
+// How the gl backend blends the translucent faces
+enum Transparency {
+    TRANSPARENCY_OPAQUE, // depth tested, alpha ignored
+    TRANSPARENCY_OIT,    // weighted blended order-independent transparency, two passes and no sorting
+    TRANSPARENCY_SORTED  // blended back to front, triangles radix sorted on the CPU whenever the view changes
+};
+
+// How the gl backend draws several views of the prism
+enum ViewMode {
+    VIEWS_AUTO,  // index where the driver supports it, clip otherwise
+    VIEWS_INDEX, // one instanced draw, every instance picks its viewport with gl_ViewportIndex
+    VIEWS_CLIP,  // one instanced draw, every instance is clipped and moved into its tile by the vertex shader
+    VIEWS_PASSES // one draw per view
+};
+
+// Command line options of the app
+struct Options
+{
+    int n;      // number of sides of the prism
+    bool stats; // print CPU/GPU timings every second
+    std::string trace; // Chrome trace-event JSON written on exit, empty when not tracing
+    std::string record; // input recording written while running
+    std::string replay; // input recording played back instead of the keyboard
+    float fixedStep;    // time step in seconds used for replays, 0 to use the recorded ones
+    std::string scenario; // scripted run played instead of the keyboard, see scenario.h
+    bool collide;         // find the overlapping instances every frame
+    std::string exportPath; // mesh file the prism is written to instead of running, see meshexport.h
+    std::string scene;       // gl backend: file the instances are loaded from, see scenefile.h
+    std::string convertFrom; // text scene converted to the binary file convertTo instead of running
+    std::string convertTo;
+    Backend backend;
+    bool analytic;      // gl backend: ray cast the prism in the fragment shader instead of drawing the mesh
+    bool packed;        // gl backend: store the mesh in the 16 byte packed vertex layout
+    bool computedColor; // gl backend: derive the colors in the vertex shader instead of reading them
+    Transparency transparency;
+    int views;          // gl backend: cameras around the prism drawn side by side, up to MAX_VIEWS
+    ViewMode viewMode;
+    bool hotReload;     // gl backend: recompile the shaders when their files change
+    unsigned threads;   // worker threads of the CPU backends and sorting, 0 for one per hardware thread
+    int frames;         // frames rendered by the headless backends when not replaying
+    std::string output; // PPM the headless backends write their last frame to
+    std::string shaderDir;   // gl backend: directory to read the shaders from instead of the copies embedded in the app
+    std::string shaderCache; // gl backend: directory of saved program binaries, empty for the default, off to disable
+    std::string capture;     // gl backend: video every frame is written to, see capture.h
+};
+
+inline void usage()
+{
+    std::cout << "Usage : ./app <n> [options]\n"
+              << "        ./app --replay <file> [options]\n"
+              << "        ./app --scenario <file> [options]\n"
+              << "        ./app --convert-scene <text> <binary>\n"
+              << "  --stats           print rolling CPU/GPU timings every second\n"
+              << "  --trace <file>    write a Chrome/Perfetto trace of startup and every frame on exit\n"
+              << "  --record <file>   record the initial state and every frame's input\n"
+              << "  --replay <file>   play a recording back, n and the initial state come from the recording\n"
+              << "  --fixed-step <ms> replay with a fixed time step instead of the recorded ones\n"
+              << "  --scenario <file> run a scripted scenario and print frame times per segment, n comes from the file\n"
+              << "  --export <file>   write the prism as binary .ply, .stl, .glb or .gltf and exit, streamed in blocks so\n"
+              << "                    any n fits in a few MB of memory\n"
+              << "  --scene <file>    gl backend: draw the prisms of a scene file as instances, text or binary from\n"
+              << "                    --convert-scene, which is mapped and used in place however many prisms it holds\n"
+              << "  --convert-scene <text> <binary> write a text scene as a binary one and exit\n"
+              << "  --collide         find the pairs of overlapping prisms every frame of a scenario's instanced steps and\n"
+              << "                    print their count with the timings\n"
+              << "  --backend <name>  gl (default), soft for the headless multithreaded software rasterizer or ray for\n"
+              << "                    the headless ray tracer, which intersects the prism analytically for any n\n"
+              << "  --analytic        gl backend: ray cast the prism over its screen rectangle in the fragment shader,\n"
+              << "                    no mesh is generated and the cost follows screen coverage instead of n\n"
+              << "  --packed          gl backend: 16 byte vertices with RGBA8 colors instead of 24 byte float ones\n"
+              << "  --computed-color  gl backend: compute the colors in the vertex shader from the vertex index\n"
+              << "  --transparency <mode> gl backend: opaque (default), oit for weighted blended order-independent\n"
+              << "                    transparency of the mesh or sorted to blend its triangles exactly back to front\n"
+              << "  --views <n>       gl backend: draw n cameras around the prism side by side, up to 16\n"
+              << "  --view-mode <mode> gl backend: how --views draws: auto (default), index for one draw routed by\n"
+              << "                    gl_ViewportIndex, clip for one draw clipped into the tiles, passes for a draw per view\n"
+              << "  --hot-reload      gl backend: recompile the shaders in the background whenever their files are saved,\n"
+              << "                    the files of --shader-dir or else the ones in the source tree\n"
+              << "  --shader-dir <dir> gl backend: read the shaders from dir instead of the copies built into the app\n"
+              << "  --shader-cache <dir|off>  gl backend: where linked programs are saved to skip compiling on the next\n"
+              << "                    launch, default $XDG_CACHE_HOME/prismGL, off to always compile\n"
+              << "  --capture <file>  gl backend: write every frame to a Y4M video, raw RGBA frames for .rgba or .raw names\n"
+              << "                    or, for |command, pipe the Y4M into command, e.g. \"|ffmpeg -i - out.mp4\"\n"
+              << "  --threads <n>     threads used by the soft and ray backends and by sorted transparency, default one\n"
+              << "                    per hardware thread\n"
+              << "  --frames <n>      frames the soft and ray backends render when not replaying, default 100\n"
+              << "  --output <file>   write the soft or ray backend's last frame as a PPM image" << std::endl;
+    exit(0);
+}
+
+inline Options parseOptions(int argc, char **argv)
+{
+    Options opts;
+    opts.stats = false;
+    opts.fixedStep = 0;
+    opts.collide = false;
+    opts.backend = BACKEND_GL;
+    opts.analytic = false;
+    opts.packed = false;
+    opts.computedColor = false;
+    opts.transparency = TRANSPARENCY_OPAQUE;
+    opts.views = 1;
+    opts.viewMode = VIEWS_AUTO;
+    opts.hotReload = false;
+    opts.threads = 0;
+    opts.frames = 100;
+
+    if (argc < 2)
+        usage();
+    // n may be left out when it comes from a recording
+    int first = 1;
+    opts.n = 0;
+    if (argv[1][0] != '-')
+        opts.n = atoi(argv[first++]);
+    for (int i = first; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+            opts.stats = true;
+        else if (arg == "--trace" && i + 1 < argc)
+            opts.trace = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            opts.record = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            opts.replay = argv[++i];
+        else if (arg == "--scenario" && i + 1 < argc)
+            opts.scenario = argv[++i];
+        else if (arg == "--export" && i + 1 < argc)
+            opts.exportPath = argv[++i];
+        else if (arg == "--scene" && i + 1 < argc)
+            opts.scene = argv[++i];
+        else if (arg == "--convert-scene" && i + 2 < argc)
+        {
+            opts.convertFrom = argv[++i];
+            opts.convertTo = argv[++i];
+        }
+        else if (arg == "--collide")
+            opts.collide = true;
+        else if (arg == "--fixed-step" && i + 1 < argc)
+            opts.fixedStep = atof(argv[++i]) / 1000.0f;
+        else if (arg == "--backend" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "gl")
+                opts.backend = BACKEND_GL;
+            else if (name == "soft")
+                opts.backend = BACKEND_SOFT;
+            else if (name == "ray")
+                opts.backend = BACKEND_RAY;
+            else
+                usage();
+        }
+        else if (arg == "--analytic")
+            opts.analytic = true;
+        else if (arg == "--packed")
+            opts.packed = true;
+        else if (arg == "--computed-color")
+            opts.computedColor = true;
+        else if (arg == "--transparency" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "opaque")
+                opts.transparency = TRANSPARENCY_OPAQUE;
+            else if (mode == "oit")
+                opts.transparency = TRANSPARENCY_OIT;
+            else if (mode == "sorted")
+                opts.transparency = TRANSPARENCY_SORTED;
+            else
+                usage();
+        }
+        else if (arg == "--views" && i + 1 < argc)
+            opts.views = atoi(argv[++i]);
+        else if (arg == "--view-mode" && i + 1 < argc)
+        {
+            std::string mode = argv[++i];
+            if (mode == "auto")
+                opts.viewMode = VIEWS_AUTO;
+            else if (mode == "index")
+                opts.viewMode = VIEWS_INDEX;
+            else if (mode == "clip")
+                opts.viewMode = VIEWS_CLIP;
+            else if (mode == "passes")
+                opts.viewMode = VIEWS_PASSES;
+            else
+                usage();
+        }
+        else if (arg == "--hot-reload")
+            opts.hotReload = true;
+        else if (arg == "--shader-dir" && i + 1 < argc)
+            opts.shaderDir = argv[++i];
+        else if (arg == "--shader-cache" && i + 1 < argc)
+            opts.shaderCache = argv[++i];
+        else if (arg == "--capture" && i + 1 < argc)
+            opts.capture = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc)
+            opts.threads = atoi(argv[++i]);
+        else if (arg == "--frames" && i + 1 < argc)
+            opts.frames = atoi(argv[++i]);
+        else if (arg == "--output" && i + 1 < argc)
+            opts.output = argv[++i];
+        else
+            usage();
+    }
+    if ((opts.n < 3 && opts.replay.empty() && opts.scenario.empty() && opts.convertFrom.empty()) || opts.views < 1 || opts.views > 16 ||
+        (!opts.scenario.empty() && !opts.replay.empty()) || (!opts.scene.empty() && opts.backend != BACKEND_GL))
+        usage();
+    return opts;
+}
+#endif
@@ -0,0 +1,117 @@
+#ifndef PICK_H
+#define PICK_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+#include "bvh.h"
+#include "camera.h"
+#include "prism.h"
+#include "scene.h"
+
+// Faces a pick can hit besides the sides 0 to n - 1, side k being the one between the mesh's vertices k and k + 1
+const int PICK_TOP = -1;
+const int PICK_BOTTOM = -2;
+const int PICK_NONE = -3; // the face of a miss
+
+struct PickHit
+{
+    long index;     // prism, -1 for none
+    int face;       // side index, PICK_TOP, PICK_BOTTOM or PICK_NONE
+    float distance; // along the pick ray, in world units
+};
+
+// World space ray from the camera through the cursor, in window coordinates with y down like GLFW's cursor position
+inline void pickRay(Camera &camera, const glm::mat4 &projection, double cursorX, double cursorY, int windowWidth,
+                    int windowHeight, glm::vec3 &origin, glm::vec3 &dir)
+{
+    glm::vec4 viewport(0.0f, 0.0f, (float)windowWidth, (float)windowHeight);
+    glm::vec3 window((float)cursorX, (float)(windowHeight - cursorY), 1.0f);
+    glm::vec3 far = glm::unProject(window, camera.GetViewMatrix(), projection, viewport);
+    origin = camera.Position;
+    dir = glm::normalize(far - origin);
+}
+
+// Where origin + t dir enters the n sided prism of prism.h, in its object space: the t of the first face crossed at
+// t >= 0, or INFINITY with face PICK_NONE when it misses. From inside the prism it is where the ray leaves.
+//
+// The caps are a slab. Of the sides only two candidates are tested for entry and two for exit: the sides whose normals
+// bracket the angle where the ray crosses the inscribed circle, or where it passes closest to the axis when it misses
+// that circle. The same selection as PrismTracer, so a pick hits exactly what the ray tracer draws.
+inline float rayPrism(const glm::vec3 &o, const glm::vec3 &d, size_t n, int &face)
+{
+    const double pi = 3.14159265358979323846;
+    float step = (float)(2 * pi / n), apothem = (float)(prismRadius * std::cos(pi / n));
+    face = PICK_NONE;
+
+    // Caps, with dz = 0 the divisions give an infinite interval inside the slab and an empty one outside
+    float tTop = (prismLen - o.z) / d.z, tBottom = (-prismLen - o.z) / d.z;
+    float capIn = std::min(tTop, tBottom), capOut = std::max(tTop, tBottom);
+    if (!(capIn <= capOut))
+        return INFINITY;
+
+    float sideIn = -INFINITY, sideOut = INFINITY;
+    long indexIn = 0, indexOut = 0;
+    float a2 = d.x * d.x + d.y * d.y;
+    float tc = a2 > 1e-20f ? -(o.x * d.x + o.y * d.y) / a2 : 0.0f;
+    float cx = o.x + tc * d.x, cy = o.y + tc * d.y, h2 = cx * cx + cy * cy;
+    if (h2 > prismRadius * prismRadius)
+        return INFINITY;
+    float dt = a2 > 1e-20f ? std::sqrt(std::max((apothem * apothem - h2) / a2, 0.0f)) : 0.0f;
+    for (int exit = 0; exit < 2; exit++)
+    {
+        float px = exit ? cx + dt * d.x : cx - dt * d.x, py = exit ? cy + dt * d.y : cy - dt * d.y;
+        long first = (long)std::floor(std::atan2(py, px) / step - 0.5f);
+        for (long k = first; k <= first + 1; k++)
+        {
+            float nx = std::cos((k + 0.5f) * step), ny = std::sin((k + 0.5f) * step);
+            float den = nx * d.x + ny * d.y, dist = apothem - (nx * o.x + ny * o.y);
+            if (den == 0.0f && dist < 0.0f)
+                return INFINITY; // parallel to the side and outside of it
+            float t = dist / den;
+            if (!exit && den < 0.0f && t > sideIn)
+                sideIn = t, indexIn = k;
+            if (exit && den > 0.0f && t < sideOut)
+                sideOut = t, indexOut = k;
+        }
+    }
+
+    float enter = std::max(capIn, sideIn), leave = std::min(capOut, sideOut);
+    if (enter > leave || leave < 0.0f)
+        return INFINITY;
+    bool front = enter >= 0.0f;
+    bool cap = front ? capIn > sideIn : capOut < sideOut;
+    bool top = front ? tTop < tBottom : tTop > tBottom;
+    long side = ((front ? indexIn : indexOut) % (long)n + (long)n) % (long)n;
+    face = cap ? (top ? PICK_TOP : PICK_BOTTOM) : (int)side;
+    return front ? enter : leave;
+}
+
+// Nearest prism of the scene, drawn at origin + its position, along the world space ray. bvh must be up to date with
+// the scene. Only prisms whose box the ray passes get the exact test, in front to back order, and boxes behind the
+// nearest hit so far are skipped.
+inline PickHit pickScene(const Bvh &bvh, const Scene &scene, const glm::vec3 &sceneOrigin, const glm::vec3 &rayOrigin,
+                         const glm::vec3 &dir)
+{
+    PickHit hit = {-1, PICK_NONE, INFINITY};
+    float tMax = INFINITY;
+    bvh.raycast(rayOrigin - sceneOrigin, dir, tMax, [&](size_t i, float &t) {
+        // Into the prism's object space, the inverse of its rotation is the transpose
+        glm::mat3 rotation(glm::rotate(glm::mat4(1.0f), scene.angle[i], glm::vec3(scene.axisX[i], scene.axisY[i], scene.axisZ[i])));
+        glm::mat3 toObject = glm::transpose(rotation);
+        glm::vec3 o = toObject * (rayOrigin - sceneOrigin - glm::vec3(scene.x[i], scene.y[i], scene.z[i]));
+        int face;
+        float distance = rayPrism(o, toObject * dir, scene.sides[i], face);
+        if (distance < t)
+        {
+            t = distance;
+            hit.index = (long)i;
+            hit.face = face;
+            hit.distance = distance;
+        }
+    });
+    return hit;
+}
+#endif
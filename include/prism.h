@@ -0,0 +1,171 @@
+#ifndef PRISM_H
+#define PRISM_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Half the len of prism
+const float prismLen = 0.5f;
+// Radius of the prism's polygon
+const float prismRadius = 0.5f;
+
+// Vertex layouts the generator can emit. Both start with a vec3 position at attribute 0 followed by the color at attribute 1
+enum Prism_Layout {
+    PRISM_FLOAT,  // vec3 position + vec3 color, 24 bytes
+    PRISM_PACKED  // vec3 position + normalized RGBA8 color, 16 bytes
+};
+
+// Every side of the prism contributes 4 triangles: the top cap slice, the bottom cap slice and the two halves of the side quad.
+// Unindexed meshes store them as 12 consecutive vertices per side, indexed meshes store 6 unique vertices per side followed
+// by the 2 cap centers, so any range of sides can be generated independently of the rest of the mesh.
+const size_t PRISM_VERTS_PER_SIDE = 12;
+const size_t PRISM_INDEXED_VERTS_PER_SIDE = 6;
+const size_t PRISM_INDICES_PER_SIDE = 12;
+
+inline size_t prismVertexSize(Prism_Layout layout)
+{
+    return layout == PRISM_PACKED ? 4 * sizeof(float) : 6 * sizeof(float);
+}
+
+inline size_t prismVertexCount(size_t n, bool indexed)
+{
+    return indexed ? PRISM_INDEXED_VERTS_PER_SIDE * n + 2 : PRISM_VERTS_PER_SIDE * n;
+}
+
+inline size_t prismIndexCount(size_t n)
+{
+    return PRISM_INDICES_PER_SIDE * n;
+}
+
+// Color of a side, the sides fade from black to magenta around the prism
+inline void prismSideColor(size_t n, size_t side, float color[3])
+{
+    float c = (1.0f / n) * side;
+    color[0] = c;
+    color[1] = 0;
+    color[2] = c;
+}
+
+const float prismTopColor[3] = {1, 1, 0};
+const float prismBottomColor[3] = {0, 1, 1};
+
+// Writes a single vertex in the requested layout and returns the position right after it
+inline unsigned char *prismWriteVertex(unsigned char *dst, Prism_Layout layout, float x, float y, float z, const float color[3])
+{
+    if (layout == PRISM_PACKED)
+    {
+        float v[4] = {x, y, z, 0};
+        unsigned char *rgba = (unsigned char *)&v[3];
+        rgba[0] = (unsigned char)(color[0] * 255.0f + 0.5f);
+        rgba[1] = (unsigned char)(color[1] * 255.0f + 0.5f);
+        rgba[2] = (unsigned char)(color[2] * 255.0f + 0.5f);
+        rgba[3] = 255;
+        memcpy(dst, v, sizeof(v));
+        return dst + sizeof(v);
+    }
+    float v[6] = {x, y, z, color[0], color[1], color[2]};
+    memcpy(dst, v, sizeof(v));
+    return dst + sizeof(v);
+}
+
+// Generates the unindexed vertices of sides [first, first + count) into dst, which points at the first vertex of side `first`.
+// dst may be a host buffer or a mapped GPU buffer, it is only ever written to sequentially.
+inline void prismSides(size_t n, size_t first, size_t count, Prism_Layout layout, void *dst)
+{
+    unsigned char *out = (unsigned char *)dst;
+    const double step = 2 * M_PI / n;
+    // The second edge of a side is the first edge of the next one, so only one sin/cos pair is evaluated per side
+    float c0 = prismRadius * cos(first * step);
+    float s0 = prismRadius * sin(first * step);
+    for (size_t i = first; i < first + count; i++)
+    {
+        float c1 = prismRadius * cos((i + 1) * step);
+        float s1 = prismRadius * sin((i + 1) * step);
+        float side[3];
+        prismSideColor(n, i, side);
+        // Top cap
+        out = prismWriteVertex(out, layout, 0, 0, prismLen, prismTopColor);
+        out = prismWriteVertex(out, layout, c0, s0, prismLen, prismTopColor);
+        out = prismWriteVertex(out, layout, c1, s1, prismLen, prismTopColor);
+        // Bottom cap
+        out = prismWriteVertex(out, layout, 0, 0, -prismLen, prismBottomColor);
+        out = prismWriteVertex(out, layout, c0, s0, -prismLen, prismBottomColor);
+        out = prismWriteVertex(out, layout, c1, s1, -prismLen, prismBottomColor);
+        // Side quad
+        out = prismWriteVertex(out, layout, c0, s0, prismLen, side);
+        out = prismWriteVertex(out, layout, c0, s0, -prismLen, side);
+        out = prismWriteVertex(out, layout, c1, s1, -prismLen, side);
+        out = prismWriteVertex(out, layout, c1, s1, -prismLen, side);
+        out = prismWriteVertex(out, layout, c0, s0, prismLen, side);
+        out = prismWriteVertex(out, layout, c1, s1, prismLen, side);
+        c0 = c1;
+        s0 = s1;
+    }
+}
+
+// Generates the 6 unique vertices of sides [first, first + count) of an indexed mesh into dst
+inline void prismIndexedSides(size_t n, size_t first, size_t count, Prism_Layout layout, void *dst)
+{
+    unsigned char *out = (unsigned char *)dst;
+    const double step = 2 * M_PI / n;
+    for (size_t i = first; i < first + count; i++)
+    {
+        float c0 = prismRadius * cos(i * step);
+        float s0 = prismRadius * sin(i * step);
+        // The far edge of the side quad comes from the next side, wrapping exactly onto side 0
+        size_t next = (i + 1) % n;
+        float c1 = prismRadius * cos(next * step);
+        float s1 = prismRadius * sin(next * step);
+        float side[3];
+        prismSideColor(n, i, side);
+        out = prismWriteVertex(out, layout, c0, s0, prismLen, prismTopColor);
+        out = prismWriteVertex(out, layout, c0, s0, -prismLen, prismBottomColor);
+        out = prismWriteVertex(out, layout, c0, s0, prismLen, side);
+        out = prismWriteVertex(out, layout, c0, s0, -prismLen, side);
+        out = prismWriteVertex(out, layout, c1, s1, prismLen, side);
+        out = prismWriteVertex(out, layout, c1, s1, -prismLen, side);
+    }
+}
+
+// Generates the 2 cap centers that follow the side vertices of an indexed mesh
+inline void prismIndexedCenters(Prism_Layout layout, void *dst)
+{
+    unsigned char *out = (unsigned char *)dst;
+    out = prismWriteVertex(out, layout, 0, 0, prismLen, prismTopColor);
+    prismWriteVertex(out, layout, 0, 0, -prismLen, prismBottomColor);
+}
+
+// Generates the indices of sides [first, first + count) into dst, in the same triangle order as prismSides()
+inline void prismIndices(size_t n, size_t first, size_t count, uint32_t *dst)
+{
+    const uint32_t top = (uint32_t)(PRISM_INDEXED_VERTS_PER_SIDE * n);
+    const uint32_t bottom = top + 1;
+    for (size_t i = first; i < first + count; i++)
+    {
+        uint32_t b = (uint32_t)(PRISM_INDEXED_VERTS_PER_SIDE * i);
+        uint32_t b1 = (uint32_t)(PRISM_INDEXED_VERTS_PER_SIDE * ((i + 1) % n));
+        uint32_t tri[PRISM_INDICES_PER_SIDE] = {
+            top, b + 0, b1 + 0,
+            bottom, b + 1, b1 + 1,
+            b + 2, b + 3, b + 5,
+            b + 5, b + 2, b + 4};
+        memcpy(dst, tri, sizeof(tri));
+        dst += PRISM_INDICES_PER_SIDE;
+    }
+}
+
+// Generates a whole mesh. indices is only used, and must hold prismIndexCount(n) entries, when indexed is set
+inline void prismGenerate(size_t n, Prism_Layout layout, bool indexed, void *vertices, uint32_t *indices)
+{
+    if (!indexed)
+    {
+        prismSides(n, 0, n, layout, vertices);
+        return;
+    }
+    prismIndexedSides(n, 0, n, layout, vertices);
+    prismIndexedCenters(layout, (unsigned char *)vertices + PRISM_INDEXED_VERTS_PER_SIDE * n * prismVertexSize(layout));
+    prismIndices(n, 0, n, indices);
+}
+#endif
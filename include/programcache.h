@@ -0,0 +1,241 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <glad/glad.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "glextras.h"
+
+// Saves linked programs with glGetProgramBinary so later launches skip compiling and linking.
+//
+// A binary is only valid for the driver that produced it, so the key hashes the sources and defines together with the
+// vendor, renderer and version strings and the binary formats the driver accepts. Drivers may still reject a binary
+// (an update that keeps the version string, a different GPU), in which case load() fails and the caller compiles as
+// usual and stores the new binary over the old one. Each file also records how long the original compile took, which
+// is what a hit saves minus the time glProgramBinary took.
+class ProgramCache
+{
+public:
+    ProgramCache(const std::string &directory) : directory(directory), hits(0), misses(0), savedMs(0)
+    {
+        enabled = glExtras().programBinary && makeDirectories(directory);
+        if (!enabled)
+            return;
+        const char *strings[3] = {(const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER),
+                                  (const char *)glGetString(GL_VERSION)};
+        for (int i = 0; i < 3; i++)
+            driver += std::string(strings[i] ? strings[i] : "") + '\n';
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &count);
+        std::vector<GLint> formats(count);
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formats.data());
+        for (GLint format : formats)
+            driver += std::to_string(format) + '\n';
+    }
+
+    // false when the driver can't save programs or the directory can't be created, every lookup is a miss then
+    bool available() const
+    {
+        return enabled;
+    }
+
+    // Key of a program built from these sources, defines being whatever was prepended to them
+    uint64_t key(const std::string &vertex, const std::string &fragment, const std::string &defines = "") const
+    {
+        uint64_t h = 14695981039346656037ull;
+        const std::string *parts[4] = {&driver, &defines, &vertex, &fragment};
+        for (int i = 0; i < 4; i++)
+        {
+            h = fnv1a(h, parts[i]->data(), parts[i]->size());
+            h = fnv1a(h, "\0", 1); // keeps "ab" + "c" apart from "a" + "bc"
+        }
+        return h;
+    }
+
+    // Loads the cached binary into a new program. Returns 0 on a miss or when the driver rejects the binary.
+    GLuint load(uint64_t key)
+    {
+        if (!enabled)
+            return 0;
+        Clock::time_point start = Clock::now();
+        Header header;
+        std::vector<char> binary;
+        FILE *file = fopen(path(key).c_str(), "rb");
+        bool read = file && fread(&header, sizeof(header), 1, file) == 1 && header.magic == MAGIC &&
+                    header.key == key && header.length > 0;
+        // A truncated or damaged file must not size the read, its length has to be what follows the header
+        if (read)
+        {
+            long at = ftell(file);
+            read = fseek(file, 0, SEEK_END) == 0 && ftell(file) - at == header.length && fseek(file, at, SEEK_SET) == 0;
+        }
+        if (read)
+        {
+            binary.resize(header.length);
+            read = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        if (file)
+            fclose(file);
+        if (!read)
+        {
+            misses++;
+            printf("Program cache miss %016llx\n", (unsigned long long)key);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.format, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            misses++;
+            printf("Program cache miss %016llx: the driver rejected the binary, recompiling\n", (unsigned long long)key);
+            return 0;
+        }
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        hits++;
+        savedMs += header.compileMs - ms;
+        printf("Program cache hit %016llx: loaded in %.1f ms instead of compiling for %.1f ms\n",
+               (unsigned long long)key, ms, header.compileMs);
+        return program;
+    }
+
+    // Call before linking a program that will be stored, some drivers only keep the binary when asked to
+    void prepare(GLuint program) const
+    {
+        if (enabled)
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Saves a linked program under key, compileMs being how long compiling and linking it took
+    void store(uint64_t key, GLuint program, double compileMs)
+    {
+        if (!enabled)
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Header header;
+        header.magic = MAGIC;
+        header.key = key;
+        header.compileMs = compileMs;
+        std::vector<char> binary(length);
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &header.format, binary.data());
+        header.length = written;
+        if (written <= 0)
+            return;
+
+        // Written aside and renamed so another instance never reads half a file
+        std::string target = path(key), temporary = target + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if (!file)
+        {
+            printf("Failed to write %s\n", temporary.c_str());
+            return;
+        }
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, written, file) == (size_t)written;
+        ok = fclose(file) == 0 && ok;
+        remove(target.c_str());
+        if (!ok || rename(temporary.c_str(), target.c_str()) != 0)
+        {
+            remove(temporary.c_str());
+            printf("Failed to write %s\n", target.c_str());
+        }
+    }
+
+    // Hit/miss totals and the compile time hits saved, printed at startup
+    void report() const
+    {
+        if (!enabled)
+            printf("Program cache unavailable: the driver has no program binary formats or %s can't be created\n",
+                   directory.c_str());
+        else
+            printf("Program cache: %d hits, %d misses, %.1f ms saved\n", hits, misses, savedMs);
+    }
+
+    // $XDG_CACHE_HOME/prismGL, ~/.cache/prismGL or %LOCALAPPDATA%\prismGL, a local directory when none is set
+    static std::string defaultDirectory()
+    {
+#ifdef _WIN32
+        const char *local = getenv("LOCALAPPDATA");
+        return local ? std::string(local) + "\\prismGL" : "shader-cache";
+#else
+        const char *xdg = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+        if (xdg && *xdg)
+            return std::string(xdg) + "/prismGL";
+        return home ? std::string(home) + "/.cache/prismGL" : "shader-cache";
+#endif
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    static const uint32_t MAGIC = 0x42505250; // "PRPB"
+
+    struct Header
+    {
+        uint32_t magic;
+        GLenum format;
+        uint64_t key; // guards against a file that was renamed or truncated into another key's place
+        double compileMs;
+        int64_t length;
+    };
+
+    static uint64_t fnv1a(uint64_t h, const char *data, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            h = (h ^ (unsigned char)data[i]) * 1099511628211ull;
+        return h;
+    }
+
+    std::string path(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+        return directory + name;
+    }
+
+    // mkdir -p
+    static bool makeDirectories(const std::string &path)
+    {
+        for (size_t i = 1; i <= path.size(); i++)
+        {
+            if (i < path.size() && path[i] != '/' && path[i] != '\\')
+                continue;
+            std::string prefix = path.substr(0, i);
+#ifdef _WIN32
+            int result = _mkdir(prefix.c_str());
+#else
+            int result = mkdir(prefix.c_str(), 0755);
+#endif
+            if (result != 0 && errno != EEXIST)
+                return false;
+        }
+        return true;
+    }
+
+    std::string directory;
+    std::string driver; // vendor, renderer, version and binary formats, hashed into every key
+    bool enabled;
+    int hits;
+    int misses;
+    double savedMs;
+};
+#endif
@@ -0,0 +1,120 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "threadpool.h"
+
+// Bits sorted per pass, 4 passes cover a 32 bit key with 256 buckets, few enough for the scatter to stay in cache
+const int RADIX_BITS = 8;
+const int RADIX_BUCKETS = 1 << RADIX_BITS;
+// Keys per chunk of the parallel loops that don't depend on the block layout
+const size_t RADIX_GRAIN = 1 << 16;
+
+// Stable least significant digit radix sort of 32 bit float keys on a ThreadPool.
+//
+// Every pass splits the keys into one contiguous block per thread. The threads count the digits of their block, a short
+// serial prefix sum over (digit, block) gives every block the start of its run within each digit's bucket, and the
+// threads scatter their block there. Blocks are visited in order within a digit, so the sort stays stable. A pass
+// where all keys share the digit is skipped, which for depths in a narrow range is often the lowest or highest byte.
+// Buffers grow to the largest count seen and are kept, so sorting the same amount again doesn't allocate.
+class RadixSort
+{
+public:
+    explicit RadixSort(ThreadPool &pool) : pool(pool) {}
+
+    // Returns the indices of the keys in ascending key order, equal keys in index order. Valid until the next call.
+    // NaNs sort after +inf.
+    const uint32_t *sortIndices(const float *keys, size_t count)
+    {
+        if (key[0].size() < count)
+            for (int i = 0; i < 2; i++)
+            {
+                key[i].resize(count);
+                value[i].resize(count);
+            }
+        blocks = std::max<size_t>(1, std::min<size_t>(pool.size(), count / RADIX_GRAIN));
+        blockSize = (count + blocks - 1) / blocks;
+        histogram.resize(blocks * RADIX_BUCKETS);
+
+        // Floats as unsigned integers that compare the same way: negative ones flip every bit, positive ones the sign
+        uint32_t *k = key[0].data(), *v = value[0].data();
+        pool.parallelFor(count, RADIX_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t bits;
+                memcpy(&bits, &keys[i], sizeof(bits));
+                k[i] = bits ^ ((uint32_t)-(int32_t)(bits >> 31) | 0x80000000u);
+                v[i] = (uint32_t)i;
+            }
+        });
+        int from = 0;
+        for (int shift = 0; shift < 32; shift += RADIX_BITS)
+            if (pass(from, shift, count))
+                from ^= 1;
+        return value[from].data();
+    }
+
+private:
+    RadixSort(const RadixSort &);
+    RadixSort &operator=(const RadixSort &);
+
+    // Sorts buffer `from` into the other one by the digit at shift, returns false when the pass was skipped
+    bool pass(int from, int shift, size_t count)
+    {
+        const uint32_t *srcKey = key[from].data(), *srcValue = value[from].data();
+        uint32_t *dstKey = key[from ^ 1].data(), *dstValue = value[from ^ 1].data();
+        uint32_t *offsets = histogram.data();
+
+        pool.parallelFor(blocks, 1, [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; b++)
+            {
+                uint32_t *h = &offsets[b * RADIX_BUCKETS];
+                std::fill(h, h + RADIX_BUCKETS, 0);
+                for (size_t i = b * blockSize, end = std::min(count, i + blockSize); i < end; i++)
+                    h[(srcKey[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            }
+        });
+
+        uint32_t start = 0;
+        for (int d = 0; d < RADIX_BUCKETS; d++)
+        {
+            uint32_t total = 0;
+            for (size_t b = 0; b < blocks; b++)
+                total += offsets[b * RADIX_BUCKETS + d];
+            if (total == count)
+                return false;
+            for (size_t b = 0; b < blocks; b++)
+            {
+                uint32_t c = offsets[b * RADIX_BUCKETS + d];
+                offsets[b * RADIX_BUCKETS + d] = start;
+                start += c;
+            }
+        }
+
+        pool.parallelFor(blocks, 1, [&](size_t first, size_t last) {
+            for (size_t b = first; b < last; b++)
+            {
+                uint32_t *next = &offsets[b * RADIX_BUCKETS];
+                for (size_t i = b * blockSize, end = std::min(count, i + blockSize); i < end; i++)
+                {
+                    uint32_t dst = next[(srcKey[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+                    dstKey[dst] = srcKey[i];
+                    dstValue[dst] = srcValue[i];
+                }
+            }
+        });
+        return true;
+    }
+
+    ThreadPool &pool;
+    std::vector<uint32_t> key[2];
+    std::vector<uint32_t> value[2];
+    std::vector<uint32_t> histogram; // per block digit counts, then the offsets they scatter to
+    size_t blocks;
+    size_t blockSize;
+};
+#endif
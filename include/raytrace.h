@@ -0,0 +1,246 @@
+#ifndef RAYTRACE_H
+#define RAYTRACE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "prism.h"
+#include "simd8.h"
+#include "softraster.h"
+#include "threadpool.h"
+
+// Side of the square screen tiles the threads pick up, a multiple of the 8 ray packet width
+const int RAY_TILE = 32;
+
+// Renders the n sided prism by intersecting every pixel's ray with it analytically, so a frame costs the same for n = 3
+// and n = 10^9. The result matches the rasterized mesh: flat cap and side colors, no culling, GL_LESS depth written in
+// the same [0, 1] window range, clipped by the projection's near and far planes.
+//
+// The prism is the slab |z| <= prismLen intersected with the n half-spaces of its sides. Against the slab a ray needs two
+// divisions; against the sides only two candidates are tested for entry and two for exit. Side k has its normal at angle
+// (k + 1/2) 2pi/n and touches the inscribed circle there, and the side a ray enters through is next to the angle where
+// it enters the inscribed circle (or, when it misses that circle, next to where it passes closest to the axis), same for
+// the exit. The angle comes from simd8.h's atan2, which is off by up to about 1e-5 rad, so a ray entering or leaving
+// within that of the angle between two candidate pairs may be tested against the pair one side over. While sides are
+// wider than about 1e-5 rad (n below about 6 * 10^5) the true side is still one of them; beyond that a neighbour of it
+// may be picked, a difference far below a pixel at those n. Side indices are floats and round beyond n = 2^24.
+class PrismTracer
+{
+public:
+    PrismTracer(ThreadPool &pool) : pool(pool), clearColor(packColor(0.2f, 0.3f, 0.3f, 1.0f)), hits(0) {}
+
+    void setClearColor(float r, float g, float b, float a)
+    {
+        clearColor = packColor(r, g, b, a);
+    }
+
+    // Renders the whole framebuffer, pixels the prism doesn't cover are cleared. projection must be a perspective matrix.
+    void render(size_t n, const glm::mat4 &model, const glm::mat4 &view, const glm::mat4 &projection, Framebuffer &fb)
+    {
+        Frame f;
+        // Rays start at the eye and go through the pixel centers, with direction (u / P00, v / P11, -1) in eye space
+        // so t is the eye space depth. Everything is intersected in object space, where the prism is axis aligned.
+        glm::mat4 toObject = glm::inverse(view * model);
+        glm::mat3 toObjectDir(toObject);
+        glm::vec3 origin(toObject[3]);
+        glm::vec3 dx = toObjectDir[0] * (2.0f / (fb.width * projection[0][0]));
+        glm::vec3 dy = toObjectDir[1] * (2.0f / (fb.height * projection[1][1]));
+        glm::vec3 base = toObjectDir * glm::vec3((1.0f / fb.width - 1.0f) / projection[0][0],
+                                                 (1.0f / fb.height - 1.0f) / projection[1][1], -1.0f);
+        for (int i = 0; i < 3; i++)
+        {
+            f.origin[i] = origin[i];
+            f.dirX[i] = dx[i];
+            f.dirY[i] = dy[i];
+            f.dirBase[i] = base[i];
+        }
+        f.n = (float)n;
+        f.step = (float)(2 * M_PI / n);
+        float apothem = (float)(prismRadius * cos(M_PI / n));
+        f.apothem = apothem;
+        f.apothem2 = apothem * apothem;
+        f.radius2 = prismRadius * prismRadius;
+        f.depthA = projection[2][2];
+        f.depthB = projection[3][2];
+        f.zNear = f.depthB / (f.depthA - 1.0f);
+        f.zFar = f.depthB / (f.depthA + 1.0f);
+        f.sides = n;
+
+        tilesX = (fb.width + RAY_TILE - 1) / RAY_TILE;
+        int tiles = tilesX * ((fb.height + RAY_TILE - 1) / RAY_TILE);
+        hits = 0;
+        pool.parallelFor(tiles, 1, [&](size_t begin, size_t end) {
+            size_t covered = 0;
+            for (size_t t = begin; t < end; t++)
+                covered += traceTile((int)t, f, fb);
+            hits += covered;
+        });
+    }
+
+    // number of pixels the prism covered in the last frame
+    size_t pixelsHit() const
+    {
+        return hits;
+    }
+
+private:
+    // Per frame constants, in object space
+    struct Frame
+    {
+        float origin[3];
+        float dirBase[3], dirX[3], dirY[3]; // ray direction of pixel (x, y) is base + x dirX + y dirY
+        float n, step, apothem, apothem2, radius2;
+        float depthA, depthB; // window depth is (P32 / t - P22) / 2 + 1/2
+        float zNear, zFar;
+        size_t sides;
+    };
+
+    // Candidate sides around the polar angle of (x, y): the two whose normals bracket it
+    static void candidates(const Frame &f, float8 x, float8 y, float8 side[2], float8 nx[2], float8 ny[2])
+    {
+        const float8 pi(3.14159265359f), twoPi(6.28318530718f);
+        float8 theta = atan2(y, x);
+        side[0] = floor(theta * float8(1.0f / f.step) - float8(0.5f));
+        side[1] = side[0] + float8(1.0f);
+        for (int k = 0; k < 2; k++)
+        {
+            float8 angle = (side[k] + float8(0.5f)) * float8(f.step);
+            angle = select(angle > pi, angle - twoPi, select(angle < -pi, angle + twoPi, angle));
+            sincos(angle, ny[k], nx[k]);
+        }
+    }
+
+    size_t traceTile(int tile, const Frame &f, Framebuffer &fb) const
+    {
+        int x0 = (tile % tilesX) * RAY_TILE, y0 = (tile / tilesX) * RAY_TILE;
+        int x1 = std::min(fb.width, x0 + RAY_TILE), y1 = std::min(fb.height, y0 + RAY_TILE);
+        const float8 ox(f.origin[0]), oy(f.origin[1]), oz(f.origin[2]);
+        const float8 zero(0.0f), inf(INFINITY);
+        size_t covered = 0;
+        for (int y = y0; y < y1; y++)
+            for (int x = x0; x < x1; x += 8)
+            {
+                float8 px = float8((float)x) + float8::lanes();
+                float8 dx = float8(f.dirBase[0] + y * f.dirY[0]) + px * float8(f.dirX[0]);
+                float8 dy = float8(f.dirBase[1] + y * f.dirY[1]) + px * float8(f.dirX[1]);
+                float8 dz = float8(f.dirBase[2] + y * f.dirY[2]) + px * float8(f.dirX[2]);
+
+                // Caps: with dz = 0 the divisions give -inf and inf inside the slab and an empty interval outside
+                float8 invDz = float8(1.0f) / dz;
+                float8 tTop = (float8(prismLen) - oz) * invDz, tBottom = (float8(-prismLen) - oz) * invDz;
+                float8 capIn = min(tTop, tBottom), capOut = max(tTop, tBottom);
+
+                // Closest approach of the ray to the axis, in the xy plane. Rays along the axis keep their origin.
+                float8 a2 = dx * dx + dy * dy;
+                float8 moving = a2 > float8(1e-20f);
+                float8 tc = select(moving, -(ox * dx + oy * dy) / a2, zero);
+                float8 cx = ox + tc * dx, cy = oy + tc * dy;
+                float8 h2 = cx * cx + cy * cy;
+                float8 live = (h2 <= float8(f.radius2)) & (capIn <= capOut);
+                if (!any(live))
+                {
+                    storeMiss(fb, x, y, x1);
+                    continue;
+                }
+                // Where the ray crosses the inscribed circle, or the closest approach when it misses it
+                float8 disc = (float8(f.apothem2) - h2) / a2;
+                float8 inside = moving & (disc > zero);
+                float8 dt = sqrt(select(inside, disc, zero));
+                float8 inX = cx - dt * dx, inY = cy - dt * dy;
+                float8 outX = cx + dt * dx, outY = cy + dt * dy;
+
+                float8 sideIn = -inf, sideOut = inf, indexIn = zero, indexOut = zero;
+                float8 side[2], nx[2], ny[2];
+                candidates(f, inX, inY, side, nx, ny);
+                for (int k = 0; k < 2; k++)
+                {
+                    float8 den = nx[k] * dx + ny[k] * dy;
+                    float8 t = (float8(f.apothem) - (nx[k] * ox + ny[k] * oy)) / den;
+                    float8 better = (den < zero) & (t > sideIn);
+                    sideIn = select(better, t, sideIn);
+                    indexIn = select(better, side[k], indexIn);
+                }
+                candidates(f, outX, outY, side, nx, ny);
+                for (int k = 0; k < 2; k++)
+                {
+                    float8 den = nx[k] * dx + ny[k] * dy;
+                    float8 dist = float8(f.apothem) - (nx[k] * ox + ny[k] * oy);
+                    float8 t = dist / den;
+                    float8 better = (den > zero) & (t < sideOut);
+                    sideOut = select(better, t, sideOut);
+                    indexOut = select(better, side[k], indexOut);
+                    // Parallel to a side and outside of it
+                    live = andNot((den == zero) & (dist < zero), live);
+                }
+
+                // Enter through whichever boundary is crossed last, leave through the one crossed first. When the near
+                // plane cuts the front away, the back face shows like it does for the mesh.
+                float8 enter = max(capIn, sideIn), exit = min(capOut, sideOut);
+                live = live & (enter <= exit);
+                float8 front = enter >= float8(f.zNear);
+                float8 t = select(front, enter, exit);
+                live = live & (t >= float8(f.zNear)) & (t <= float8(f.zFar));
+                float8 cap = select(front, capIn > sideIn, capOut < sideOut);
+                float8 top = select(front, tTop < tBottom, tTop > tBottom);
+                float8 index = select(front, indexIn, indexOut);
+                index = select(index < zero, index + float8(f.n), index);
+                float8 depth = float8(0.5f) * (float8(f.depthB) / t - float8(f.depthA)) + float8(0.5f);
+
+                int hitMask = movemask(live);
+                if (!hitMask)
+                {
+                    storeMiss(fb, x, y, x1);
+                    continue;
+                }
+                float lanesDepth[8], lanesCap[8], lanesTop[8], lanesIndex[8];
+                depth.store(lanesDepth);
+                cap.store(lanesCap);
+                top.store(lanesTop);
+                index.store(lanesIndex);
+                uint32_t *color = &fb.color[(size_t)y * fb.stride];
+                float *z = &fb.depth[(size_t)y * fb.stride];
+                for (int i = 0; i < 8 && x + i < x1; i++)
+                {
+                    if (!(hitMask & (1 << i)))
+                    {
+                        color[x + i] = clearColor;
+                        z[x + i] = 1.0f;
+                        continue;
+                    }
+                    color[x + i] = shade(f, std::signbit(lanesCap[i]), std::signbit(lanesTop[i]), lanesIndex[i]);
+                    z[x + i] = lanesDepth[i];
+                    covered++;
+                }
+            }
+        return covered;
+    }
+
+    void storeMiss(Framebuffer &fb, int x, int y, int x1) const
+    {
+        int end = std::min(x + 8, x1);
+        std::fill(&fb.color[(size_t)y * fb.stride + x], &fb.color[(size_t)y * fb.stride + end], clearColor);
+        std::fill(&fb.depth[(size_t)y * fb.stride + x], &fb.depth[(size_t)y * fb.stride + end], 1.0f);
+    }
+
+    // Same colors and alpha as the mesh
+    static uint32_t shade(const Frame &f, bool cap, bool top, float index)
+    {
+        float side[3];
+        const float *c = top ? prismTopColor : prismBottomColor;
+        if (!cap)
+        {
+            prismSideColor(f.sides, std::min((size_t)index, f.sides - 1), side);
+            c = side;
+        }
+        return packColor(c[0], c[1], c[2], 0.6f);
+    }
+
+    ThreadPool &pool;
+    uint32_t clearColor;
+    int tilesX;
+    std::atomic<size_t> hits;
+};
+#endif
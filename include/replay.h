@@ -0,0 +1,142 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Input recordings: a header with everything the simulation starts from, followed by one 8 byte record per frame holding
+// the frame's time step and the mask of keys held during it. Replaying the records through processInput() reproduces the
+// exact same sequence of frames on any build. All values are stored in the host's byte order.
+
+const char REPLAY_MAGIC[4] = {'P', 'R', 'I', 'N'};
+const uint32_t REPLAY_VERSION = 1;
+
+// State the simulation starts from
+struct InputState
+{
+    int32_t n;
+    float cameraPosition[3];
+    float cameraYaw;
+    float cameraPitch;
+    float cameraZoom;
+    float pos[3];
+    float angle;
+    uint8_t outOfPlace;
+    uint8_t modelSpin;
+    uint8_t camSpin;
+    uint8_t reserved;
+};
+
+struct InputFrame
+{
+    float deltaTime;
+    uint32_t keys;
+};
+
+class InputRecorder
+{
+public:
+    InputRecorder() : file(NULL) {}
+    ~InputRecorder()
+    {
+        close();
+    }
+
+    bool open(const std::string &path, const InputState &state)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+        return fwrite(REPLAY_MAGIC, sizeof(REPLAY_MAGIC), 1, file) == 1 &&
+               fwrite(&REPLAY_VERSION, sizeof(REPLAY_VERSION), 1, file) == 1 &&
+               fwrite(&state, sizeof(state), 1, file) == 1;
+    }
+
+    bool isOpen() const
+    {
+        return file != NULL;
+    }
+
+    void record(float deltaTime, uint32_t keys)
+    {
+        InputFrame frame = {deltaTime, keys};
+        fwrite(&frame, sizeof(frame), 1, file);
+    }
+
+    void close()
+    {
+        if (file)
+            fclose(file);
+        file = NULL;
+    }
+
+private:
+    InputRecorder(const InputRecorder &);
+    InputRecorder &operator=(const InputRecorder &);
+
+    FILE *file;
+};
+
+class InputReplay
+{
+public:
+    InputReplay() : file(NULL), fixedStep(0), frames(0) {}
+    ~InputReplay()
+    {
+        if (file)
+            fclose(file);
+    }
+
+    // opens a recording and reads its initial state. A positive fixedStep replaces the recorded time steps.
+    bool open(const std::string &path, float step, InputState &state)
+    {
+        file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        char magic[sizeof(REPLAY_MAGIC)];
+        uint32_t version = 0;
+        if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, REPLAY_MAGIC, sizeof(magic)) != 0 ||
+            fread(&version, sizeof(version), 1, file) != 1 || version != REPLAY_VERSION ||
+            fread(&state, sizeof(state), 1, file) != 1)
+        {
+            fclose(file);
+            file = NULL;
+            return false;
+        }
+        fixedStep = step;
+        return true;
+    }
+
+    bool isOpen() const
+    {
+        return file != NULL;
+    }
+
+    // fetches the next frame, returns false once the recording is exhausted
+    bool next(float &deltaTime, uint32_t &keys)
+    {
+        InputFrame frame;
+        if (fread(&frame, sizeof(frame), 1, file) != 1)
+            return false;
+        deltaTime = fixedStep > 0 ? fixedStep : frame.deltaTime;
+        keys = frame.keys;
+        frames++;
+        return true;
+    }
+
+    int framesPlayed() const
+    {
+        return frames;
+    }
+
+private:
+    InputReplay(const InputReplay &);
+    InputReplay &operator=(const InputReplay &);
+
+    FILE *file;
+    float fixedStep;
+    int frames;
+};
+#endif
@@ -0,0 +1,292 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Scripted benchmark runs. A scenario is a text file of timed segments, each of which may change the number of sides,
+// the instance count and the spin states and fly the camera along a Catmull-Rom spline. Scenario time advances by a
+// fixed step every frame, so a scenario renders exactly the same frames on every machine and build, and frame
+// statistics are reported for every segment.
+//
+//     # comments run to the end of the line
+//     step 0.0166667          optional time step in seconds, 1/60 by default
+//     n 6                     sides the scenario starts with
+//     segment <name> <seconds>
+//     n <sides>               the settings take effect when the segment starts and stay until changed
+//     instances <count>       prisms drawn on a grid around the model position
+//     drift <speed>           instances move in random directions at speed units per second, bouncing inside the grid
+//     spin model|camera on|off
+//     camera <t> <x> <y> <z> [<target x> <y> <z>]
+//                             control point of the segment's camera path at t seconds into it, looking at the target
+//                             (the origin when left out). The camera stays wherever it is in segments without any.
+
+// Control point of a camera path
+struct ScenarioKey
+{
+    float time;
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+struct ScenarioSegment
+{
+    std::string name;
+    float duration;
+    int n;         // 0 keeps the current one
+    int instances; // 0 keeps the current count
+    float drift;   // negative keeps the current speed
+    int modelSpin; // -1 keeps the current state, otherwise 0 or 1
+    int camSpin;
+    std::vector<ScenarioKey> keys; // ordered by time
+};
+
+// Uniform Catmull-Rom spline through p1 and p2, u in [0, 1]
+inline glm::vec3 catmullRom(const glm::vec3 &p0, const glm::vec3 &p1, const glm::vec3 &p2, const glm::vec3 &p3, float u)
+{
+    float u2 = u * u, u3 = u2 * u;
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * u + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * u2 +
+                   (3.0f * p1 - p0 - 3.0f * p2 + p3) * u3);
+}
+
+// Position and target along the keys at time t, the end points repeat to close the spline off
+inline void scenarioCamera(const std::vector<ScenarioKey> &keys, float t, glm::vec3 &position, glm::vec3 &target)
+{
+    size_t last = keys.size() - 1;
+    size_t i = 0;
+    while (i < last && keys[i + 1].time <= t)
+        i++;
+    if (i == last || t <= keys[0].time)
+    {
+        position = t <= keys[0].time ? keys[0].position : keys[last].position;
+        target = t <= keys[0].time ? keys[0].target : keys[last].target;
+        return;
+    }
+    const ScenarioKey &k0 = keys[i > 0 ? i - 1 : i], &k1 = keys[i], &k2 = keys[i + 1];
+    const ScenarioKey &k3 = keys[std::min(i + 2, last)];
+    float u = (t - k1.time) / (k2.time - k1.time);
+    position = catmullRom(k0.position, k1.position, k2.position, k3.position, u);
+    target = catmullRom(k0.target, k1.target, k2.target, k3.target, u);
+}
+
+class Scenario
+{
+public:
+    Scenario() : timeStep(1.0f / 60.0f), startN(0) {}
+
+    // Reads a scenario, printing the first error with its line number
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            printf("Failed to read scenario %s\n", path.c_str());
+            return false;
+        }
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++)
+        {
+            line = line.substr(0, line.find('#'));
+            std::istringstream in(line);
+            std::string command;
+            if (!(in >> command))
+                continue;
+            if (!parse(command, in))
+            {
+                printf("%s:%d: can't read '%s'\n", path.c_str(), number, line.c_str());
+                return false;
+            }
+        }
+        if (list.empty() || startN < 3)
+        {
+            printf("%s: needs n and at least one segment\n", path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    float step() const
+    {
+        return timeStep;
+    }
+
+    // Sides before the first segment changes them
+    int initialN() const
+    {
+        return startN;
+    }
+
+    // Largest instance count of any segment
+    int maxInstances() const
+    {
+        int most = 1;
+        for (size_t i = 0; i < list.size(); i++)
+            most = std::max(most, list[i].instances);
+        return most;
+    }
+
+    const std::vector<ScenarioSegment> &segments() const
+    {
+        return list;
+    }
+
+private:
+    bool parse(const std::string &command, std::istringstream &in)
+    {
+        if (command == "step")
+            return (in >> timeStep) && timeStep > 0;
+        if (command == "segment")
+        {
+            ScenarioSegment s;
+            s.n = s.instances = 0;
+            s.drift = -1;
+            s.modelSpin = s.camSpin = -1;
+            if (!(in >> s.name >> s.duration) || s.duration <= 0)
+                return false;
+            list.push_back(s);
+            return true;
+        }
+        if (command == "n" && list.empty())
+            return (in >> startN) && startN >= 3;
+        // The rest belongs to a segment
+        if (list.empty())
+            return false;
+        ScenarioSegment &s = list.back();
+        if (command == "n")
+            return (in >> s.n) && s.n >= 3;
+        if (command == "instances")
+            return (in >> s.instances) && s.instances >= 1;
+        if (command == "drift")
+            return (in >> s.drift) && s.drift >= 0;
+        if (command == "spin")
+        {
+            std::string what, state;
+            if (!(in >> what >> state) || (what != "model" && what != "camera") || (state != "on" && state != "off"))
+                return false;
+            (what == "model" ? s.modelSpin : s.camSpin) = state == "on";
+            return true;
+        }
+        if (command == "camera")
+        {
+            ScenarioKey key;
+            key.target = glm::vec3(0.0f);
+            if (!(in >> key.time >> key.position.x >> key.position.y >> key.position.z))
+                return false;
+            // The target is optional, but all of it when it is there
+            if (!(in >> std::ws).eof() && !(in >> key.target.x >> key.target.y >> key.target.z))
+                return false;
+            if (!s.keys.empty() && key.time <= s.keys.back().time)
+                return false;
+            s.keys.push_back(key);
+            return true;
+        }
+        return false;
+    }
+
+    float timeStep;
+    int startN;
+    std::vector<ScenarioSegment> list;
+};
+
+// What a frame of a running scenario sets up
+struct ScenarioFrame
+{
+    int n;
+    int instances;
+    float drift;
+    bool modelSpin;
+    bool camSpin;
+    bool moveCamera; // false leaves the camera to the spin or where it was
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+// Steps through a scenario one frame at a time and reports the frame times of every segment as it ends
+class ScenarioRunner
+{
+public:
+    explicit ScenarioRunner(const Scenario &scenario) : scenario(scenario), segment(0), frame(0), last(-1)
+    {
+        state.n = scenario.initialN();
+        state.instances = 1;
+        state.drift = 0;
+        state.modelSpin = state.camSpin = false;
+        state.moveCamera = false;
+        printf("%-16s %8s %10s %10s %10s %10s  %s\n", "segment", "frames", "mean ms", "p50 ms", "p99 ms", "max ms",
+               "n x instances");
+    }
+
+    // Call at the start of every frame with the wall clock in seconds. Returns false once every segment ran.
+    bool next(double now, ScenarioFrame &out)
+    {
+        // The time since the previous call is what the previous frame cost
+        if (last >= 0)
+            times.push_back((now - last) * 1000.0);
+        last = now;
+
+        const std::vector<ScenarioSegment> &list = scenario.segments();
+        // Frame counts rather than summed steps, so rounding never moves a segment boundary
+        while (segment < list.size() && frame >= frames(list[segment]))
+        {
+            report(list[segment]);
+            segment++;
+            frame = 0;
+        }
+        if (segment == list.size())
+            return false;
+
+        const ScenarioSegment &s = list[segment];
+        if (frame == 0)
+        {
+            state.n = s.n ? s.n : state.n;
+            state.instances = s.instances ? s.instances : state.instances;
+            state.drift = s.drift >= 0 ? s.drift : state.drift;
+            state.modelSpin = s.modelSpin >= 0 ? s.modelSpin == 1 : state.modelSpin;
+            state.camSpin = s.camSpin >= 0 ? s.camSpin == 1 : state.camSpin;
+        }
+        state.moveCamera = !s.keys.empty();
+        if (state.moveCamera)
+            scenarioCamera(s.keys, frame * scenario.step(), state.position, state.target);
+        frame++;
+        out = state;
+        return true;
+    }
+
+private:
+    ScenarioRunner(const ScenarioRunner &);
+    ScenarioRunner &operator=(const ScenarioRunner &);
+
+    size_t frames(const ScenarioSegment &s) const
+    {
+        return std::max<size_t>(1, (size_t)(s.duration / scenario.step() + 0.5f));
+    }
+
+    void report(const ScenarioSegment &s)
+    {
+        if (times.empty())
+            return;
+        std::vector<double> sorted(times);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0;
+        for (size_t i = 0; i < sorted.size(); i++)
+            sum += sorted[i];
+        printf("%-16s %8zu %10.3f %10.3f %10.3f %10.3f  %d x %d\n", s.name.c_str(), sorted.size(), sum / sorted.size(),
+               sorted[sorted.size() / 2], sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)], sorted.back(),
+               state.n, state.instances);
+        times.clear();
+    }
+
+    const Scenario &scenario;
+    size_t segment;
+    size_t frame;    // within the segment
+    double last;     // wall clock at the previous frame, negative before the first
+    ScenarioFrame state;
+    std::vector<double> times; // ms of every frame of the segment so far
+};
+#endif
@@ -0,0 +1,313 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "matrixbatch.h"
+#include "threadpool.h"
+
+// Prisms per chunk of the parallel loops, enough to amortize taking a chunk, small enough to balance 10^6 prisms
+const size_t SCENE_GRAIN = 4096;
+
+// One array of a Scene. It holds its values like a vector, or views count values that live elsewhere, such as a
+// mapped scene file (include/scenefile.h), which it uses in place until a resize copies them into its own storage.
+template <class T> class SceneArray
+{
+public:
+    SceneArray() : ptr(NULL), count(0) {}
+
+    SceneArray(const SceneArray &other) : owned(other.owned), ptr(other.ptr), count(other.count)
+    {
+        if (other.ptr == other.owned.data())
+            ptr = owned.data();
+    }
+
+    SceneArray &operator=(const SceneArray &other)
+    {
+        SceneArray copy(other);
+        owned.swap(copy.owned);
+        ptr = copy.ptr == copy.owned.data() ? owned.data() : copy.ptr;
+        count = copy.count;
+        return *this;
+    }
+
+    T &operator[](size_t i)
+    {
+        return ptr[i];
+    }
+
+    const T &operator[](size_t i) const
+    {
+        return ptr[i];
+    }
+
+    T *data()
+    {
+        return ptr;
+    }
+
+    const T *data() const
+    {
+        return ptr;
+    }
+
+    T *begin()
+    {
+        return ptr;
+    }
+
+    T *end()
+    {
+        return ptr + count;
+    }
+
+    const T *begin() const
+    {
+        return ptr;
+    }
+
+    const T *end() const
+    {
+        return ptr + count;
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    void resize(size_t n)
+    {
+        if (ptr != owned.data())
+            owned.assign(ptr, ptr + std::min(count, n));
+        owned.resize(n);
+        ptr = owned.data();
+        count = n;
+    }
+
+    // Views the n values at p instead of its own, which it lets go of
+    void attach(T *p, size_t n)
+    {
+        std::vector<T>().swap(owned);
+        ptr = p;
+        count = n;
+    }
+
+private:
+    std::vector<T> owned;
+    T *ptr; // owned.data() or the viewed values
+    size_t count;
+};
+
+// The arrays of a Scene by number, in the order scene files store them
+enum SceneField
+{
+    SCENE_X,
+    SCENE_Y,
+    SCENE_Z,
+    SCENE_AXIS_X,
+    SCENE_AXIS_Y,
+    SCENE_AXIS_Z,
+    SCENE_ANGLE,
+    SCENE_SPIN,
+    SCENE_VX,
+    SCENE_VY,
+    SCENE_VZ,
+    SCENE_SIDES,
+    SCENE_COLOR,
+    SCENE_FIELDS
+};
+
+// Consecutive prisms with the same number of sides, which one instanced draw of that mesh covers
+struct SceneRun
+{
+    int sides;
+    size_t begin;
+    size_t count;
+};
+
+// Many animated prisms stored as structure of arrays, so the per-frame update streams through just the fields it
+// needs and vectorizes. update() and writeMatrices() run as parallel-fors over chunks of prisms, the latter straight
+// into a mapped instance buffer. The single prism of the app is still the pos/angle globals of main.cpp, the scene
+// holds the instanced ones.
+class Scene
+{
+public:
+    // Per prism
+    SceneArray<float> x, y, z;             // position
+    SceneArray<float> axisX, axisY, axisZ; // unit rotation axis
+    SceneArray<float> angle;               // about the axis, radians within a turn of zero
+    SceneArray<float> spin;                // angular velocity, radians per second
+    SceneArray<float> vx, vy, vz;          // velocity, units per second
+    SceneArray<int32_t> sides;
+    SceneArray<uint32_t> color; // RGBA8, red in the lowest byte, multiplies the mesh colors
+
+    // Half size of the box around the origin prisms bounce off, 0 for none
+    float extent;
+
+    Scene() : extent(0) {}
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    void clear()
+    {
+        resize(0);
+    }
+
+    // Adds a resting prism and returns its index
+    size_t add(const glm::vec3 &position, const glm::vec3 &axis, float angle, float spin, int sides,
+               uint32_t color = 0xFFFFFFFFu)
+    {
+        size_t i = size();
+        resize(i + 1);
+        glm::vec3 a = glm::normalize(axis);
+        x[i] = position.x, y[i] = position.y, z[i] = position.z;
+        axisX[i] = a.x, axisY[i] = a.y, axisZ[i] = a.z;
+        this->angle[i] = std::fmod(angle, 6.2831853f);
+        this->spin[i] = spin;
+        vx[i] = vy[i] = vz[i] = 0;
+        this->sides[i] = sides;
+        this->color[i] = color;
+        return i;
+    }
+
+    // Replaces the scene with count prisms on a square grid in the z = 0 plane, spinning about x at 40 degrees per
+    // second with phases a degree apart. drift gives them random velocities of that speed within the grid's box.
+    void grid(size_t count, int n, float spacing, float drift = 0, uint32_t seed = 1)
+    {
+        resize(count);
+        size_t side = 1;
+        while (side * side < count)
+            side++;
+        float half = 0.5f * spacing * (side - 1);
+        extent = drift > 0 ? half + spacing : 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            x[i] = spacing * (i % side) - half;
+            y[i] = spacing * (i / side) - half;
+            z[i] = 0;
+            axisX[i] = 1, axisY[i] = 0, axisZ[i] = 0;
+            angle[i] = glm::radians((float)(i % 360));
+            spin[i] = glm::radians(40.0f);
+            // xorshift, the same scene on every platform
+            seed ^= seed << 13, seed ^= seed >> 17, seed ^= seed << 5;
+            float heading = (seed & 0xFFFF) * (6.2831853f / 65536.0f);
+            vx[i] = drift * std::cos(heading);
+            vy[i] = drift * std::sin(heading);
+            vz[i] = 0;
+            sides[i] = n;
+            color[i] = 0xFFFFFFFFu;
+        }
+    }
+
+    // Advances every prism by dt: spins it when spinning and moves it, bouncing off the box
+    void update(ThreadPool &pool, float dt, bool spinning)
+    {
+        const float turn = 6.2831853f;
+        pool.parallelFor(size(), SCENE_GRAIN, [&](size_t begin, size_t end) {
+            if (spinning)
+                for (size_t i = begin; i < end; i++)
+                {
+                    float a = angle[i] + spin[i] * dt;
+                    angle[i] = a >= turn ? a - turn : a < 0 ? a + turn : a;
+                }
+            moveAxis(x.data(), vx.data(), begin, end, dt, extent);
+            moveAxis(y.data(), vy.data(), begin, end, dt, extent);
+            moveAxis(z.data(), vz.data(), begin, end, dt, extent);
+        });
+    }
+
+    // The positions, axes and angles for include/matrixbatch.h
+    TransformArrays transforms() const
+    {
+        TransformArrays t = {x.data(), y.data(), z.data(), axisX.data(), axisY.data(), axisZ.data(), angle.data()};
+        return t;
+    }
+
+    // The prisms in runs of equal sides, one for a grid, as many as there are side counts for a file listing them
+    // grouped
+    std::vector<SceneRun> runs() const
+    {
+        std::vector<SceneRun> list;
+        for (size_t i = 0; i < size(); i++)
+            if (list.empty() || sides[i] != list.back().sides)
+            {
+                SceneRun run = {sides[i], i, 1};
+                list.push_back(run);
+            }
+            else
+                list.back().count++;
+        return list;
+    }
+
+    // The array of a SceneField, 4 bytes a prism
+    const void *field(int f) const
+    {
+        const void *fields[SCENE_FIELDS] = {x.data(),     y.data(),     z.data(),    axisX.data(), axisY.data(),
+                                            axisZ.data(), angle.data(), spin.data(), vx.data(),    vy.data(),
+                                            vz.data(),    sides.data(), color.data()};
+        return fields[f];
+    }
+
+    // Makes this a scene of count prisms whose arrays are the values at fields[f] for each SceneField, used in place
+    // and kept alive through storage. Adding prisms copies them out first.
+    void attach(size_t count, float extent, void *const fields[SCENE_FIELDS], const std::shared_ptr<void> &storage)
+    {
+        SceneArray<float> *floats[] = {&x, &y, &z, &axisX, &axisY, &axisZ, &angle, &spin, &vx, &vy, &vz};
+        for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++)
+            floats[i]->attach((float *)fields[i], count);
+        sides.attach((int32_t *)fields[SCENE_SIDES], count);
+        color.attach((uint32_t *)fields[SCENE_COLOR], count);
+        this->extent = extent;
+        backing = storage;
+    }
+
+    // Writes translate(origin + position) * rotate(angle, axis) of every prism in the layout, prism i at
+    // out + i * matrixFloats(layout), with the batched builder
+    void writeMatrices(ThreadPool &pool, const glm::vec3 &origin, float *out, MatrixLayout layout = MATRIX_4X4) const
+    {
+        TransformArrays t = transforms();
+        pool.parallelFor(size(), SCENE_GRAIN, [&](size_t begin, size_t end) {
+            buildMatrices(t, origin, begin, end, layout, out);
+        });
+    }
+
+private:
+    std::shared_ptr<void> backing; // the file the arrays view, if they do
+
+    void resize(size_t count)
+    {
+        SceneArray<float> *floats[] = {&x, &y, &z, &axisX, &axisY, &axisZ, &angle, &spin, &vx, &vy, &vz};
+        for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); i++)
+            floats[i]->resize(count);
+        sides.resize(count);
+        color.resize(count);
+        backing.reset();
+    }
+
+    static void moveAxis(float *p, float *v, size_t begin, size_t end, float dt, float extent)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            float moved = p[i] + v[i] * dt;
+            // Reflect off the walls, the velocity turns around with it
+            if (extent > 0 && (moved > extent || moved < -extent))
+            {
+                float wall = moved > extent ? extent : -extent;
+                moved = 2.0f * wall - moved;
+                v[i] = -v[i];
+            }
+            p[i] = moved;
+        }
+    }
+};
+#endif
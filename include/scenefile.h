@@ -0,0 +1,282 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "meshexport.h"
+#include "scene.h"
+
+// Scene files. The text format is for writing scenes by hand or from scripts:
+//
+//     # comments run to the end of the line
+//     extent <half size>      box around the origin the prisms bounce off, none when left out
+//     prism <x> <y> <z> <sides> [<axis x> <y> <z> [<angle> [<spin> [<velocity x> <y> <z> [<color>]]]]]
+//                             3 to SCENE_MAX_SIDES sides, axis (1, 0, 0) by default, angle in degrees, spin in
+//                             degrees per second, color as hexadecimal RRGGBBAA, white by default
+//
+// Parsing it takes a few microseconds a prism, so --convert-scene turns it into the binary format, which is the
+// Scene's arrays as they are in memory: a header, then each SceneField's array of count 4 byte values at a page aligned
+// offset. Loading maps the file and points the scene's arrays into the mapping. Only the sides are read then, to check
+// them, nothing is copied and the rest waits for the first frame to touch it. The mapping is private, so the frames'
+// updates of the positions and angles copy the pages they write and never reach the file.
+const char SCENE_FILE_MAGIC[8] = {'P', 'R', 'I', 'S', 'M', 'S', 'C', 'N'};
+const uint32_t SCENE_FILE_VERSION = 1;
+const uint32_t SCENE_FILE_BYTE_ORDER = 0x01020304; // reads back differently on a machine of the other endianness
+const uint64_t SCENE_FILE_ALIGNMENT = 4096;
+const int32_t SCENE_MAX_SIDES = 1 << 16; // a mesh of 19 MB, the vertex arena is sized for the largest one
+
+struct SceneFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t count; // prisms
+    float extent;
+    uint32_t fields; // SCENE_FIELDS
+    uint64_t fileBytes;
+    uint64_t offsets[SCENE_FIELDS]; // of the arrays from the start of the file, multiples of SCENE_FILE_ALIGNMENT
+};
+static_assert(sizeof(SceneFileHeader) == 40 + 8 * SCENE_FIELDS, "the header is written as it is in memory");
+
+// Where the arrays of count prisms go, and the size of the file
+inline SceneFileHeader sceneFileHeader(size_t count, float extent)
+{
+    SceneFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SCENE_FILE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_FILE_VERSION;
+    header.byteOrder = SCENE_FILE_BYTE_ORDER;
+    header.count = count;
+    header.extent = extent;
+    header.fields = SCENE_FIELDS;
+    uint64_t arrayBytes = (count * 4 + SCENE_FILE_ALIGNMENT - 1) / SCENE_FILE_ALIGNMENT * SCENE_FILE_ALIGNMENT;
+    for (int f = 0; f < SCENE_FIELDS; f++)
+        header.offsets[f] = SCENE_FILE_ALIGNMENT + f * arrayBytes;
+    header.fileBytes = SCENE_FILE_ALIGNMENT + SCENE_FIELDS * arrayBytes;
+    return header;
+}
+
+inline bool writeSceneFile(const Scene &scene, const std::string &path)
+{
+    SceneFileHeader header = sceneFileHeader(scene.size(), scene.extent);
+    BlockWriter out;
+    if (!out.open(path))
+    {
+        printf("Failed to write %s\n", path.c_str());
+        return false;
+    }
+    // Padding up to the next array, never as much as a page
+    std::vector<unsigned char> zeros(SCENE_FILE_ALIGNMENT);
+    out.write(&header, sizeof(header));
+    uint64_t at = sizeof(header);
+    for (int f = 0; f < SCENE_FIELDS; f++)
+    {
+        out.write(&zeros[0], header.offsets[f] - at);
+        out.write(scene.field(f), scene.size() * 4);
+        at = header.offsets[f] + scene.size() * 4;
+    }
+    out.write(&zeros[0], header.fileBytes - at);
+    if (!out.close())
+    {
+        printf("Failed to write %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+// The header of a file of bytes, NULL with the reason printed when it isn't a scene file this build reads
+inline const SceneFileHeader *checkSceneFile(const unsigned char *data, uint64_t bytes, const std::string &path)
+{
+    const SceneFileHeader *header = (const SceneFileHeader *)data;
+    const char *problem = NULL;
+    if (bytes < sizeof(SceneFileHeader) || memcmp(header->magic, SCENE_FILE_MAGIC, sizeof(header->magic)) != 0)
+        problem = "not a scene file";
+    else if (header->byteOrder != SCENE_FILE_BYTE_ORDER)
+        problem = "written on a machine of the other byte order";
+    else if (header->version != SCENE_FILE_VERSION || header->fields != SCENE_FIELDS)
+        problem = "written by a different version";
+    else if (header->fileBytes > bytes)
+        problem = "truncated";
+    else if (header->count > bytes / 4)
+        problem = "damaged";
+    for (int f = 0; f < SCENE_FIELDS && !problem; f++)
+        if (header->offsets[f] % SCENE_FILE_ALIGNMENT || header->offsets[f] > bytes - header->count * 4)
+            problem = "damaged";
+    if (problem)
+    {
+        printf("Can't load %s: %s\n", path.c_str(), problem);
+        return NULL;
+    }
+    return header;
+}
+
+// The bytes of a scene file, mapped copy on write where there is mmap and read otherwise
+class MappedSceneFile
+{
+public:
+    MappedSceneFile() : data(NULL), bytes(0) {}
+    ~MappedSceneFile()
+    {
+#ifndef _WIN32
+        if (data)
+            munmap(data, bytes);
+#endif
+    }
+
+    bool open(const std::string &path)
+    {
+#ifdef _WIN32
+        std::ifstream file(path.c_str(), std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        bytes = (uint64_t)file.tellg();
+        // 8 byte elements keep the arrays as aligned as they are in a mapping
+        copy.resize(bytes / 8 + 1);
+        data = (unsigned char *)&copy[0];
+        file.seekg(0);
+        return (bool)file.read((char *)data, bytes);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        bytes = info.st_size;
+        void *mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = (unsigned char *)mapped;
+        // Start reading it in behind the caller's back, the first frame touches all of it
+        madvise(data, bytes, MADV_WILLNEED);
+        return true;
+#endif
+    }
+
+    unsigned char *data;
+    uint64_t bytes;
+
+private:
+#ifdef _WIN32
+    std::vector<uint64_t> copy;
+#endif
+    MappedSceneFile(const MappedSceneFile &);
+    MappedSceneFile &operator=(const MappedSceneFile &);
+};
+
+// Replaces the scene with a binary scene file's, whose arrays it then uses in place
+inline bool mapSceneFile(const std::string &path, Scene &scene)
+{
+    std::shared_ptr<MappedSceneFile> file(new MappedSceneFile);
+    if (!file->open(path))
+    {
+        printf("Failed to read scene %s\n", path.c_str());
+        return false;
+    }
+    const SceneFileHeader *header = checkSceneFile(file->data, file->bytes, path);
+    if (!header)
+        return false;
+    void *fields[SCENE_FIELDS];
+    for (int f = 0; f < SCENE_FIELDS; f++)
+        fields[f] = file->data + header->offsets[f];
+    // The one array read before the first frame, every prism needs a mesh that can be drawn
+    const int32_t *sides = (const int32_t *)fields[SCENE_SIDES];
+    for (uint64_t i = 0; i < header->count; i++)
+        if (sides[i] < 3 || sides[i] > SCENE_MAX_SIDES)
+        {
+            printf("Can't load %s: prism %llu has %d sides, not 3 to %d\n", path.c_str(), (unsigned long long)i,
+                   sides[i], SCENE_MAX_SIDES);
+            return false;
+        }
+    scene.attach(header->count, header->extent, fields, file);
+    return true;
+}
+
+// Replaces the scene with a text scene file's, printing the first error with its line number
+inline bool readSceneText(const std::string &path, Scene &scene)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        printf("Failed to read scene %s\n", path.c_str());
+        return false;
+    }
+    scene.clear();
+    scene.extent = 0;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream in(line);
+        std::string command;
+        if (!(in >> command))
+            continue;
+        // Whether anything but spaces is left on the line
+        auto more = [&]() { return !(in >> std::ws).eof(); };
+        bool ok = false;
+        if (command == "extent")
+            ok = in >> scene.extent && scene.extent >= 0;
+        else if (command == "prism")
+        {
+            glm::vec3 position, axis(1, 0, 0), velocity(0);
+            float angle = 0, spin = 0;
+            int sides;
+            uint32_t rgba = 0xFFFFFFFFu;
+            ok = in >> position.x >> position.y >> position.z >> sides && sides >= 3 && sides <= SCENE_MAX_SIDES;
+            if (ok && more())
+                ok = in >> axis.x >> axis.y >> axis.z && glm::dot(axis, axis) > 0;
+            if (ok && more())
+                ok = (bool)(in >> angle);
+            if (ok && more())
+                ok = (bool)(in >> spin);
+            if (ok && more())
+                ok = (bool)(in >> velocity.x >> velocity.y >> velocity.z);
+            if (ok && more())
+                ok = (bool)(in >> std::hex >> rgba);
+            if (ok)
+            {
+                size_t i = scene.add(position, axis, glm::radians(angle), glm::radians(spin), sides,
+                                     rgba >> 24 | (rgba >> 8 & 0xFF00u) | (rgba << 8 & 0xFF0000u) | rgba << 24);
+                scene.vx[i] = velocity.x, scene.vy[i] = velocity.y, scene.vz[i] = velocity.z;
+            }
+        }
+        if (!ok || more())
+        {
+            printf("%s:%d: can't read '%s'\n", path.c_str(), number, line.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Maps a binary scene file or reads a text one, whichever path is
+inline bool loadScene(const std::string &path, Scene &scene)
+{
+    char magic[sizeof(SCENE_FILE_MAGIC)] = {0};
+    std::ifstream file(path.c_str(), std::ios::binary);
+    file.read(magic, sizeof(magic));
+    if (memcmp(magic, SCENE_FILE_MAGIC, sizeof(magic)) == 0)
+        return mapSceneFile(path, scene);
+    return readSceneText(path, scene);
+}
+#endif
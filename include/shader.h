@@ -4,18 +4,21 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include "programcache.h"
+
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, or loads it from cache when given one
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath)
+    Shader(const char* vertexPath, const char* fragmentPath, ProgramCache* cache = NULL)
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -45,30 +48,18 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessery
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-
+        build(vertexCode, fragmentCode, cache);
+    }
+    // wraps a program that was built elsewhere, 0 for none
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int program) : ID(program) {}
+    // builds the shader from sources already in memory, e.g. the ones embedded at build time
+    // ------------------------------------------------------------------------
+    static Shader fromSource(const std::string& vertexCode, const std::string& fragmentCode, ProgramCache* cache = NULL)
+    {
+        Shader shader(0);
+        shader.build(vertexCode, fragmentCode, cache);
+        return shader;
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -136,9 +127,51 @@ public:
     }
 
 private:
-    // utility function for checking shader compilation/linking errors.
+    // compiles and links the sources, or loads the program from cache when given one
+    // ------------------------------------------------------------------------
+    void build(const std::string& vertexCode, const std::string& fragmentCode, ProgramCache* cache)
+    {
+        // 1. reuse the binary linked by an earlier run when the driver still accepts it
+        uint64_t key = 0;
+        if (cache)
+        {
+            key = cache->key(vertexCode, fragmentCode);
+            ID = cache->load(key);
+            if (ID)
+                return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        const char* vShaderCode = vertexCode.c_str();
+        const char * fShaderCode = fragmentCode.c_str();
+        // 2. compile shaders
+        unsigned int vertex, fragment;
+        // vertex shader
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vShaderCode, NULL);
+        glCompileShader(vertex);
+        checkCompileErrors(vertex, "VERTEX");
+        // fragment Shader
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fShaderCode, NULL);
+        glCompileShader(fragment);
+        checkCompileErrors(fragment, "FRAGMENT");
+        // shader Program
+        ID = glCreateProgram();
+        if (cache)
+            cache->prepare(ID);
+        glAttachShader(ID, vertex);
+        glAttachShader(ID, fragment);
+        glLinkProgram(ID);
+        if (checkCompileErrors(ID, "PROGRAM") && cache)
+            cache->store(key, ID, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        // delete the shaders as they're linked into our program now and no longer necessery
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+    }
+
+    // utility function for checking shader compilation/linking errors, returns true on success.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -160,6 +193,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
     }
 };
 #endif
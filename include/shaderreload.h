@@ -0,0 +1,222 @@
+#ifndef SHADERRELOAD_H
+#define SHADERRELOAD_H
+
+#include <glad/glad.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "shadervariants.h"
+#include "trace.h"
+
+// Watches the source files of a set of shader variants and swaps in new programs when they change, without restarting
+// the app.
+//
+// A thread blocks on inotify for writes to the files' directories (editors often save by renaming a new file over the
+// old one, so the files themselves can't be watched) and reads the new sources. update(), called once per frame on the
+// GL thread, submits them to every variant built so far and later swaps them all in once they linked. With
+// KHR_parallel_shader_compile the driver compiles on its own threads and update() only polls for completion, otherwise
+// the status check waits for the compile. A failed compile or link prints the log and keeps the old programs.
+class ShaderReloader
+{
+public:
+    ShaderReloader(ShaderVariants &variants, const std::string &vertexPath, const std::string &fragmentPath)
+        : variants(variants), vertexPath(vertexPath), fragmentPath(fragmentPath), pending(false), reloading(false),
+          stop(false)
+    {
+#ifdef __linux__
+        notify = inotify_init1(IN_CLOEXEC);
+        wake[0] = wake[1] = -1;
+        if (notify < 0 || pipe(wake) != 0)
+        {
+            printf("Shader hot reload unavailable: inotify failed\n");
+            return;
+        }
+        watchDirectory(vertexPath);
+        if (directory(fragmentPath) != directory(vertexPath))
+            watchDirectory(fragmentPath);
+        watcher = std::thread(&ShaderReloader::watch, this);
+#else
+        printf("Shader hot reload needs inotify, it is only available on Linux\n");
+#endif
+    }
+
+    ~ShaderReloader()
+    {
+#ifdef __linux__
+        if (watcher.joinable())
+        {
+            stop = true;
+            char c = 0;
+            if (write(wake[1], &c, 1) < 0)
+                perror("write");
+            watcher.join();
+        }
+        if (notify >= 0)
+            close(notify);
+        for (int i = 0; i < 2; i++)
+            if (wake[i] >= 0)
+                close(wake[i]);
+#endif
+    }
+
+    // Call at a frame boundary with the context current. Never waits when the driver compiles in parallel.
+    void update()
+    {
+        if (reloading)
+        {
+            ShaderVariants::ReloadStatus status = variants.pollReload();
+            if (status == ShaderVariants::RELOAD_PENDING)
+                return;
+            TRACE_SCOPE("shader swap");
+            Clock::time_point now = Clock::now();
+            if (status == ShaderVariants::RELOAD_DONE)
+                printf("Shaders reloaded: compile and link %.1f ms, %.1f ms after the edit\n",
+                       std::chrono::duration<double, std::milli>(now - submitted).count(),
+                       std::chrono::duration<double, std::milli>(now - submittedChange).count());
+            else
+                printf("Shader reload failed, keeping the previous programs\n");
+            reloading = false;
+        }
+        if (pending)
+            submit();
+    }
+
+private:
+    ShaderReloader(const ShaderReloader &);
+    ShaderReloader &operator=(const ShaderReloader &);
+
+    typedef std::chrono::steady_clock Clock;
+
+    static std::string directory(const std::string &path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? "." : path.substr(0, slash);
+    }
+
+    static std::string fileName(const std::string &path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    static bool readFile(const std::string &path, std::string &out)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+            return false;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        out = stream.str();
+        return true;
+    }
+
+#ifdef __linux__
+    void watchDirectory(const std::string &path)
+    {
+        if (inotify_add_watch(notify, directory(path).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+            printf("Failed to watch %s for shader changes\n", directory(path).c_str());
+    }
+
+    // Watcher thread: waits for events on either file and hands the new sources to the GL thread
+    void watch()
+    {
+        Tracer::get().nameThread("shader watcher");
+        alignas(struct inotify_event) char buffer[4096];
+        pollfd fds[2] = {{notify, POLLIN, 0}, {wake[0], POLLIN, 0}};
+        const std::string vertexName = fileName(vertexPath), fragmentName = fileName(fragmentPath);
+        while (!stop)
+        {
+            // Saving often produces a burst of events, wait until it has been quiet for a moment before reading
+            bool changed = false;
+            int timeout = -1;
+            while (!stop && poll(fds, 2, timeout) > 0 && !(fds[1].revents & POLLIN))
+            {
+                ssize_t len = read(notify, buffer, sizeof(buffer));
+                for (ssize_t i = 0; i < len;)
+                {
+                    const inotify_event *event = (const inotify_event *)(buffer + i);
+                    if (event->len && (vertexName == event->name || fragmentName == event->name))
+                    {
+                        if (!changed)
+                            detected = Clock::now();
+                        changed = true;
+                    }
+                    i += sizeof(inotify_event) + event->len;
+                }
+                if (changed)
+                    timeout = 50;
+            }
+            if (!changed || stop)
+                continue;
+
+            std::string vertex, fragment;
+            if (!readFile(vertexPath, vertex) || !readFile(fragmentPath, fragment))
+            {
+                printf("Failed to read %s or %s, keeping the current shaders\n", vertexPath.c_str(), fragmentPath.c_str());
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            vertexSource = vertex;
+            fragmentSource = fragment;
+            changedAt = detected;
+            pending = true;
+        }
+    }
+#endif
+
+    // Starts rebuilding every variant from the latest sources, the status is only queried once they are done
+    void submit()
+    {
+        TRACE_SCOPE("shader submit");
+        std::string vertex, fragment;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            vertex.swap(vertexSource);
+            fragment.swap(fragmentSource);
+            submittedChange = changedAt;
+            pending = false;
+        }
+        submitted = Clock::now();
+        variants.reload(vertex, fragment);
+        reloading = true;
+    }
+
+    ShaderVariants &variants;
+    std::string vertexPath;
+    std::string fragmentPath;
+
+    // handed from the watcher to the GL thread
+    std::mutex mutex;
+    std::string vertexSource;
+    std::string fragmentSource;
+    Clock::time_point changedAt;
+    std::atomic<bool> pending;
+
+    // reload in flight, GL thread only
+    bool reloading;
+    Clock::time_point submitted;
+    Clock::time_point submittedChange;
+
+    // watcher thread
+    std::thread watcher;
+    std::atomic<bool> stop;
+    Clock::time_point detected;
+#ifdef __linux__
+    int notify;
+    int wake[2];
+#endif
+};
+#endif
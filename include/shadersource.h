@@ -0,0 +1,40 @@
+#ifndef SHADERSOURCE_H
+#define SHADERSOURCE_H
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "embedded_shaders.h"
+
+// Absolute path of src/, set by CMake. Only used to find the files to watch for hot reloading.
+#ifndef SHADER_SOURCE_DIR
+#define SHADER_SOURCE_DIR "../src"
+#endif
+
+// Returns the source of src/<name>. The copies embedded at build time are used unless overrideDir is given, which
+// reads <overrideDir>/<name> instead so shaders can be edited without rebuilding. A file that can't be read falls
+// back to the embedded copy.
+inline std::string shaderSource(const char *name, const std::string &overrideDir = "")
+{
+    if (!overrideDir.empty())
+    {
+        std::ifstream file((overrideDir + "/" + name).c_str());
+        if (file)
+        {
+            std::stringstream stream;
+            stream << file.rdbuf();
+            return stream.str();
+        }
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << overrideDir << "/" << name
+                  << ", using the embedded copy" << std::endl;
+    }
+    for (size_t i = 0; i < sizeof(embeddedShaders) / sizeof(embeddedShaders[0]); i++)
+        if (strcmp(embeddedShaders[i].name, name) == 0)
+            return embeddedShaders[i].source;
+    std::cout << "ERROR::SHADER::NOT_EMBEDDED " << name << std::endl;
+    return "";
+}
+#endif
@@ -0,0 +1,327 @@
+#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "glextras.h"
+#include "programcache.h"
+#include "shader.h"
+#include "trace.h"
+
+// Features a shader can be built with, each one a #define its source tests
+enum ShaderFeature {
+    SHADER_INSTANCED = 1 << 0,      // per-instance 4x3 model matrix rows at attributes 2 to 4
+    SHADER_COMPUTED_COLOR = 1 << 1, // color derived from gl_VertexID, the color attribute is ignored
+    SHADER_PACKED = 1 << 2,         // color attribute in the packed RGBA8 layout
+    SHADER_OIT = 1 << 3,            // weighted blended transparency outputs, see oit.h
+    SHADER_MULTIVIEW = 1 << 4,      // one view-projection per instance, drawn into its tile, see multiview.h
+    SHADER_VIEWPORT_INDEX = 1 << 5  // with SHADER_MULTIVIEW, route instances by gl_ViewportIndex instead of clipping
+};
+const char *const shaderFeatureNames[] = {"INSTANCED", "COMPUTED_COLOR", "PACKED", "OIT", "MULTIVIEW", "VIEWPORT_INDEX"};
+const int SHADER_FEATURE_COUNT = sizeof(shaderFeatureNames) / sizeof(shaderFeatureNames[0]);
+
+// The #define lines of a feature mask
+inline std::string shaderDefines(unsigned features)
+{
+    std::string defines;
+    for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+        if (features & (1u << i))
+            defines += std::string("#define ") + shaderFeatureNames[i] + "\n";
+    return defines;
+}
+
+// Inserts the defines right after the #version line, which must stay first
+inline std::string shaderWithDefines(const std::string &source, const std::string &defines)
+{
+    if (defines.empty())
+        return source;
+    size_t version = source.find("#version");
+    size_t line = version == std::string::npos ? std::string::npos : source.find('\n', version);
+    if (line == std::string::npos)
+        return version == std::string::npos ? defines + source : source + "\n" + defines;
+    return source.substr(0, line + 1) + defines + source.substr(line + 1);
+}
+
+// A program whose compile and link were issued without querying any status, so a driver with
+// KHR_parallel_shader_compile works on it in the background until done() or finish().
+struct PendingProgram
+{
+    GLuint program;
+    GLuint vertex;
+    GLuint fragment;
+
+    PendingProgram() : program(0), vertex(0), fragment(0) {}
+
+    void submit(const std::string &vertexCode, const std::string &fragmentCode, ProgramCache *cache)
+    {
+        const char *vCode = vertexCode.c_str(), *fCode = fragmentCode.c_str();
+        vertex = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertex, 1, &vCode, NULL);
+        glCompileShader(vertex);
+        fragment = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragment, 1, &fCode, NULL);
+        glCompileShader(fragment);
+        program = glCreateProgram();
+        if (cache)
+            cache->prepare(program);
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glLinkProgram(program);
+    }
+
+    // Never waits. Without the extension there is no way to tell, so the work is always reported done.
+    bool done() const
+    {
+        if (!glExtras().parallelShaderCompile)
+            return true;
+        GLint complete = GL_FALSE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &complete);
+        return complete == GL_TRUE;
+    }
+
+    // Returns the linked program, or 0 after printing the logs of whatever failed. Waits if it isn't done.
+    GLuint finish(const char *name)
+    {
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked)
+        {
+            printLog(vertex, "VERTEX", name);
+            printLog(fragment, "FRAGMENT", name);
+            GLchar log[1024];
+            glGetProgramInfoLog(program, sizeof(log), NULL, log);
+            printf("ERROR::PROGRAM_LINKING_ERROR of %s\n%s\n", name, log);
+            glDeleteProgram(program);
+        }
+        GLuint result = linked ? program : 0;
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        program = vertex = fragment = 0;
+        return result;
+    }
+
+    // Drops the program without looking at how it built
+    void cancel()
+    {
+        glDeleteProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        program = vertex = fragment = 0;
+    }
+
+private:
+    static void printLog(GLuint shader, const char *type, const char *name)
+    {
+        GLint compiled = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+        if (compiled)
+            return;
+        GLchar log[1024];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        printf("ERROR::SHADER_COMPILATION_ERROR of type %s in %s\n%s\n", type, name, log);
+    }
+};
+
+// Every feature combination of one vertex/fragment source pair, built on demand and kept by feature mask.
+//
+// request() issues the compile and returns, so requesting all the variants needed up front and then calling
+// finishAll() overlaps their compiles on drivers with KHR_parallel_shader_compile. get() returns a built variant,
+// building a variant nobody requested on the spot, so variants that are never used are never compiled. The Shader
+// references it returns stay valid, reloading swaps the programs inside them.
+class ShaderVariants
+{
+public:
+    enum ReloadStatus {
+        RELOAD_IDLE,    // no reload in flight
+        RELOAD_PENDING, // still compiling
+        RELOAD_DONE,    // every variant was rebuilt and swapped in
+        RELOAD_FAILED   // something didn't build, the logs were printed and the previous programs kept
+    };
+
+    ShaderVariants(const std::string &vertexSource, const std::string &fragmentSource, ProgramCache *cache = NULL)
+        : vertexSource(vertexSource), fragmentSource(fragmentSource), cache(cache)
+    {
+        if (glExtras().parallelShaderCompile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    }
+
+    // Starts building a variant unless it was already requested. Cached binaries load right away.
+    void request(unsigned features)
+    {
+        if (variants.count(features))
+            return;
+        TRACE_SCOPE("shader request");
+        Variant &v = variants.insert(std::make_pair(features, Variant())).first->second;
+        std::string defines = shaderDefines(features);
+        if (cache)
+        {
+            v.key = cache->key(vertexSource, fragmentSource, defines);
+            v.shader.ID = cache->load(v.key);
+            if (v.shader.ID)
+                return;
+        }
+        v.submitted = Clock::now();
+        v.pending.submit(shaderWithDefines(vertexSource, defines), shaderWithDefines(fragmentSource, defines), cache);
+    }
+
+    // The built variant, requested and waited for now if it has to be. A variant that failed to build has ID 0.
+    Shader &get(unsigned features)
+    {
+        request(features);
+        Variant &v = variants.find(features)->second;
+        if (v.pending.program)
+            finish(features, v);
+        return v.shader;
+    }
+
+    // true once get() would return without waiting
+    bool ready(unsigned features) const
+    {
+        std::map<unsigned, Variant>::const_iterator it = variants.find(features);
+        return it != variants.end() && (!it->second.pending.program || it->second.pending.done());
+    }
+
+    // Waits for every requested variant, taking them in whichever order the driver completes them
+    void finishAll()
+    {
+        TRACE_SCOPE("shader variants");
+        Clock::time_point start = Clock::now();
+        int built = 0;
+        for (bool waiting = true; waiting;)
+        {
+            waiting = false;
+            for (std::map<unsigned, Variant>::iterator it = variants.begin(); it != variants.end(); ++it)
+            {
+                if (!it->second.pending.program)
+                    continue;
+                if (it->second.pending.done())
+                {
+                    start = std::min(start, it->second.submitted);
+                    finish(it->first, it->second);
+                    built++;
+                }
+                else
+                    waiting = true;
+            }
+            if (waiting)
+                std::this_thread::yield();
+        }
+        if (built)
+            printf("Built %d shader variant%s in %.1f ms\n", built, built > 1 ? "s" : "",
+                   std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+
+    // Rebuilds every variant built so far from new sources, in the background. pollReload() swaps them in together
+    // once all of them linked, so the frame never mixes old and new variants. Later variants use the new sources.
+    void reload(const std::string &vertex, const std::string &fragment)
+    {
+        cancelReload();
+        reloadVertex = vertex;
+        reloadFragment = fragment;
+        for (std::map<unsigned, Variant>::iterator it = variants.begin(); it != variants.end(); ++it)
+        {
+            if (it->second.pending.program || !it->second.shader.ID)
+                continue;
+            std::string defines = shaderDefines(it->first);
+            reloads[it->first].submit(shaderWithDefines(vertex, defines), shaderWithDefines(fragment, defines), NULL);
+        }
+    }
+
+    // Call at a frame boundary, never waits when the driver compiles in parallel
+    ReloadStatus pollReload()
+    {
+        if (reloads.empty())
+            return RELOAD_IDLE;
+        for (std::map<unsigned, PendingProgram>::iterator it = reloads.begin(); it != reloads.end(); ++it)
+            if (!it->second.done())
+                return RELOAD_PENDING;
+
+        std::map<unsigned, GLuint> programs;
+        bool linked = true;
+        for (std::map<unsigned, PendingProgram>::iterator it = reloads.begin(); it != reloads.end(); ++it)
+        {
+            programs[it->first] = it->second.finish(variantName(it->first).c_str());
+            linked = linked && programs[it->first];
+        }
+        reloads.clear();
+        for (std::map<unsigned, GLuint>::iterator it = programs.begin(); it != programs.end(); ++it)
+        {
+            if (!linked)
+            {
+                glDeleteProgram(it->second);
+                continue;
+            }
+            Variant &v = variants[it->first];
+            glDeleteProgram(v.shader.ID);
+            v.shader.ID = it->second;
+        }
+        if (!linked)
+            return RELOAD_FAILED;
+        vertexSource.swap(reloadVertex);
+        fragmentSource.swap(reloadFragment);
+        return RELOAD_DONE;
+    }
+
+    // Number of variants requested so far
+    size_t count() const
+    {
+        return variants.size();
+    }
+
+private:
+    ShaderVariants(const ShaderVariants &);
+    ShaderVariants &operator=(const ShaderVariants &);
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Variant
+    {
+        Shader shader;
+        PendingProgram pending;
+        uint64_t key;
+        Clock::time_point submitted;
+
+        Variant() : shader(0), key(0) {}
+    };
+
+    static std::string variantName(unsigned features)
+    {
+        std::string name = "shader variant";
+        for (int i = 0; i < SHADER_FEATURE_COUNT; i++)
+            if (features & (1u << i))
+                name += std::string(" ") + shaderFeatureNames[i];
+        return features ? name : name + " (no features)";
+    }
+
+    void finish(unsigned features, Variant &v)
+    {
+        v.shader.ID = v.pending.finish(variantName(features).c_str());
+        if (cache && v.shader.ID)
+            cache->store(v.key, v.shader.ID, std::chrono::duration<double, std::milli>(Clock::now() - v.submitted).count());
+    }
+
+    void cancelReload()
+    {
+        for (std::map<unsigned, PendingProgram>::iterator it = reloads.begin(); it != reloads.end(); ++it)
+            it->second.cancel();
+        reloads.clear();
+    }
+
+    std::string vertexSource;
+    std::string fragmentSource;
+    ProgramCache *cache;
+    std::map<unsigned, Variant> variants;
+
+    // reload in flight
+    std::map<unsigned, PendingProgram> reloads;
+    std::string reloadVertex;
+    std::string reloadFragment;
+};
+#endif
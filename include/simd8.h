@@ -0,0 +1,204 @@
+#ifndef SIMD8_H
+#define SIMD8_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD8_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD8_SSE 1
+#endif
+
+// Eight floats processed together: one AVX register when the build targets AVX, two SSE2 registers on any other x86-64
+// build and a plain array elsewhere. Comparisons return lane masks with every bit set or cleared, for select() and any().
+struct float8
+{
+#if defined(SIMD8_AVX)
+    __m256 v;
+    float8() {}
+    float8(__m256 v) : v(v) {}
+    float8(float f) : v(_mm256_set1_ps(f)) {}
+    static float8 load(const float *p) { return _mm256_loadu_ps(p); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+#elif defined(SIMD8_SSE)
+    __m128 lo, hi;
+    float8() {}
+    float8(__m128 lo, __m128 hi) : lo(lo), hi(hi) {}
+    float8(float f) : lo(_mm_set1_ps(f)), hi(_mm_set1_ps(f)) {}
+    static float8 load(const float *p) { return float8(_mm_loadu_ps(p), _mm_loadu_ps(p + 4)); }
+    void store(float *p) const { _mm_storeu_ps(p, lo); _mm_storeu_ps(p + 4, hi); }
+#else
+    float f[8];
+    float8() {}
+    float8(float x) { for (int i = 0; i < 8; i++) f[i] = x; }
+    static float8 load(const float *p) { float8 r; memcpy(r.f, p, sizeof(r.f)); return r; }
+    void store(float *p) const { memcpy(p, f, sizeof(f)); }
+#endif
+
+    // Stores lanes 0 to 3 only
+#if defined(SIMD8_AVX)
+    void store4(float *p) const { _mm_storeu_ps(p, _mm256_castps256_ps128(v)); }
+#elif defined(SIMD8_SSE)
+    void store4(float *p) const { _mm_storeu_ps(p, lo); }
+#else
+    void store4(float *p) const { memcpy(p, f, 4 * sizeof(float)); }
+#endif
+
+    // 0, 1, ..., 7
+    static float8 lanes()
+    {
+        static const float l[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+        return load(l);
+    }
+};
+
+#if defined(SIMD8_AVX)
+#define SIMD8_OP(name, avx, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { return avx(a.v, b.v); }
+#define SIMD8_CMP(name, pred, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { return _mm256_cmp_ps(a.v, b.v, pred); }
+#elif defined(SIMD8_SSE)
+#define SIMD8_OP(name, avx, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { return float8(sse(a.lo, b.lo), sse(a.hi, b.hi)); }
+#define SIMD8_CMP(name, pred, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { return float8(sse(a.lo, b.lo), sse(a.hi, b.hi)); }
+#else
+#define SIMD8_OP(name, avx, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { float8 r; for (int i = 0; i < 8; i++) { float x = a.f[i], y = b.f[i]; r.f[i] = scalar; } return r; }
+#define SIMD8_CMP(name, pred, sse, scalar) \
+    inline float8 name(float8 a, float8 b) { float8 r; for (int i = 0; i < 8; i++) { float x = a.f[i], y = b.f[i]; uint32_t m = (scalar) ? ~0u : 0u; memcpy(&r.f[i], &m, 4); } return r; }
+#endif
+
+SIMD8_OP(operator+, _mm256_add_ps, _mm_add_ps, x + y)
+SIMD8_OP(operator-, _mm256_sub_ps, _mm_sub_ps, x - y)
+SIMD8_OP(operator*, _mm256_mul_ps, _mm_mul_ps, x * y)
+SIMD8_OP(operator/, _mm256_div_ps, _mm_div_ps, x / y)
+SIMD8_OP(min, _mm256_min_ps, _mm_min_ps, y < x ? y : x)
+SIMD8_OP(max, _mm256_max_ps, _mm_max_ps, y > x ? y : x)
+SIMD8_CMP(operator<, _CMP_LT_OQ, _mm_cmplt_ps, x < y)
+SIMD8_CMP(operator<=, _CMP_LE_OQ, _mm_cmple_ps, x <= y)
+SIMD8_CMP(operator>, _CMP_GT_OQ, _mm_cmpgt_ps, x > y)
+SIMD8_CMP(operator>=, _CMP_GE_OQ, _mm_cmpge_ps, x >= y)
+SIMD8_CMP(operator==, _CMP_EQ_OQ, _mm_cmpeq_ps, x == y)
+#undef SIMD8_OP
+#undef SIMD8_CMP
+
+#if defined(SIMD8_AVX)
+inline float8 operator&(float8 a, float8 b) { return _mm256_and_ps(a.v, b.v); }
+inline float8 operator|(float8 a, float8 b) { return _mm256_or_ps(a.v, b.v); }
+inline float8 andNot(float8 a, float8 b) { return _mm256_andnot_ps(a.v, b.v); } // ~a & b
+inline float8 sqrt(float8 a) { return _mm256_sqrt_ps(a.v); }
+inline float8 floor(float8 a) { return _mm256_floor_ps(a.v); }
+inline int movemask(float8 a) { return _mm256_movemask_ps(a.v); }
+#elif defined(SIMD8_SSE)
+inline float8 operator&(float8 a, float8 b) { return float8(_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)); }
+inline float8 operator|(float8 a, float8 b) { return float8(_mm_or_ps(a.lo, b.lo), _mm_or_ps(a.hi, b.hi)); }
+inline float8 andNot(float8 a, float8 b) { return float8(_mm_andnot_ps(a.lo, b.lo), _mm_andnot_ps(a.hi, b.hi)); }
+inline float8 sqrt(float8 a) { return float8(_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)); }
+// SSE2 has no rounding instructions: truncate and step down where that rounded up, exact for |x| < 2^31
+inline __m128 floor4(__m128 x)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+inline float8 floor(float8 a) { return float8(floor4(a.lo), floor4(a.hi)); }
+inline int movemask(float8 a) { return _mm_movemask_ps(a.lo) | _mm_movemask_ps(a.hi) << 4; }
+#else
+#define SIMD8_BITS(name, expr) \
+    inline float8 name(float8 a, float8 b) { float8 r; for (int i = 0; i < 8; i++) { uint32_t x, y, z; memcpy(&x, &a.f[i], 4); memcpy(&y, &b.f[i], 4); z = expr; memcpy(&r.f[i], &z, 4); } return r; }
+SIMD8_BITS(operator&, x & y)
+SIMD8_BITS(operator|, x | y)
+SIMD8_BITS(andNot, ~x & y)
+#undef SIMD8_BITS
+inline float8 sqrt(float8 a) { float8 r; for (int i = 0; i < 8; i++) r.f[i] = std::sqrt(a.f[i]); return r; }
+inline float8 floor(float8 a) { float8 r; for (int i = 0; i < 8; i++) r.f[i] = std::floor(a.f[i]); return r; }
+inline int movemask(float8 a) { int m = 0; for (int i = 0; i < 8; i++) m |= (std::signbit(a.f[i]) ? 1 : 0) << i; return m; }
+#endif
+
+// Transposes the 8x8 matrix of rows r, lane j of r[i] swaps with lane i of r[j]. Turns eight structure of arrays
+// vectors into the eight records they hold.
+#if defined(SIMD8_AVX)
+inline void transpose8(float8 r[8])
+{
+    __m256 t[8], s[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_ps(r[i].v, r[i + 1].v);
+        t[i + 1] = _mm256_unpackhi_ps(r[i].v, r[i + 1].v);
+    }
+    for (int i = 0; i < 8; i += 4)
+    {
+        s[i] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        s[i + 1] = _mm256_shuffle_ps(t[i], t[i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        s[i + 2] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        s[i + 3] = _mm256_shuffle_ps(t[i + 1], t[i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        r[i].v = _mm256_permute2f128_ps(s[i], s[i + 4], 0x20);
+        r[i + 4].v = _mm256_permute2f128_ps(s[i], s[i + 4], 0x31);
+    }
+}
+#elif defined(SIMD8_SSE)
+// Four 4x4 transposes, the off diagonal blocks trade places
+inline void transpose8(float8 r[8])
+{
+    __m128 a0 = r[0].lo, a1 = r[1].lo, a2 = r[2].lo, a3 = r[3].lo; // rows 0-3, lanes 0-3
+    __m128 b0 = r[0].hi, b1 = r[1].hi, b2 = r[2].hi, b3 = r[3].hi; // rows 0-3, lanes 4-7
+    __m128 c0 = r[4].lo, c1 = r[5].lo, c2 = r[6].lo, c3 = r[7].lo; // rows 4-7, lanes 0-3
+    __m128 d0 = r[4].hi, d1 = r[5].hi, d2 = r[6].hi, d3 = r[7].hi; // rows 4-7, lanes 4-7
+    _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+    _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    _MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+    r[0] = float8(a0, c0), r[1] = float8(a1, c1), r[2] = float8(a2, c2), r[3] = float8(a3, c3);
+    r[4] = float8(b0, d0), r[5] = float8(b1, d1), r[6] = float8(b2, d2), r[7] = float8(b3, d3);
+}
+#else
+inline void transpose8(float8 r[8])
+{
+    for (int i = 0; i < 8; i++)
+        for (int j = i + 1; j < 8; j++)
+            std::swap(r[i].f[j], r[j].f[i]);
+}
+#endif
+
+inline float8 operator-(float8 a) { return float8(0.0f) - a; }
+inline float8 select(float8 m, float8 a, float8 b) { return (m & a) | andNot(m, b); }
+inline float8 abs(float8 a) { return andNot(float8(-0.0f), a); }
+inline bool any(float8 m) { return movemask(m) != 0; }
+
+// sin and cos of |x| <= pi, to about 1e-7
+inline void sincos(float8 x, float8 &s, float8 &c)
+{
+    const float halfPi = 1.57079632679f, pi = 3.14159265359f;
+    // Fold into [-pi/2, pi/2]: sin(pi - x) = sin(x), cos(pi - x) = -cos(x)
+    float8 high = x > float8(halfPi), low = x < float8(-halfPi);
+    x = select(high, float8(pi) - x, select(low, float8(-pi) - x, x));
+    float8 sign = select(high | low, float8(-1.0f), float8(1.0f));
+    float8 x2 = x * x;
+    s = x * (float8(1.0f) + x2 * (float8(-1.0f / 6) + x2 * (float8(1.0f / 120) + x2 * (float8(-1.0f / 5040) +
+        x2 * (float8(1.0f / 362880) + x2 * float8(-1.0f / 39916800))))));
+    c = sign * (float8(1.0f) + x2 * (float8(-0.5f) + x2 * (float8(1.0f / 24) + x2 * (float8(-1.0f / 720) +
+        x2 * (float8(1.0f / 40320) + x2 * (float8(-1.0f / 3628800) + x2 * float8(1.0f / 479001600)))))));
+}
+
+// atan2(y, x) in (-pi, pi], to about 1e-5
+inline float8 atan2(float8 y, float8 x)
+{
+    float8 ax = abs(x), ay = abs(y);
+    float8 hi = max(ax, ay), lo = min(ax, ay);
+    float8 a = select(hi > float8(0.0f), lo / hi, float8(0.0f));
+    float8 s = a * a;
+    float8 r = a * (float8(0.99997726f) + s * (float8(-0.33262347f) + s * (float8(0.19354346f) +
+               s * (float8(-0.11643287f) + s * (float8(0.05265332f) + s * float8(-0.01172120f))))));
+    r = select(ay > ax, float8(1.57079632679f) - r, r);
+    r = select(x < float8(0.0f), float8(3.14159265359f) - r, r);
+    return select(y < float8(0.0f), -r, r);
+}
+#endif
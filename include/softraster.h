@@ -0,0 +1,434 @@
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SOFTRASTER_SSE 1
+#endif
+
+#include "prism.h"
+#include "threadpool.h"
+
+// Side of the square screen tiles triangles are binned into, a multiple of the 4 pixel SIMD width
+const int SOFT_TILE = 64;
+
+// Packs a [0, 1] color into RGBA8, red in the lowest byte
+inline uint32_t packColor(float r, float g, float b, float a)
+{
+    return (uint32_t)(r * 255.0f + 0.5f) | (uint32_t)(g * 255.0f + 0.5f) << 8 |
+           (uint32_t)(b * 255.0f + 0.5f) << 16 | (uint32_t)(a * 255.0f + 0.5f) << 24;
+}
+
+// In-memory render target of the software backend. Rows go bottom to top like in GL.
+struct Framebuffer
+{
+    int width;
+    int height;
+    int stride; // pixels per row, padded to the widest SIMD width
+    std::vector<uint32_t> color; // RGBA8, red in the lowest byte
+    std::vector<float> depth;
+
+    Framebuffer(int width, int height) : width(width), height(height), stride((width + 7) & ~7),
+                                         color((size_t)stride * height), depth((size_t)stride * height) {}
+
+    // writes the color buffer as a binary PPM, top row first
+    bool writePPM(const std::string &path) const
+    {
+        FILE *out = fopen(path.c_str(), "wb");
+        if (!out)
+            return false;
+        fprintf(out, "P6\n%d %d\n255\n", width, height);
+        std::vector<unsigned char> row(3 * width);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            const uint32_t *src = &color[(size_t)y * stride];
+            for (int x = 0; x < width; x++)
+            {
+                row[3 * x + 0] = src[x] & 0xff;
+                row[3 * x + 1] = (src[x] >> 8) & 0xff;
+                row[3 * x + 2] = (src[x] >> 16) & 0xff;
+            }
+            fwrite(row.data(), 1, row.size(), out);
+        }
+        return fclose(out) == 0;
+    }
+};
+
+// Multithreaded tile based rasterizer implementing the pipeline of src/vertex.shader and src/fragment.shader:
+// MVP transform, perspective correct color interpolation, depth test (GL_LESS) with depth writes and no blending.
+//
+// A frame runs in two parallel passes. Setup transforms, clips against the near plane and bins the triangles of a
+// range of the mesh into the screen tiles they touch. Raster then walks every tile on its own, clearing it and
+// drawing its triangles in submission order with 4-wide SIMD edge functions.
+class SoftRasterizer
+{
+public:
+    SoftRasterizer(ThreadPool &pool) : pool(pool), clearColor(packColor(0.2f, 0.3f, 0.3f, 1.0f)), drawn(0) {}
+
+    void setClearColor(float r, float g, float b, float a)
+    {
+        clearColor = packColor(r, g, b, a);
+    }
+
+    // Draws an unindexed PRISM_FLOAT mesh, clearing the framebuffer first when clear is set
+    void draw(const float *vertices, size_t vertexCount, const glm::mat4 &mvp, Framebuffer &fb, bool clear = true)
+    {
+        size_t triangles = vertexCount / 3;
+        tilesX = (fb.width + SOFT_TILE - 1) / SOFT_TILE;
+        tilesY = (fb.height + SOFT_TILE - 1) / SOFT_TILE;
+        int tiles = tilesX * tilesY;
+
+        // Setup, in a fixed number of ranges so raster can replay them in order whichever thread binned them
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(4 * pool.size(), triangles / 256));
+        size_t perChunk = (triangles + chunks - 1) / chunks;
+        if (bins.size() < chunks)
+            bins.resize(chunks);
+        for (size_t c = 0; c < chunks; c++)
+        {
+            bins[c].triangles.clear();
+            bins[c].tiles.resize(tiles);
+            for (int t = 0; t < tiles; t++)
+                bins[c].tiles[t].clear();
+        }
+        pool.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++)
+            {
+                size_t first = c * perChunk;
+                size_t last = std::min(triangles, first + perChunk);
+                for (size_t t = first; t < last; t++)
+                    setupTriangle(vertices + 3 * t * 6, mvp, fb, bins[c]);
+            }
+        });
+
+        // Raster
+        pool.parallelFor(tiles, 1, [&](size_t begin, size_t end) {
+            for (size_t t = begin; t < end; t++)
+                rasterTile((int)t, chunks, fb, clear);
+        });
+
+        drawn = 0;
+        for (size_t c = 0; c < chunks; c++)
+            drawn += bins[c].triangles.size();
+    }
+
+    // number of triangles binned to a tile in the last draw, some of which may have covered no pixel center
+    size_t trianglesDrawn() const
+    {
+        return drawn;
+    }
+
+private:
+    struct Vertex
+    {
+        glm::vec4 pos; // clip space
+        glm::vec3 color;
+    };
+
+    // Screen space triangle with counter-clockwise winding
+    struct Triangle
+    {
+        float edgeA[3], edgeB[3], edgeC[3]; // edge i is opposite vertex i: E(x, y) = A x + B y + C
+        float edgeMin[3];                   // smallest passing edge value, 0 on top-left edges and just above elsewhere
+        float edgeDX[3], edgeX0[3];         // where edges cross row y: x = DX y + X0, when A != 0
+        float z[3];                         // z0, z1 - z0, z2 - z0
+        float invW[3], r[3], g[3], b[3];    // colors premultiplied by 1/w
+        float invArea;
+        int minX, minY, maxX, maxY; // inclusive pixel bounds
+    };
+
+    struct Bins
+    {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<uint32_t> > tiles;
+    };
+
+    void setupTriangle(const float *v, const glm::mat4 &mvp, const Framebuffer &fb, Bins &out)
+    {
+        Vertex in[3];
+        for (int i = 0; i < 3; i++)
+        {
+            in[i].pos = mvp * glm::vec4(v[6 * i], v[6 * i + 1], v[6 * i + 2], 1.0f);
+            in[i].color = glm::vec3(v[6 * i + 3], v[6 * i + 4], v[6 * i + 5]);
+        }
+
+        // Clip against the near plane (z >= -w), leaving a polygon of up to 4 vertices
+        Vertex poly[4];
+        int count = 0;
+        for (int i = 0; i < 3; i++)
+        {
+            const Vertex &a = in[i];
+            const Vertex &b = in[(i + 1) % 3];
+            float da = a.pos.z + a.pos.w;
+            float db = b.pos.z + b.pos.w;
+            if (da >= 0)
+                poly[count++] = a;
+            if ((da >= 0) != (db >= 0))
+            {
+                float t = da / (da - db);
+                poly[count].pos = a.pos + t * (b.pos - a.pos);
+                poly[count].color = a.color + t * (b.color - a.color);
+                count++;
+            }
+        }
+        for (int i = 1; i + 1 < count; i++)
+            setupScreenTriangle(poly[0], poly[i], poly[i + 1], fb, out);
+    }
+
+    void setupScreenTriangle(const Vertex &v0, const Vertex &v1, const Vertex &v2, const Framebuffer &fb, Bins &out)
+    {
+        const Vertex *v[3] = {&v0, &v1, &v2};
+        float x[3], y[3], z[3], invW[3];
+        for (int i = 0; i < 3; i++)
+        {
+            invW[i] = 1.0f / v[i]->pos.w;
+            x[i] = (v[i]->pos.x * invW[i] * 0.5f + 0.5f) * fb.width;
+            y[i] = (v[i]->pos.y * invW[i] * 0.5f + 0.5f) * fb.height;
+            z[i] = v[i]->pos.z * invW[i] * 0.5f + 0.5f;
+        }
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (!(std::fabs(area) > 0)) // also drops NaNs
+            return;
+        // No face culling in the GL pipeline either, clockwise triangles are flipped to counter-clockwise
+        if (area < 0)
+        {
+            std::swap(v[1], v[2]);
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            std::swap(invW[1], invW[2]);
+            area = -area;
+        }
+
+        Triangle tri;
+        // Pixels whose centers lie inside the bounds
+        tri.minX = std::max(0, (int)std::ceil(std::min(x[0], std::min(x[1], x[2])) - 0.5f));
+        tri.maxX = std::min(fb.width - 1, (int)std::floor(std::max(x[0], std::max(x[1], x[2])) - 0.5f));
+        tri.minY = std::max(0, (int)std::ceil(std::min(y[0], std::min(y[1], y[2])) - 0.5f));
+        tri.maxY = std::min(fb.height - 1, (int)std::floor(std::max(y[0], std::max(y[1], y[2])) - 0.5f));
+        // Most sides of a prism with huge n cover no pixel center at all and end here
+        if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+            return;
+
+        for (int i = 0; i < 3; i++)
+        {
+            int a = (i + 1) % 3, b = (i + 2) % 3;
+            // Both triangles sharing an edge build it from the same endpoint order and one negates it, so they evaluate
+            // to exactly opposite values and no pixel along the edge is missed or drawn twice
+            bool flip = x[b] < x[a] || (x[b] == x[a] && y[b] < y[a]);
+            int p = flip ? b : a, q = flip ? a : b;
+            float dx = x[q] - x[p], dy = y[q] - y[p];
+            float sign = flip ? -1.0f : 1.0f;
+            tri.edgeA[i] = -dy * sign;
+            tri.edgeB[i] = dx * sign;
+            tri.edgeC[i] = (dy * x[p] - dx * y[p]) * sign;
+            // Top-left fill rule: with y up and counter-clockwise winding, left edges point down and top edges point left
+            dx *= sign;
+            dy *= sign;
+            bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+            tri.edgeMin[i] = topLeft ? 0.0f : 1e-30f;
+            tri.edgeDX[i] = tri.edgeA[i] != 0 ? -tri.edgeB[i] / tri.edgeA[i] : 0.0f;
+            tri.edgeX0[i] = tri.edgeA[i] != 0 ? -tri.edgeC[i] / tri.edgeA[i] : 0.0f;
+            // Depth is kept relative to vertex 0: on slivers the weights are off by far more than the depth differences
+            tri.z[i] = i ? z[i] - z[0] : z[0];
+            tri.invW[i] = invW[i];
+            tri.r[i] = v[i]->color.r * invW[i];
+            tri.g[i] = v[i]->color.g * invW[i];
+            tri.b[i] = v[i]->color.b * invW[i];
+        }
+        tri.invArea = 1.0f / area;
+
+        uint32_t id = (uint32_t)out.triangles.size();
+        out.triangles.push_back(tri);
+        for (int ty = tri.minY / SOFT_TILE; ty <= tri.maxY / SOFT_TILE; ty++)
+            for (int tx = tri.minX / SOFT_TILE; tx <= tri.maxX / SOFT_TILE; tx++)
+                out.tiles[ty * tilesX + tx].push_back(id);
+    }
+
+    void rasterTile(int tile, size_t chunks, Framebuffer &fb, bool clear)
+    {
+        int x0 = (tile % tilesX) * SOFT_TILE, y0 = (tile / tilesX) * SOFT_TILE;
+        int x1 = std::min(fb.width, x0 + SOFT_TILE) - 1, y1 = std::min(fb.height, y0 + SOFT_TILE) - 1;
+        if (clear)
+            for (int y = y0; y <= y1; y++)
+            {
+                std::fill(&fb.color[(size_t)y * fb.stride + x0], &fb.color[(size_t)y * fb.stride + x1] + 1, clearColor);
+                std::fill(&fb.depth[(size_t)y * fb.stride + x0], &fb.depth[(size_t)y * fb.stride + x1] + 1, 1.0f);
+            }
+        for (size_t c = 0; c < chunks; c++)
+        {
+            const std::vector<uint32_t> &ids = bins[c].tiles[tile];
+            for (size_t i = 0; i < ids.size(); i++)
+            {
+                const Triangle &tri = bins[c].triangles[ids[i]];
+                rasterTriangle(tri, std::max(tri.minX, x0), std::max(tri.minY, y0),
+                               std::min(tri.maxX, x1), std::min(tri.maxY, y1), fb);
+            }
+        }
+    }
+
+#ifdef SOFTRASTER_SSE
+    // interpolates per vertex values with barycentric weights
+    static __m128 lerp(__m128 w0, __m128 w1, __m128 w2, const float v[3])
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(w0, _mm_set1_ps(v[0])), _mm_mul_ps(w1, _mm_set1_ps(v[1]))), _mm_mul_ps(w2, _mm_set1_ps(v[2])));
+    }
+
+    // converts [0, 1] floats to rounded bytes, clamping the interpolation error at the edges
+    static __m128i toByte(__m128 v)
+    {
+        v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    }
+#endif
+
+    // Narrows [minX, maxX] to the pixels of row py that can be inside the triangle, by intersecting the row with each
+    // edge. The span is widened by the rounding error of the intersections so it never loses pixels, the edge tests
+    // stay exact. Without it thin slivers, like the slices of a prism with many sides, would walk their whole bounding
+    // box, and most of their rows hold no pixel center at all.
+    static bool rowSpan(const Triangle &tri, float py, int minX, int maxX, int &spanMin, int &spanMax)
+    {
+        float lo = (float)minX, hi = (float)maxX;
+        for (int e = 0; e < 3; e++)
+        {
+            // A x + B y + C >= 0 at the pixel center x + 0.5
+            float dx = tri.edgeDX[e] * py;
+            float cross = dx + tri.edgeX0[e] - 0.5f;
+            float slack = (std::fabs(dx) + std::fabs(tri.edgeX0[e])) * 1e-5f + 1e-3f;
+            if (tri.edgeA[e] > 0)
+                lo = std::max(lo, cross - slack);
+            else if (tri.edgeA[e] < 0)
+                hi = std::min(hi, cross + slack);
+            else if (tri.edgeB[e] * py + tri.edgeC[e] < tri.edgeMin[e])
+                return false;
+        }
+        if (!(lo <= hi))
+            return false;
+        spanMin = std::max(minX, (int)std::ceil(lo));
+        spanMax = std::min(maxX, (int)std::floor(hi));
+        return spanMin <= spanMax;
+    }
+
+    // converts a [0, 1] float to a rounded byte
+    static uint32_t toByte(float v)
+    {
+        return (uint32_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+    }
+
+    // Shades the pixels of a triangle inside [minX, maxX] x [minY, maxY]
+    void rasterTriangle(const Triangle &tri, int minX, int minY, int maxX, int maxY, Framebuffer &fb) const
+    {
+#ifdef SOFTRASTER_SSE
+        const __m128 lane = _mm_set_ps(3, 2, 1, 0);
+        const __m128 four = _mm_set1_ps(4.0f);
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128i alpha = _mm_set1_epi32((int)(uint32_t)(0.6f * 255.0f + 0.5f) << 24);
+        __m128 edgeMin[3];
+        for (int e = 0; e < 3; e++)
+            edgeMin[e] = _mm_set1_ps(tri.edgeMin[e]);
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            int spanMin, spanMax;
+            if (!rowSpan(tri, py, minX, maxX, spanMin, spanMax))
+                continue;
+            const __m128 minXs = _mm_set1_ps((float)spanMin), maxXs = _mm_set1_ps((float)spanMax);
+            int startX = spanMin & ~3;
+            __m128 px = _mm_add_ps(_mm_set1_ps(startX + 0.5f), lane);
+            __m128 xi = _mm_add_ps(_mm_set1_ps((float)startX), lane);
+            __m128 A[3], K[3];
+            for (int e = 0; e < 3; e++)
+            {
+                A[e] = _mm_set1_ps(tri.edgeA[e]);
+                K[e] = _mm_set1_ps(tri.edgeB[e] * py + tri.edgeC[e]);
+            }
+            uint32_t *color = &fb.color[(size_t)y * fb.stride];
+            float *depth = &fb.depth[(size_t)y * fb.stride];
+            for (int x = startX; x <= spanMax; x += 4)
+            {
+                // Evaluated in full rather than stepped, stepping would break the exact match along shared edges
+                __m128 E[3];
+                for (int e = 0; e < 3; e++)
+                    E[e] = _mm_add_ps(_mm_mul_ps(A[e], px), K[e]);
+                __m128 mask = _mm_and_ps(_mm_cmpge_ps(xi, minXs), _mm_cmple_ps(xi, maxXs));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(E[0], edgeMin[0]));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(E[1], edgeMin[1]));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(E[2], edgeMin[2]));
+                if (_mm_movemask_ps(mask))
+                {
+                    __m128 invArea = _mm_set1_ps(tri.invArea);
+                    __m128 w0 = _mm_mul_ps(E[0], invArea), w1 = _mm_mul_ps(E[1], invArea), w2 = _mm_mul_ps(E[2], invArea);
+                    __m128 z = _mm_add_ps(_mm_set1_ps(tri.z[0]), _mm_add_ps(_mm_mul_ps(w1, _mm_set1_ps(tri.z[1])), _mm_mul_ps(w2, _mm_set1_ps(tri.z[2]))));
+                    __m128 old = _mm_loadu_ps(depth + x);
+                    mask = _mm_and_ps(mask, _mm_and_ps(_mm_cmplt_ps(z, old), _mm_and_ps(_mm_cmpge_ps(z, zero), _mm_cmple_ps(z, one))));
+                    if (_mm_movemask_ps(mask))
+                    {
+                        __m128 w = _mm_div_ps(one, lerp(w0, w1, w2, tri.invW));
+                        __m128i r = toByte(_mm_mul_ps(lerp(w0, w1, w2, tri.r), w));
+                        __m128i g = toByte(_mm_mul_ps(lerp(w0, w1, w2, tri.g), w));
+                        __m128i b = toByte(_mm_mul_ps(lerp(w0, w1, w2, tri.b), w));
+                        __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), alpha));
+                        __m128i m = _mm_castps_si128(mask);
+                        __m128i oldColor = _mm_loadu_si128((const __m128i *)(color + x));
+                        _mm_storeu_si128((__m128i *)(color + x), _mm_or_si128(_mm_and_si128(m, rgba), _mm_andnot_si128(m, oldColor)));
+                        _mm_storeu_ps(depth + x, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old)));
+                    }
+                }
+                px = _mm_add_ps(px, four);
+                xi = _mm_add_ps(xi, four);
+            }
+        }
+#else
+        const uint32_t alpha = (uint32_t)(0.6f * 255.0f + 0.5f) << 24;
+        for (int y = minY; y <= maxY; y++)
+        {
+            float py = y + 0.5f;
+            int spanMin, spanMax;
+            if (!rowSpan(tri, py, minX, maxX, spanMin, spanMax))
+                continue;
+            uint32_t *color = &fb.color[(size_t)y * fb.stride];
+            float *depth = &fb.depth[(size_t)y * fb.stride];
+            for (int x = spanMin; x <= spanMax; x++)
+            {
+                float px = x + 0.5f;
+                float E[3];
+                bool inside = true;
+                for (int e = 0; e < 3; e++)
+                {
+                    E[e] = tri.edgeA[e] * px + (tri.edgeB[e] * py + tri.edgeC[e]);
+                    inside = inside && E[e] >= tri.edgeMin[e];
+                }
+                if (!inside)
+                    continue;
+                float w0 = E[0] * tri.invArea, w1 = E[1] * tri.invArea, w2 = E[2] * tri.invArea;
+                float z = tri.z[0] + w1 * tri.z[1] + w2 * tri.z[2];
+                if (!(z < depth[x]) || z < 0 || z > 1)
+                    continue;
+                float w = 1.0f / (w0 * tri.invW[0] + w1 * tri.invW[1] + w2 * tri.invW[2]);
+                uint32_t r = toByte((w0 * tri.r[0] + w1 * tri.r[1] + w2 * tri.r[2]) * w);
+                uint32_t g = toByte((w0 * tri.g[0] + w1 * tri.g[1] + w2 * tri.g[2]) * w);
+                uint32_t b = toByte((w0 * tri.b[0] + w1 * tri.b[1] + w2 * tri.b[2]) * w);
+                color[x] = r | g << 8 | b << 16 | alpha;
+                depth[x] = z;
+            }
+        }
+#endif
+    }
+
+    ThreadPool &pool;
+    uint32_t clearColor;
+    std::vector<Bins> bins;
+    int tilesX;
+    int tilesY;
+    size_t drawn;
+};
+#endif
@@ -0,0 +1,117 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Number of samples each rolling average covers
+const int STATS_WINDOW = 60;
+// Seconds between two reports
+const double STATS_INTERVAL = 1.0;
+
+// Named timing channels in milliseconds, averaged over the last STATS_WINDOW samples.
+// CPU and GPU timers both report here so every timing shows up in the same place.
+class Stats
+{
+public:
+    Stats() : lastReport(0) {}
+
+    // registers a channel (or finds an existing one) and returns its handle
+    int channel(const std::string &name)
+    {
+        for (size_t i = 0; i < channels.size(); i++)
+            if (channels[i].name == name)
+                return (int)i;
+        Channel c;
+        c.name = name;
+        c.count = 0;
+        c.next = 0;
+        c.sum = 0;
+        channels.push_back(c);
+        return (int)channels.size() - 1;
+    }
+
+    void add(int channel, double ms)
+    {
+        Channel &c = channels[channel];
+        if (c.count == STATS_WINDOW)
+            c.sum -= c.samples[c.next];
+        else
+            c.count++;
+        c.samples[c.next] = ms;
+        c.sum += ms;
+        c.next = (c.next + 1) % STATS_WINDOW;
+    }
+
+    // rolling average of a channel, negative while it has no samples
+    double average(int channel) const
+    {
+        const Channel &c = channels[channel];
+        return c.count ? c.sum / c.count : -1.0;
+    }
+
+    const std::string &name(int channel) const
+    {
+        return channels[channel].name;
+    }
+
+    int size() const
+    {
+        return (int)channels.size();
+    }
+
+    // returns true once every STATS_INTERVAL seconds
+    bool due(double now)
+    {
+        if (now - lastReport < STATS_INTERVAL)
+            return false;
+        lastReport = now;
+        return true;
+    }
+
+    // prints every channel on one line
+    void print(FILE *out = stdout) const
+    {
+        for (size_t i = 0; i < channels.size(); i++)
+        {
+            double avg = average((int)i);
+            if (avg < 0)
+                fprintf(out, "%s%s -", i ? " | " : "", channels[i].name.c_str());
+            else
+                fprintf(out, "%s%s %.3f", i ? " | " : "", channels[i].name.c_str(), avg);
+        }
+        fprintf(out, " (ms)\n");
+        fflush(out);
+    }
+
+private:
+    struct Channel
+    {
+        std::string name;
+        double samples[STATS_WINDOW];
+        int count;
+        int next;
+        double sum;
+    };
+    std::vector<Channel> channels;
+    double lastReport;
+};
+
+// Times the enclosing scope on the CPU
+class CpuScope
+{
+public:
+    CpuScope(Stats &stats, int channel) : stats(stats), channel(channel), start(std::chrono::steady_clock::now()) {}
+    ~CpuScope()
+    {
+        stats.add(channel, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    Stats &stats;
+    int channel;
+    std::chrono::steady_clock::time_point start;
+};
+#endif
@@ -0,0 +1,200 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads running parallel-for loops. The calling thread takes part in every loop, so a pool of
+// size 1 runs everything inline without any synchronization.
+//
+// Loops are work stealing: every thread starts on its own contiguous share of the range and takes chunks from its
+// front, and a thread that runs out steals the back half of the largest share it finds. A share is a single 64 bit
+// word of begin and end updated with compare and swap, so neither taking nor stealing needs a lock. Threads keep
+// touching the same part of the data from one call to the next unless the load is uneven.
+class ThreadPool
+{
+public:
+    // threads counts the calling thread too, 0 picks one per hardware thread
+    explicit ThreadPool(unsigned threads = 0) : job(NULL), jobContext(NULL), generation(0), pending(0), stop(false)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        shares.reset(new Share[threads]);
+        for (unsigned i = 1; i < threads; i++)
+            workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    // number of threads loops are spread over, including the caller
+    unsigned size() const
+    {
+        return (unsigned)workers.size() + 1;
+    }
+
+    // Calls fn(begin, end) over [0, count) in chunks of at most grain items and returns once all of them are done.
+    // Chunks start at multiples of grain. Not reentrant: fn must not call parallelFor.
+    template <class F>
+    void parallelFor(size_t count, size_t grain, F fn)
+    {
+        grain = std::max<size_t>(grain, 1);
+        if (workers.empty() || count <= grain)
+        {
+            if (count)
+                fn((size_t)0, count);
+            return;
+        }
+        // Shares hold 32 bit bounds, larger loops run in rounds
+        const size_t round = (size_t)UINT32_MAX / grain * grain;
+        for (size_t offset = 0; offset < count; offset += round)
+        {
+            size_t length = std::min(count - offset, round);
+            std::unique_lock<std::mutex> lock(mutex);
+            // fn lives on this stack frame until every worker is done with it, so no copy or allocation is needed
+            job = &invoke<F>;
+            jobContext = &fn;
+            jobOffset = offset;
+            jobGrain = grain;
+            size_t chunks = (length + grain - 1) / grain;
+            for (unsigned i = 0; i < size(); i++)
+                shares[i].range = pack(std::min(length, chunks * i / size() * grain),
+                                       std::min(length, chunks * (i + 1) / size() * grain));
+            pending = (unsigned)workers.size();
+            generation++;
+            lock.unlock();
+            wake.notify_all();
+
+            runChunks(0);
+
+            lock.lock();
+            done.wait(lock, [this]() { return pending == 0; });
+        }
+    }
+
+private:
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    template <class F>
+    static void invoke(void *fn, size_t begin, size_t end)
+    {
+        (*(F *)fn)(begin, end);
+    }
+
+    // Padded to a cache line of its own, the owner updates it on every chunk
+    struct Share
+    {
+        std::atomic<uint64_t> range;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static uint64_t pack(size_t begin, size_t end)
+    {
+        return (uint64_t)begin << 32 | (uint64_t)end;
+    }
+    static size_t first(uint64_t range)
+    {
+        return (size_t)(range >> 32);
+    }
+    static size_t last(uint64_t range)
+    {
+        return (size_t)(range & UINT32_MAX);
+    }
+
+    void runChunks(unsigned self)
+    {
+        std::atomic<uint64_t> &mine = shares[self].range;
+        do
+        {
+            uint64_t range = mine.load();
+            while (first(range) < last(range))
+            {
+                size_t begin = first(range), end = std::min(begin + jobGrain, last(range));
+                if (mine.compare_exchange_weak(range, pack(end, last(range))))
+                {
+                    job(jobContext, jobOffset + begin, jobOffset + end);
+                    range = mine.load();
+                }
+            }
+        } while (steal(self));
+    }
+
+    // Moves the back half of the largest share left, at least one chunk, into this thread's own. false when all are empty.
+    bool steal(unsigned self)
+    {
+        for (;;)
+        {
+            unsigned victim = self;
+            size_t most = 0;
+            for (unsigned i = 0; i < size(); i++)
+            {
+                uint64_t range = shares[i].range.load();
+                if (last(range) - first(range) > most)
+                {
+                    most = last(range) - first(range);
+                    victim = i;
+                }
+            }
+            if (most == 0)
+                return false;
+            uint64_t range = shares[victim].range.load();
+            if (first(range) >= last(range))
+                continue;
+            size_t chunks = (last(range) - first(range) + jobGrain - 1) / jobGrain;
+            size_t split = std::min(last(range), first(range) + chunks / 2 * jobGrain);
+            if (shares[victim].range.compare_exchange_strong(range, pack(first(range), split)))
+            {
+                shares[self].range = pack(split, last(range));
+                return true;
+            }
+        }
+    }
+
+    void workerLoop(unsigned self)
+    {
+        unsigned seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&]() { return stop || generation != seen; });
+                if (stop)
+                    return;
+                seen = generation;
+            }
+            runChunks(self);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*job)(void *, size_t, size_t);
+    void *jobContext;
+    size_t jobOffset;
+    size_t jobGrain;
+    std::unique_ptr<Share[]> shares; // one per thread, the caller's first
+    unsigned generation;
+    unsigned pending;
+    bool stop;
+};
+#endif
@@ -0,0 +1,176 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TRACE_RDTSC 1
+#endif
+
+// Scoped CPU trace markers written out as Chrome trace-event JSON, which Perfetto and chrome://tracing open directly.
+// Every thread appends to its own buffer, the only lock is taken once per thread when its buffer is created.
+//
+//     TRACE_SCOPE("swap");
+//
+// Markers cost a single branch while tracing is disabled.
+
+struct TraceEvent
+{
+    const char *name; // must be a string literal or otherwise outlive the trace
+    uint64_t start;
+    uint64_t end;
+};
+
+struct TraceBuffer
+{
+    std::vector<TraceEvent> events;
+    int tid;
+    const char *name;
+};
+
+class Tracer
+{
+public:
+    static Tracer &get()
+    {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    bool enabled() const
+    {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    void enable()
+    {
+        calibrate(startTicks, startClock);
+        on = true;
+    }
+
+    // raw timestamp, TSC ticks on x86 and steady_clock nanoseconds elsewhere
+    static uint64_t now()
+    {
+#ifdef TRACE_RDTSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // the calling thread's buffer
+    TraceBuffer &local()
+    {
+        static thread_local TraceBuffer *buffer = NULL;
+        if (!buffer)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            buffers.push_back(new TraceBuffer());
+            buffer = buffers.back();
+            buffer->tid = (int)buffers.size();
+            buffer->name = "thread";
+            buffer->events.reserve(1 << 16);
+        }
+        return *buffer;
+    }
+
+    // labels the calling thread in the trace
+    void nameThread(const char *name)
+    {
+        local().name = name;
+    }
+
+    // writes every event recorded so far, returns false if the file can't be written.
+    // Must not race with threads still recording.
+    bool write(const std::string &path)
+    {
+        uint64_t endTicks;
+        std::chrono::steady_clock::time_point endClock;
+        calibrate(endTicks, endClock);
+        double usPerTick = std::chrono::duration<double, std::micro>(endClock - startClock).count() / (double)(endTicks - startTicks);
+
+        FILE *out = fopen(path.c_str(), "w");
+        if (!out)
+            return false;
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t b = 0; b < buffers.size(); b++)
+        {
+            const TraceBuffer &buf = *buffers[b];
+            fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", buf.tid, buf.name);
+            first = false;
+            for (size_t i = 0; i < buf.events.size(); i++)
+            {
+                const TraceEvent &e = buf.events[i];
+                double ts = (double)(int64_t)(e.start - startTicks) * usPerTick;
+                double dur = (double)(e.end - e.start) * usPerTick;
+                fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        e.name, buf.tid, ts, dur);
+            }
+        }
+        fprintf(out, "\n]}\n");
+        return fclose(out) == 0;
+    }
+
+private:
+    Tracer() : on(false), startTicks(now()), startClock(std::chrono::steady_clock::now()) {}
+
+    static void calibrate(uint64_t &ticks, std::chrono::steady_clock::time_point &clock)
+    {
+        ticks = now();
+        clock = std::chrono::steady_clock::now();
+    }
+
+    std::atomic<bool> on;
+    std::mutex mutex;
+    std::vector<TraceBuffer *> buffers;
+    uint64_t startTicks;
+    std::chrono::steady_clock::time_point startClock;
+};
+
+// Records the enclosing scope when tracing is enabled
+class TraceScope
+{
+public:
+    TraceScope(const char *name) : name(name), start(0)
+    {
+        if (Tracer::get().enabled())
+            start = Tracer::now();
+    }
+    ~TraceScope()
+    {
+        end();
+    }
+
+    // closes the scope early, for spans that end before the variables they create go out of scope
+    void end()
+    {
+        if (!start)
+            return;
+        TraceEvent e = {name, start, Tracer::now()};
+        Tracer::get().local().events.push_back(e);
+        start = 0;
+    }
+
+private:
+    const char *name;
+    uint64_t start;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#endif
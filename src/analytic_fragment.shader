@@ -0,0 +1,101 @@
+#version 330 core
+// Intersects the pixel's view ray with the n sided prism analytically, the same way include/raytrace.h does, and
+// writes the color and depth the mesh would have produced there. The cost is one ray per covered pixel for any n.
+out vec4 FragColor;
+
+uniform mat4 projection;
+uniform mat4 toObject; // inverse(view * model)
+uniform vec2 viewport;
+uniform float sides;
+
+const float PI = 3.14159265359;
+const float prismLen = 0.5;
+const float prismRadius = 0.5;
+
+// Tests the two sides whose normals bracket the polar angle of p. Entering sides face the ray (den < 0) and raise the
+// entry distance, leaving sides lower the exit distance. Returns false when the ray runs parallel outside a side.
+bool testSides(vec2 p, vec2 o, vec2 d, float apothem, bool entering, inout float t, inout float index)
+{
+    float sideAngle = 2.0 * PI / sides;
+    float first = floor(atan(p.y, p.x) / sideAngle - 0.5);
+    for (int k = 0; k < 2; k++)
+    {
+        float side = first + float(k);
+        float angle = (side + 0.5) * sideAngle;
+        angle -= 2.0 * PI * floor(angle / (2.0 * PI) + 0.5);
+        vec2 normal = vec2(cos(angle), sin(angle));
+        float den = dot(normal, d);
+        float dist = apothem - dot(normal, o);
+        if (den == 0.0)
+        {
+            if (dist < 0.0)
+                return false;
+            continue;
+        }
+        float s = dist / den;
+        if (entering && den < 0.0 && s > t)
+        {
+            t = s;
+            index = side;
+        }
+        if (!entering && den > 0.0 && s < t)
+        {
+            t = s;
+            index = side;
+        }
+    }
+    return true;
+}
+
+void main()
+{
+    vec2 ndc = gl_FragCoord.xy / viewport * 2.0 - 1.0;
+    // Eye space direction with z = -1, so t is the eye space depth
+    vec3 o = (toObject * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+    vec3 d = mat3(toObject) * vec3(ndc.x / projection[0][0], ndc.y / projection[1][1], -1.0);
+
+    // Caps
+    float tTop = (prismLen - o.z) / d.z, tBottom = (-prismLen - o.z) / d.z;
+    float capIn = min(tTop, tBottom), capOut = max(tTop, tBottom);
+
+    // Closest approach to the axis and the crossings of the inscribed circle
+    float a2 = dot(d.xy, d.xy);
+    float tc = a2 > 1e-20 ? -dot(o.xy, d.xy) / a2 : 0.0;
+    vec2 c = o.xy + tc * d.xy;
+    float h2 = dot(c, c);
+    if (h2 > prismRadius * prismRadius || !(capIn <= capOut))
+        discard;
+    float apothem = prismRadius * cos(PI / sides);
+    float disc = a2 > 1e-20 ? (apothem * apothem - h2) / a2 : 0.0;
+    float dt = sqrt(max(disc, 0.0));
+
+    float sideIn = -1e30, sideOut = 1e30, indexIn = 0.0, indexOut = 0.0;
+    if (!testSides(c - dt * d.xy, o.xy, d.xy, apothem, true, sideIn, indexIn) ||
+        !testSides(c + dt * d.xy, o.xy, d.xy, apothem, false, sideOut, indexOut))
+        discard;
+
+    float enter = max(capIn, sideIn), exit = min(capOut, sideOut);
+    if (enter > exit)
+        discard;
+    // The near and far planes of the projection, when the near plane cuts the front away the back face shows
+    float zNear = projection[3][2] / (projection[2][2] - 1.0);
+    float zFar = projection[3][2] / (projection[2][2] + 1.0);
+    bool front = enter >= zNear;
+    float t = front ? enter : exit;
+    if (t < zNear || t > zFar)
+        discard;
+
+    vec3 color;
+    if (front ? capIn > sideIn : capOut < sideOut)
+        color = (front ? tTop < tBottom : tTop > tBottom) ? vec3(1.0, 1.0, 0.0) : vec3(0.0, 1.0, 1.0);
+    else
+    {
+        float index = front ? indexIn : indexOut;
+        if (index < 0.0)
+            index += sides;
+        index = min(index, sides - 1.0);
+        color = vec3(1.0 / sides * index, 0.0, 1.0 / sides * index);
+    }
+    FragColor = vec4(color, 0.6f);
+    gl_FragDepth = 0.5 * (projection[3][2] / t - projection[2][2]) + 0.5;
+}
@@ -0,0 +1,9 @@
+#version 330 core
+// Screen-space quad covering the prism, bounds holds its NDC rectangle as (min x, min y, max x, max y)
+uniform vec4 bounds;
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    gl_Position = vec4(mix(bounds.xy, bounds.zw, corner), 0.0, 1.0);
+}
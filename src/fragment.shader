@@ -1,8 +1,23 @@
 #version 330 core
-in vec3 ourColor;
+// Built in variants by include/shadervariants.h, which may define:
+//   OIT  write the weighted blended transparency targets of include/oit.h instead of the blended color
+in vec4 ourColor; // its alpha multiplies the faces' own
+#ifdef OIT
+layout (location = 0) out vec4 accum;   // color * alpha * weight, and alpha to multiply the revealage by
+layout (location = 1) out float weight; // alpha * weight
+#else
 out vec4 FragColor;
+#endif
 
 void main()
 {
-    FragColor = vec4(ourColor, 0.6f);
+    float alpha = 0.6f * ourColor.a;
+#ifdef OIT
+    // McGuire and Bavoil's depth weight: nearer fragments count more, bounded to keep 16 bit floats in range
+    float w = clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);
+    accum = vec4(ourColor.rgb * alpha * w, alpha);
+    weight = alpha * w;
+#else
+    FragColor = vec4(ourColor.rgb, alpha);
+#endif
 }
\ No newline at end of file
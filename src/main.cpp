@@ -4,22 +4,60 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
 
 #include "shader.h"
+#include "shadersource.h"
 #include "camera.h"
+#include "prism.h"
+#include "options.h"
+#include "glextras.h"
+#include "stats.h"
+#include "gputimer.h"
+#include "trace.h"
+#include "replay.h"
+#include "threadpool.h"
+#include "softraster.h"
+#include "raytrace.h"
+#include "analytic.h"
+#include "shadervariants.h"
+#include "shaderreload.h"
+#include "oit.h"
+#include "depthsort.h"
+#include "multiview.h"
+#include "scenario.h"
+#include "scene.h"
+#include "bvh.h"
+#include "pick.h"
+#include "collision.h"
+#include "meshexport.h"
+#include "capture.h"
+#include "scenefile.h"
+#include "bufferarena.h"
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
-void processInput(GLFWwindow *window);
+void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+uint32_t pollKeys(GLFWwindow *window);
+uint32_t moveKeys();
+void processInput(GLFWwindow *window, uint32_t keys);
 void moveModel(int dir, float deltaTime);
 void resetState();
+void updateMatrices();
+int runSoftware(const Options &opts, InputReplay &replay, const InputState &initialState, const Scenario &scenario);
+InputState saveState(int n);
+void loadState(const InputState &state);
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 800;
 
-// Half the len of prism
-const float prismLen = 0.5f;
-
 // Init Camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 // timing
@@ -33,19 +71,89 @@ float angle;
 bool outOfPlace = false;
 bool modelSpin = false;
 bool camSpin = false;
+Scene scene;      // the instances, laid out around pos
+long picked = -1; // instance the move keys move instead of pos, -1 for none
+// A click waiting for the next frame to pick at its cursor position
+bool pickRequested = false;
+double pickX, pickY;
+
+// Keys processInput() reacts to, a frame's input is the mask of the ones held down
+const int inputKeys[] = {GLFW_KEY_ESCAPE, GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E,
+                         GLFW_KEY_U, GLFW_KEY_O, GLFW_KEY_I, GLFW_KEY_K, GLFW_KEY_J, GLFW_KEY_L, GLFW_KEY_R,
+                         GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_T};
+const int inputKeyCount = sizeof(inputKeys) / sizeof(inputKeys[0]);
 
 int main(int argc, char **argv)
 {
     // Validate args
-    if (argc != 2)
+    Options opts = parseOptions(argc, argv);
+    // Exports only need the generator
+    if (!opts.exportPath.empty())
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        uint64_t bytes;
+        if (!exportPrism(opts.n, opts.exportPath, bytes))
+            return -1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Wrote %.1f MB to %s in %.2f s, %.0f MB/s\n", bytes / 1e6, opts.exportPath.c_str(), seconds, bytes / 1e6 / seconds);
+        return 0;
+    }
+    // So does converting a scene file
+    if (!opts.convertFrom.empty())
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        Scene text;
+        if (!readSceneText(opts.convertFrom, text) || !writeSceneFile(text, opts.convertTo))
+            return -1;
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("Converted %zu prisms to %s in %.2f s\n", text.size(), opts.convertTo.c_str(), seconds);
+        return 0;
+    }
+    // Recorded runs start from the recorded state, including the number of sides
+    InputReplay replay;
+    InputState initialState;
+    if (!opts.replay.empty())
+    {
+        if (!replay.open(opts.replay, opts.fixedStep, initialState))
+        {
+            std::cout << "Failed to read recording " << opts.replay << std::endl;
+            return -1;
+        }
+        opts.n = initialState.n;
+    }
+    // Scenarios script the whole run, starting with the number of sides
+    Scenario scenario;
+    if (!opts.scenario.empty())
+    {
+        if (!scenario.load(opts.scenario))
+            return -1;
+        opts.n = scenario.initialN();
+    }
+    // A scene file gives the instances instead of the scenario's grids
+    if (!opts.scene.empty())
     {
-        std::cout << "Usage : ./app <n>" << std::endl;
-        exit(0);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!loadScene(opts.scene, scene))
+            return -1;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        printf("Loaded %zu prisms from %s in %.2f ms\n", scene.size(), opts.scene.c_str(), ms);
     }
     // Prism n sides
-    int pn = atoi(argv[1]);
+    int pn = opts.n;
+    if (!opts.trace.empty())
+    {
+        Tracer::get().enable();
+        Tracer::get().nameThread("main");
+    }
+    // The software backend needs neither a window nor a GL context
+    if (opts.backend != BACKEND_GL)
+        return runSoftware(opts, replay, initialState, scenario);
+    TraceScope startup("startup");
     // Init GLFW
-    glfwInit();
+    {
+        TRACE_SCOPE("glfwInit");
+        glfwInit();
+    }
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -55,7 +163,9 @@ int main(int argc, char **argv)
 #endif
 
     // Create window
+    TraceScope createWindow("glfwCreateWindow");
     GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "MyGL", NULL, NULL);
+    createWindow.end();
 
     if (window == NULL)
     {
@@ -65,13 +175,22 @@ int main(int argc, char **argv)
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback); // Register function to handle viewport with change in dimensions
+    // Clicks pick a prism. Recordings only hold keys, so neither recording nor replaying reacts to them.
+    if (!replay.isOpen() && opts.record.empty())
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+    // Replays and scenarios are benchmarks, don't let vsync cap them
+    if (replay.isOpen() || !opts.scenario.empty())
+        glfwSwapInterval(0);
 
     // Load OpenGL functions
+    TraceScope loadGL("gladLoadGLLoader");
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
+    loadGLExtras((GLADloadproc)glfwGetProcAddress);
+    loadGL.end();
 
     // OpenGL Config
     // Enable blending
@@ -81,116 +200,262 @@ int main(int argc, char **argv)
     glEnable(GL_DEPTH_TEST);
 
     // Compiler shaders
-    Shader ourShader("../src/vertex.shader", "../src/fragment.shader");
-
-    // Vertices
-    float vertices[4 * pn][18];
-    for (int i = 0; i < pn; i++)
-    {
-        vertices[i][0] = 0;
-        vertices[i][1] = 0;
-        vertices[i][2] = prismLen;
-        vertices[i][3] = 1;
-        vertices[i][4] = 1;
-        vertices[i][5] = 0;
-        vertices[i][6] = 0.5 * cos(i * 2 * M_PI / pn);
-        vertices[i][7] = 0.5 * sin(i * 2 * M_PI / pn);
-        vertices[i][8] = prismLen;
-        vertices[i][9] = 1;
-        vertices[i][10] = 1;
-        vertices[i][11] = 0;
-        vertices[i][12] = 0.5 * cos((i + 1) * 2 * M_PI / pn);
-        vertices[i][13] = 0.5 * sin((i + 1) * 2 * M_PI / pn);
-        vertices[i][14] = prismLen;
-        vertices[i][15] = 1;
-        vertices[i][16] = 1;
-        vertices[i][17] = 0;
-    }
-    for (int i = pn; i < 2 * pn; i++)
-    {
-        vertices[i][0] = 0;
-        vertices[i][1] = 0;
-        vertices[i][2] = -prismLen;
-        vertices[i][3] = 0;
-        vertices[i][4] = 1;
-        vertices[i][5] = 1;
-        vertices[i][6] = 0.5 * cos(i * 2 * M_PI / pn);
-        vertices[i][7] = 0.5 * sin(i * 2 * M_PI / pn);
-        vertices[i][8] = -prismLen;
-        vertices[i][9] = 0;
-        vertices[i][10] = 1;
-        vertices[i][11] = 1;
-        vertices[i][12] = 0.5 * cos((i + 1) * 2 * M_PI / pn);
-        vertices[i][13] = 0.5 * sin((i + 1) * 2 * M_PI / pn);
-        vertices[i][14] = -prismLen;
-        vertices[i][15] = 0;
-        vertices[i][16] = 1;
-        vertices[i][17] = 1;
-    }
-    for (int i = 2 * pn; i < 3 * pn; i++)
-    {
-        vertices[i][0] = 0.5 * cos(i * 2 * M_PI / pn);
-        vertices[i][1] = 0.5 * sin(i * 2 * M_PI / pn);
-        vertices[i][2] = prismLen;
-        vertices[i][3] = (1.0f / pn) * (i % pn);
-        vertices[i][4] = 0;
-        vertices[i][5] = (1.0f / pn) * (i % pn);
-        vertices[i][6] = 0.5 * cos(i * 2 * M_PI / pn);
-        vertices[i][7] = 0.5 * sin(i * 2 * M_PI / pn);
-        vertices[i][8] = -prismLen;
-        vertices[i][9] = (1.0f / pn) * (i % pn);
-        vertices[i][10] = 0;
-        vertices[i][11] = (1.0f / pn) * (i % pn);
-        vertices[i][12] = 0.5 * cos((i + 1) * 2 * M_PI / pn);
-        vertices[i][13] = 0.5 * sin((i + 1) * 2 * M_PI / pn);
-        vertices[i][14] = -prismLen;
-        vertices[i][15] = (1.0f / pn) * (i % pn);
-        vertices[i][16] = 0;
-        vertices[i][17] = (1.0f / pn) * (i % pn);
-    }
-    for (int i = 3 * pn; i < 4 * pn; i++)
-    {
-        vertices[i][0] = 0.5 * cos((i + 1) * 2 * M_PI / pn);
-        vertices[i][1] = 0.5 * sin((i + 1) * 2 * M_PI / pn);
-        vertices[i][2] = -prismLen;
-        vertices[i][3] = (1.0f / pn) * (i % pn);
-        vertices[i][4] = 0;
-        vertices[i][5] = (1.0f / pn) * (i % pn);
-        vertices[i][6] = 0.5 * cos(i * 2 * M_PI / pn);
-        vertices[i][7] = 0.5 * sin(i * 2 * M_PI / pn);
-        vertices[i][8] = prismLen;
-        vertices[i][9] = (1.0f / pn) * (i % pn);
-        vertices[i][10] = 0;
-        vertices[i][11] = (1.0f / pn) * (i % pn);
-        vertices[i][12] = 0.5 * cos((i + 1) * 2 * M_PI / pn);
-        vertices[i][13] = 0.5 * sin((i + 1) * 2 * M_PI / pn);
-        vertices[i][14] = prismLen;
-        vertices[i][15] = (1.0f / pn) * (i % pn);
-        vertices[i][16] = 0;
-        vertices[i][17] = (1.0f / pn) * (i % pn);
+    TraceScope compile("Shader");
+    const char *vertexName = opts.analytic ? "analytic_vertex.shader" : "vertex.shader";
+    const char *fragmentName = opts.analytic ? "analytic_fragment.shader" : "fragment.shader";
+    // Embedded in the app at build time, hot reloading needs files to watch though
+    std::string shaderDir = opts.shaderDir;
+    if (opts.hotReload && shaderDir.empty())
+        shaderDir = SHADER_SOURCE_DIR;
+    // Linked programs are saved per driver, so later launches skip compiling
+    std::unique_ptr<ProgramCache> programCache;
+    if (opts.shaderCache != "off")
+        programCache.reset(new ProgramCache(opts.shaderCache.empty() ? ProgramCache::defaultDirectory() : opts.shaderCache));
+    ShaderVariants shaders(shaderSource(vertexName, shaderDir), shaderSource(fragmentName, shaderDir), programCache.get());
+    // Only the variants this run draws with are built up front, any other one compiles the first time it is used
+    unsigned features = 0;
+    if (!opts.analytic && opts.packed)
+        features |= SHADER_PACKED;
+    if (!opts.analytic && opts.computedColor)
+        features |= SHADER_COMPUTED_COLOR;
+    // The analytic mode only finds the nearest surface, there is nothing behind it to blend
+    bool oitEnabled = opts.transparency == TRANSPARENCY_OIT && !opts.analytic;
+    if (opts.transparency != TRANSPARENCY_OPAQUE && opts.analytic)
+        std::cout << "--transparency needs the mesh, drawing the analytic prism opaque" << std::endl;
+    if (oitEnabled)
+        features |= SHADER_OIT;
+    // Every view of the instanced modes comes out of the same draw
+    std::unique_ptr<MultiView> multiView;
+    if (opts.views > 1 && (opts.analytic || opts.transparency != TRANSPARENCY_OPAQUE))
+        std::cout << "--views needs the opaque mesh, drawing one view" << std::endl;
+    else if (opts.views > 1)
+    {
+        ViewMode mode = opts.viewMode;
+        if (mode == VIEWS_INDEX && !glExtras().viewportIndex)
+            std::cout << "gl_ViewportIndex can't be written from the vertex shader, clipping the views into their tiles" << std::endl;
+        if (mode == VIEWS_AUTO || (mode == VIEWS_INDEX && !glExtras().viewportIndex))
+            mode = glExtras().viewportIndex ? VIEWS_INDEX : VIEWS_CLIP;
+        multiView.reset(new MultiView(opts.views, mode));
+        const char *how = mode == VIEWS_INDEX ? "in one draw routed by gl_ViewportIndex"
+                          : mode == VIEWS_CLIP ? "in one draw clipped into their tiles" : "in one pass each";
+        std::cout << "Drawing " << opts.views << " views " << how << std::endl;
+        features |= multiView->features();
+    }
+    // Scenarios with many prisms draw them all at once, each with its own model matrix
+    bool instancing = scenario.maxInstances() > 1 || scene.size() > 1;
+    if (instancing && (opts.analytic || opts.transparency == TRANSPARENCY_SORTED || multiView || !glExtras().instancedArrays))
+    {
+        std::cout << "Instances need the mesh and instanced arrays, without sorting or --views, drawing one prism" << std::endl;
+        instancing = false;
     }
+    shaders.request(features);
+    if (instancing)
+        shaders.request(features | SHADER_INSTANCED);
+    shaders.finishAll();
+    Shader &ourShader = shaders.get(features);
+    Shader *instancedShader = instancing ? &shaders.get(features | SHADER_INSTANCED) : NULL;
+    std::unique_ptr<WeightedOIT> oit;
+    if (oitEnabled)
+        oit.reset(new WeightedOIT(shaderSource("oit_vertex.shader", shaderDir), shaderSource("oit_fragment.shader", shaderDir),
+                                  programCache.get()));
+    compile.end();
+    if (programCache)
+        programCache->report();
+    // Recompiles the shaders in the background whenever their files are saved
+    std::unique_ptr<ShaderReloader> reloader;
+    if (opts.hotReload)
+        reloader.reset(new ShaderReloader(shaders, shaderDir + "/" + vertexName, shaderDir + "/" + fragmentName));
+
     // Init object specifics
     pos = glm::vec3(0, 0, 0);
     angle = 0;
+    if (replay.isOpen())
+        loadState(initialState);
+    InputRecorder recorder;
+    if (!opts.record.empty() && !recorder.open(opts.record, saveState(pn)))
+    {
+        std::cout << "Failed to write recording " << opts.record << std::endl;
+        return -1;
+    }
 
-    // Gpu buffer
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);                                                         // Init VAO
-    glGenBuffers(1, &VBO);                                                              // Generates vertex buffers
-    glBindVertexArray(VAO);                                                             // Bind VBO, VAO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);                                                 // Binds buffers to VBO
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), (float *)vertices, GL_STATIC_DRAW); // Uploads data to GPU
+    // Sorted transparency and the instances' updates run on the CPU, over the same threads as the software backends
+    std::unique_ptr<ThreadPool> pool;
+    if ((opts.transparency == TRANSPARENCY_SORTED && !opts.analytic) || instancing)
+        pool.reset(new ThreadPool(opts.threads));
+    std::unique_ptr<DepthSorter> sorter;
+    if (opts.transparency == TRANSPARENCY_SORTED && !opts.analytic)
+        sorter.reset(new DepthSorter(*pool));
 
-    // Link vertex array
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0); // Tells openGL how to interpret the data
-    glEnableVertexAttribArray(0);                                                  // Enables vertex attribute array
+    // Gpu buffers: every mesh drawn, the sorted triangle order and the instances' model matrices are ranges of three
+    // arenas, all read through the one VAO, the meshes by base vertex
+    TraceScope geometry("geometry");
+    unsigned int VAO;
+    glGenVertexArrays(1, &VAO);                                                 // Init VAO
+    glBindVertexArray(VAO);                                                     // Bind VBO, VAO
+    Prism_Layout layout = opts.packed ? PRISM_PACKED : PRISM_FLOAT;
+    size_t matrixBytes = matrixFloats(MATRIX_4X3) * sizeof(float);
+    GpuArena vertexArena, indexArena, instanceArena;
+    struct MeshRange
+    {
+        uint32_t range;
+        unsigned drawn; // frame it was last drawn in
+    };
+    std::map<int, MeshRange> meshes; // in the vertex arena, by sides
+    uint32_t indexRange = ARENA_NONE, instanceRange = ARENA_NONE, colorRange = ARENA_NONE;
+    unsigned frameIndex = 0;
+    bool arenaChanged = false; // something was allocated this frame, which isn't an idle one then
+    std::vector<SceneRun> runs = scene.runs();
+    bool colorsChanged = true; // the scene's colors aren't in colorRange yet
+    // Makes an instance arena range hold at least bytes, true when it had to move. The arena has room for the most
+    // instances at once, which closing the holes always makes.
+    auto instanceSpace = [&](uint32_t &range, size_t bytes) {
+        if (range != ARENA_NONE && instanceArena.bytes(range) >= bytes)
+            return false;
+        if (range != ARENA_NONE)
+            instanceArena.release(range);
+        range = instanceArena.allocate(bytes);
+        if (range == ARENA_NONE)
+        {
+            instanceArena.defragment(SIZE_MAX);
+            range = instanceArena.allocate(bytes);
+        }
+        arenaChanged = true;
+        return true;
+    };
+    // First vertex of the n sided prism in the vertex arena, which it is generated into when it isn't there yet, -1 if
+    // it doesn't fit
+    auto meshFor = [&](int sides) -> GLint {
+        std::map<int, MeshRange>::iterator found = meshes.find(sides);
+        if (found != meshes.end())
+        {
+            found->second.drawn = frameIndex;
+            return vertexArena.first(found->second.range);
+        }
+        TRACE_SCOPE("geometry");
+        size_t vertexBytes = prismVertexCount(sides, false) * prismVertexSize(layout);
+        uint32_t range = vertexArena.allocate(vertexBytes);
+        // Out of room: close the holes, then drop the meshes drawn longest ago, never one of this frame's
+        while (range == ARENA_NONE)
+        {
+            vertexArena.defragment(SIZE_MAX);
+            range = vertexArena.allocate(vertexBytes);
+            if (range != ARENA_NONE)
+                break;
+            std::map<int, MeshRange>::iterator oldest = meshes.end();
+            for (std::map<int, MeshRange>::iterator it = meshes.begin(); it != meshes.end(); ++it)
+                if (it->second.drawn != frameIndex && (oldest == meshes.end() || it->second.drawn < oldest->second.drawn))
+                    oldest = it;
+            if (oldest == meshes.end())
+            {
+                std::cout << "No room for the mesh of " << sides << " sides" << std::endl;
+                return -1;
+            }
+            vertexArena.release(oldest->second.range);
+            meshes.erase(oldest);
+        }
+        arenaChanged = true;
+        // Generate the vertices straight into the mapped range, falling back to a host copy if the driver can't map it
+        void *mapped = vertexArena.map(range, vertexBytes);
+        if (mapped)
+        {
+            prismGenerate(sides, layout, false, mapped, NULL);
+            vertexArena.unmap();
+        }
+        else
+        {
+            std::vector<unsigned char> vertices(vertexBytes);
+            prismGenerate(sides, layout, false, vertices.data(), NULL);
+            vertexArena.upload(range, vertices.data(), vertexBytes); // Uploads data to GPU
+        }
+        MeshRange mesh = {range, frameIndex};
+        meshes[sides] = mesh;
+        return vertexArena.first(range);
+    };
+    // Makes the n sided prism the one drawn, again whenever a scenario changes n
+    auto uploadMesh = [&](int sides) {
+        meshFor(sides);
+        // The sorter reads the positions back from a host copy, which mapped memory is too slow for, and writes the
+        // triangle order into its own range whenever the view changes
+        if (sorter)
+        {
+            std::vector<unsigned char> vertices(prismVertexCount(sides, false) * prismVertexSize(layout));
+            prismGenerate(sides, layout, false, vertices.data(), NULL);
+            sorter->setMesh(vertices.data(), prismVertexSize(layout), prismVertexCount(sides, false));
+            if (indexRange != ARENA_NONE)
+                indexArena.release(indexRange);
+            indexRange = indexArena.allocate(prismVertexCount(sides, false) * sizeof(uint32_t));
+            arenaChanged = true;
+        }
+    };
+    // The analytic mode draws a quad made up in the vertex shader and only needs the empty VAO
+    if (!opts.analytic)
+    {
+        // Room for the meshes of the scene file's prisms and the largest of the scenario's side counts at once, the
+        // other side counts stay around while they fit in MESH_CACHE_BYTES more
+        const uint64_t MESH_CACHE_BYTES = 32 << 20;
+        std::set<int> sideCounts;
+        sideCounts.insert(pn);
+        for (size_t i = 0; i < scenario.segments().size(); i++)
+            if (scenario.segments()[i].n >= 3)
+                sideCounts.insert(scenario.segments()[i].n);
+        std::set<int> sceneSides;
+        for (size_t i = 0; i < runs.size() && instancing; i++)
+            sceneSides.insert(runs[i].sides);
+        uint64_t vertexSize = prismVertexSize(layout), largest = 0, atOnce = 0, all = 0;
+        for (std::set<int>::iterator it = sideCounts.begin(); it != sideCounts.end(); ++it)
+        {
+            largest = std::max(largest, prismVertexCount(*it, false) * vertexSize);
+            all += sceneSides.count(*it) ? 0 : prismVertexCount(*it, false) * vertexSize;
+        }
+        for (std::set<int>::iterator it = sceneSides.begin(); it != sceneSides.end(); ++it)
+            atOnce += prismVertexCount(*it, false) * vertexSize;
+        all += atOnce;
+        atOnce += largest;
+        vertexArena.create(vertexSize, std::max(atOnce, std::min(all, atOnce + MESH_CACHE_BYTES)) / vertexSize,
+                           GL_STATIC_DRAW);
+        if (sorter)
+        {
+            indexArena.create(sizeof(uint32_t), largest / vertexSize, GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexArena.id()); // part of the VAO
+        }
+        uploadMesh(pn);
+
+        // Link vertex array
+        glBindBuffer(GL_ARRAY_BUFFER, vertexArena.id());
+        GLsizei stride = prismVertexSize(layout);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0); // Tells openGL how to interpret the data
+        glEnableVertexAttribArray(0);                                       // Enables vertex attribute array
 
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+        if (layout == PRISM_PACKED)
+            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, (void *)(3 * sizeof(float)));
+        else
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+
+        // One 4x3 model matrix per instance, its three rows take the locations from 2, and one RGBA8 color at 5. They
+        // point into the instance and color ranges of each draw.
+        if (instancing)
+        {
+            size_t most = std::max((size_t)scenario.maxInstances(), scene.size());
+            instanceArena.create(matrixBytes, most + (most * sizeof(uint32_t) + matrixBytes - 1) / matrixBytes,
+                                 GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, instanceArena.id());
+            for (int i = 0; i < 3; i++)
+            {
+                glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, matrixBytes, (void *)(i * sizeof(glm::vec4)));
+                glEnableVertexAttribArray(2 + i);
+                glVertexAttribDivisor(2 + i, 1);
+            }
+            glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint32_t), (void *)0);
+            glEnableVertexAttribArray(5);
+            glVertexAttribDivisor(5, 1);
+        }
 
-    // Unneccecary
-    glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind VBO
-    glBindVertexArray(0);             // Unbind VAO
+        // Unneccecary
+        glBindBuffer(GL_ARRAY_BUFFER, 0); // Unbind VBO
+        glBindVertexArray(0);             // Unbind VAO
+    }
+    geometry.end();
 
     // Position of prism top faces
     glm::vec3 topPos[] =
@@ -198,138 +463,511 @@ int main(int argc, char **argv)
             glm::vec3(0, 0, prismLen),
             glm::vec3(0, 0, -prismLen)};
 
+    // Timings
+    Stats stats;
+    int frameTime = stats.channel("cpu.frame");
+    int inputTime = stats.channel("cpu.input");
+    int drawTime = stats.channel("cpu.draw");
+    int swapTime = stats.channel("cpu.swap");
+    GpuTimer clearTimer(stats, "gpu.clear");
+    GpuTimer prismTimer(stats, "gpu.prism");
+    GpuTimer compositeTimer(stats, "gpu.composite");
+    int sortTime = stats.channel("cpu.sort");
+    int indexTime = stats.channel("cpu.indices");
+    int instanceTime = stats.channel("cpu.instances");
+    int collideTime = stats.channel("cpu.collide");
+    int captureTime = stats.channel("cpu.capture");
+    if (opts.stats && !glExtras().timerQuery)
+        std::cout << "Timer queries not supported, GPU timings disabled" << std::endl;
+
+    std::unique_ptr<ScenarioRunner> runner;
+    if (!opts.scenario.empty())
+        runner.reset(new ScenarioRunner(scenario));
+    int instances = instancing && scene.size() > 1 ? (int)scene.size() : 1;
+    float drift = 0;
+    Bvh bvh; // over the instances, brought up to date when a click needs it
+    CollisionDetector collisions;
+    // Frames go to the video at the window's initial size, tagged with the replay's fixed step or else 60 fps
+    FrameCapture capture;
+    if (!opts.capture.empty())
+    {
+        int width, height;
+        glfwGetFramebufferSize(window, &width, &height);
+        int fps = opts.fixedStep > 0 ? (int)(1.0f / opts.fixedStep + 0.5f) : 60;
+        if (!capture.open(opts.capture, width, height, fps))
+            std::cout << "Failed to open " << opts.capture << " for capture" << std::endl;
+    }
+
+    startup.end();
+    float replayStart = glfwGetTime();
+
     // Render loop
     while (!glfwWindowShouldClose(window))
     {
+        TRACE_SCOPE("frame");
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        stats.add(frameTime, deltaTime * 1000.0);
+        // Scenarios set the frame up and advance by their fixed step
+        if (runner)
+        {
+            ScenarioFrame step;
+            if (!runner->next(glfwGetTime(), step))
+                break;
+            deltaTime = scenario.step();
+            if (step.n != pn)
+            {
+                TRACE_SCOPE("geometry");
+                pn = step.n;
+                if (!opts.analytic)
+                    uploadMesh(pn);
+                if (opts.scene.empty())
+                {
+                    std::fill(scene.sides.begin(), scene.sides.end(), pn);
+                    runs = scene.runs();
+                }
+            }
+            // The instances of a scene file stay as they are
+            if (opts.scene.empty())
+            {
+                instances = instancing ? step.instances : 1;
+                if (instances > 1 && ((int)scene.size() != instances || step.drift != drift))
+                {
+                    TRACE_SCOPE("scene");
+                    drift = step.drift;
+                    scene.grid(instances, pn, 1.5f, drift);
+                    runs = scene.runs();
+                    colorsChanged = true;
+                    picked = -1;
+                }
+            }
+            if (instances == 1)
+                picked = -1;
+            modelSpin = step.modelSpin;
+            camSpin = step.camSpin;
+            if (step.moveCamera)
+            {
+                camera.Position = step.position;
+                camera.Target = step.target;
+            }
+        }
         // Input handling
-        processInput(window);
+        {
+            TRACE_SCOPE("input");
+            CpuScope t(stats, inputTime);
+            uint32_t keys = 0;
+            if (!replay.isOpen() && !runner)
+                keys = pollKeys(window);
+            else if (runner && picked >= 0)
+                keys = pollKeys(window) & moveKeys(); // scenarios script the rest, but a picked prism can be moved
+            else if (replay.isOpen() && !replay.next(deltaTime, keys))
+                break;
+            if (recorder.isOpen())
+                recorder.record(deltaTime, keys);
+            processInput(window, keys);
+        }
 
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Bg color
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // Swap in reloaded shaders between frames
+        if (reloader)
+            reloader->update();
 
-        ourShader.use();        // Use shaders
-        glBindVertexArray(VAO); // Bind VAO
+        {
+            TRACE_SCOPE("clear");
+            GpuScope g(clearTimer);
+            glClearColor(0.2f, 0.3f, 0.3f, 1.0f); // Bg color
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        {
+            CpuScope drawScope(stats, drawTime);
+            {
+                TRACE_SCOPE("matrices");
+                updateMatrices();
+            }
+            glm::vec4 bounds = prismScreenBounds(projection * view * model);
+            if (multiView)
+            {
+                int width, height;
+                glfwGetFramebufferSize(window, &width, &height);
+                multiView->update(camera, width, height);
+            }
+            // Reorder the triangles back to front when the prism moved relative to the camera
+            bool resorted = false;
+            if (sorter)
+            {
+                TRACE_SCOPE("sort");
+                CpuScope sortScope(stats, sortTime);
+                resorted = sorter->sort(view * model);
+            }
+            if (resorted)
+            {
+                TRACE_SCOPE("indices");
+                CpuScope indexScope(stats, indexTime);
+                size_t indexBytes = prismVertexCount(pn, false) * sizeof(uint32_t);
+                void *indices = indexArena.map(indexRange, indexBytes);
+                if (indices)
+                {
+                    sorter->writeIndices((uint32_t *)indices);
+                    indexArena.unmap();
+                }
+                else
+                {
+                    std::vector<uint32_t> host(prismVertexCount(pn, false));
+                    sorter->writeIndices(host.data());
+                    indexArena.upload(indexRange, host.data(), indexBytes);
+                }
+            }
+
+            // Moves every instance and streams its model matrix straight into its range of the instance arena
+            if (instances > 1)
+            {
+                TRACE_SCOPE("instances");
+                CpuScope instanceScope(stats, instanceTime);
+                scene.update(*pool, deltaTime, modelSpin);
+                size_t instanceBytes = instances * matrixBytes;
+                instanceSpace(instanceRange, instanceBytes);
+                // The colors only change with the scene
+                if (instanceSpace(colorRange, instances * sizeof(uint32_t)) || colorsChanged)
+                {
+                    instanceArena.upload(colorRange, scene.color.data(), instances * sizeof(uint32_t));
+                    colorsChanged = false;
+                }
+                void *matrices = instanceArena.map(instanceRange, instanceBytes);
+                if (matrices)
+                {
+                    scene.writeMatrices(*pool, pos, (float *)matrices, MATRIX_4X3);
+                    instanceArena.unmap();
+                }
+                else
+                {
+                    std::vector<float> host(instances * matrixFloats(MATRIX_4X3));
+                    scene.writeMatrices(*pool, pos, host.data(), MATRIX_4X3);
+                    instanceArena.upload(instanceRange, host.data(), instanceBytes);
+                }
+            }
+            if (opts.collide && instances > 1)
+            {
+                TRACE_SCOPE("collide");
+                CpuScope collideScope(stats, collideTime);
+                collisions.update(*pool, scene);
+            }
 
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, pos);
-        model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0, 0));
-        // Perspective and view
-        view = camera.GetViewMatrix();
+            // The prism under the cursor, found on the CPU so nothing waits on the GPU
+            if (pickRequested)
+            {
+                TRACE_SCOPE("pick");
+                pickRequested = false;
+                int width, height;
+                glfwGetWindowSize(window, &width, &height);
+                glm::vec3 origin, dir;
+                pickRay(camera, projection, pickX, pickY, width, height, origin, dir);
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                PickHit hit = {-1, PICK_NONE, INFINITY};
+                if (instances > 1)
+                    bvh.update(*pool, scene.transforms(), scene.size());
+                std::chrono::steady_clock::time_point indexed = std::chrono::steady_clock::now();
+                if (multiView)
+                    std::cout << "Picking needs a single view" << std::endl;
+                else if (instances > 1)
+                    hit = pickScene(bvh, scene, pos, origin, dir);
+                else
+                {
+                    // The model matrix is rigid, so distances come out the same in object space
+                    glm::mat4 toObject = glm::inverse(model);
+                    hit.distance = rayPrism(glm::vec3(toObject * glm::vec4(origin, 1.0f)), glm::mat3(toObject) * dir, pn, hit.face);
+                    hit.index = hit.distance < INFINITY ? 0 : -1;
+                }
+                double query = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - indexed).count();
+                double index = std::chrono::duration<double, std::milli>(indexed - start).count();
+                picked = instances > 1 ? hit.index : -1;
+                std::string face = hit.face == PICK_TOP ? "the top" : hit.face == PICK_BOTTOM ? "the bottom" : "side " + std::to_string(hit.face);
+                if (hit.index < 0)
+                    std::cout << "Nothing picked";
+                else
+                    std::cout << "Picked prism " << hit.index << " on " << face << " at distance " << hit.distance;
+                std::cout << " in " << query << " us";
+                if (instances > 1)
+                    std::cout << ", updating the index took " << index << " ms";
+                std::cout << std::endl;
+            }
 
-        projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
-        // projection = glm::ortho(0.0f, 800.0f, 0.0f, 600.0f, 0.1f, 100.0f);
+            Shader &shader = instances > 1 ? *instancedShader : ourShader;
+            // The single prism's mesh, the instances look theirs up per run
+            GLint meshFirst = opts.analytic || instances > 1 ? 0 : meshFor(pn);
+            {
+                TRACE_SCOPE("uniforms");
+                shader.use(); // Use shaders
+                shader.setMat4("projection", projection);
+                if (opts.analytic)
+                {
+                    int width, height;
+                    glfwGetFramebufferSize(window, &width, &height);
+                    shader.setMat4("toObject", glm::inverse(view * model));
+                    shader.setVec2("viewport", (float)width, (float)height);
+                    shader.setFloat("sides", (float)pn);
+                    shader.setVec4("bounds", bounds);
+                }
+                else
+                {
+                    shader.setMat4("model", model);
+                    shader.setMat4("view", view);
+                    if (features & SHADER_COMPUTED_COLOR)
+                    {
+                        shader.setFloat("sides", (float)pn);
+                        shader.setInt("firstVertex", meshFirst);
+                    }
+                }
+            }
 
-        ourShader.setMat4("model", model);
-        ourShader.setMat4("view", view);
-        ourShader.setMat4("projection", projection);
-        for (int i = 0; i < 2; i++)
+            TRACE_SCOPE("draw");
+            // Only the draws, the CPU work above would count as GPU time between the timestamps
+            GpuScope prismScope(prismTimer);
+            if (oit)
+            {
+                int width, height;
+                glfwGetFramebufferSize(window, &width, &height);
+                oit->begin(width, height);
+            }
+            if (sorter)
+            {
+                // Back to front over whatever is behind, the depth test stays on but nothing may hide the faces behind
+                glEnable(GL_BLEND);
+                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                glDepthMask(GL_FALSE);
+            }
+            glBindVertexArray(VAO); // Bind VAO
+            // Blending counts every fragment it gets, transparency draws the faces only once
+            for (int i = 0; i < (oit || sorter ? 1 : 2); i++)
+            {
+                if (opts.analytic && bounds.x < bounds.z && bounds.y < bounds.w)
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); // Ray cast the prism over its screen rectangle
+                else if (opts.analytic || meshFirst < 0)
+                    continue;
+                else if (multiView)
+                    multiView->draw(shader, meshFirst, prismVertexCount(pn, false)); // Every view at once
+                else if (instances > 1)
+                    for (size_t r = 0; r < runs.size(); r++) // Every prism at once, a draw per side count
+                    {
+                        GLint first = runs[r].sides >= 3 ? meshFor(runs[r].sides) : -1;
+                        if (first < 0)
+                            continue;
+                        glBindBuffer(GL_ARRAY_BUFFER, instanceArena.id());
+                        size_t matrices = instanceArena.offset(instanceRange) + runs[r].begin * matrixBytes;
+                        for (int row = 0; row < 3; row++)
+                            glVertexAttribPointer(2 + row, 4, GL_FLOAT, GL_FALSE, matrixBytes,
+                                                  (void *)(matrices + row * sizeof(glm::vec4)));
+                        size_t colors = instanceArena.offset(colorRange) + runs[r].begin * sizeof(uint32_t);
+                        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(uint32_t), (void *)colors);
+                        if (features & SHADER_COMPUTED_COLOR)
+                        {
+                            shader.setFloat("sides", (float)runs[r].sides);
+                            shader.setInt("firstVertex", first);
+                        }
+                        glDrawArraysInstanced(GL_TRIANGLES, first, prismVertexCount(runs[r].sides, false), runs[r].count);
+                    }
+                else if (sorter)
+                    glDrawElementsBaseVertex(GL_TRIANGLES, prismVertexCount(pn, false), GL_UNSIGNED_INT,
+                                             (void *)indexArena.offset(indexRange), meshFirst); // In sorted order
+                else
+                    glDrawArrays(GL_TRIANGLES, meshFirst, prismVertexCount(pn, false)); // Draw Triangle
+            }
+            if (sorter)
+            {
+                glDepthMask(GL_TRUE);
+                glDisable(GL_BLEND);
+            }
+        }
+        if (oit)
         {
-            glDrawArrays(GL_TRIANGLES, 0, 12 * pn); // Draw Triangle
+            TRACE_SCOPE("composite");
+            GpuScope g(compositeTimer);
+            oit->composite();
+        }
+
+        if (capture.isOpen())
+        {
+            CpuScope c(stats, captureTime);
+            capture.capture();
         }
 
         // Neccessary stuff
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        {
+            TRACE_SCOPE("glfwSwapBuffers");
+            CpuScope t(stats, swapTime);
+            glfwSwapBuffers(window);
+        }
+        {
+            TRACE_SCOPE("glfwPollEvents");
+            glfwPollEvents();
+        }
+
+        // Frames that allocated nothing close a little of the arenas' holes
+        if (!arenaChanged)
+        {
+            TRACE_SCOPE("defragment");
+            vertexArena.defragment(ARENA_DEFRAG_BYTES);
+            indexArena.defragment(ARENA_DEFRAG_BYTES);
+            instanceArena.defragment(ARENA_DEFRAG_BYTES);
+        }
+        arenaChanged = false;
+        frameIndex++;
+
+        // Read back whatever GPU timings are ready, never waits
+        TRACE_SCOPE("stats");
+        clearTimer.collect();
+        prismTimer.collect();
+        compositeTimer.collect();
+        if (opts.stats && stats.due(currentFrame))
+        {
+            stats.print();
+            if (opts.collide && instances > 1)
+                std::cout << collisions.pairs().size() << " overlapping pairs of " << collisions.candidates()
+                          << " candidates" << std::endl;
+            if (!opts.analytic)
+                vertexArena.print("vertex");
+            if (sorter)
+                indexArena.print("index");
+            if (instancing)
+                instanceArena.print("instance");
+        }
+    }
+
+    if (replay.isOpen())
+    {
+        float elapsed = glfwGetTime() - replayStart;
+        std::cout << "Replayed " << replay.framesPlayed() << " frames in " << elapsed << " s ("
+                  << 1000.0f * elapsed / replay.framesPlayed() << " ms/frame)" << std::endl;
     }
+    recorder.close();
+    capture.close();
 
     glfwTerminate();
+    if (!opts.trace.empty() && !Tracer::get().write(opts.trace))
+        std::cout << "Failed to write trace " << opts.trace << std::endl;
     return 0;
 }
 
-void processInput(GLFWwindow *window)
+// Mask of the keys that move the model
+uint32_t moveKeys()
 {
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    const int keys[] = {GLFW_KEY_U, GLFW_KEY_O, GLFW_KEY_I, GLFW_KEY_K, GLFW_KEY_J, GLFW_KEY_L};
+    uint32_t mask = 0;
+    for (int i = 0; i < inputKeyCount; i++)
+        for (int j = 0; j < 6; j++)
+            if (inputKeys[i] == keys[j])
+                mask |= 1u << i;
+    return mask;
+}
+
+uint32_t pollKeys(GLFWwindow *window)
+{
+    uint32_t keys = 0;
+    for (int i = 0; i < inputKeyCount; i++)
+        if (glfwGetKey(window, inputKeys[i]) == GLFW_PRESS)
+            keys |= 1u << i;
+    return keys;
+}
+
+bool keyDown(uint32_t keys, int key)
+{
+    for (int i = 0; i < inputKeyCount; i++)
+        if (inputKeys[i] == key)
+            return (keys >> i) & 1;
+    return false;
+}
+
+void processInput(GLFWwindow *window, uint32_t keys)
+{
+    if (keyDown(keys, GLFW_KEY_ESCAPE) && window)
         glfwSetWindowShouldClose(window, true);
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_W))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(FORWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_S))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(BACKWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_A))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(LEFT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_D))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(RIGHT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_Q))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(UP, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_E))
     {
         if (outOfPlace)
             resetState();
         camera.ProcessKeyboard(DOWN, deltaTime);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_U))
     {
         outOfPlace = true;
         moveModel(UP, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_O))
     {
         outOfPlace = true;
         moveModel(DOWN, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_I))
     {
         outOfPlace = true;
         moveModel(FORWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_K))
     {
         outOfPlace = true;
         moveModel(BACKWARD, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_J))
     {
         outOfPlace = true;
         moveModel(LEFT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_L))
     {
         outOfPlace = true;
         moveModel(RIGHT, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_R))
     {
         modelSpin = !modelSpin;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_1))
     {
         if (outOfPlace)
             resetState();
         camera.Position = glm::vec3(0, 0, 2);
     }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_2))
     {
         if (outOfPlace)
             resetState();
         camera.Position = glm::vec3(0, 0, -2);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+    if (keyDown(keys, GLFW_KEY_T))
     {
         camSpin = !camSpin;
     }
@@ -355,12 +993,23 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height)
     glViewport(0, 0, width, height);
 }
 
+void mouse_button_callback(GLFWwindow *window, int button, int action, int)
+{
+    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS)
+    {
+        pickRequested = true;
+        glfwGetCursorPos(window, &pickX, &pickY);
+    }
+}
+
+// Moves the picked instance when there is one, otherwise the model
 void moveModel(int dir, float deltaTime)
 {
     float v = 2.50f * deltaTime;
     glm::vec3 Front = camera.Position;
     glm::vec3 Right = glm::normalize(glm::cross(Front, camera.WorldUp));
     glm::vec3 Up = glm::normalize(glm::cross(Right, Front));
+    glm::vec3 start = pos;
     if (dir == UP)
     {
         pos += Up * v;
@@ -385,6 +1034,159 @@ void moveModel(int dir, float deltaTime)
     {
         pos += Right * v;
     }
+    if (picked >= 0 && picked < (long)scene.size())
+    {
+        glm::vec3 step = pos - start;
+        pos = start;
+        scene.x[picked] += step.x;
+        scene.y[picked] += step.y;
+        scene.z[picked] += step.z;
+    }
+}
+
+void updateMatrices()
+{
+    model = glm::mat4(1.0f);
+    model = glm::translate(model, pos);
+    model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0, 0));
+    // Perspective and view
+    view = camera.GetViewMatrix();
+
+    projection = glm::perspective(glm::radians(camera.Zoom), 800.0f / 600.0f, 0.1f, 100.0f);
+    // projection = glm::ortho(0.0f, 800.0f, 0.0f, 600.0f, 0.1f, 100.0f);
+}
+
+// Renders with the software rasterizer or the ray tracer into an in-memory framebuffer. Runs a replay or a scenario when
+// one is given, otherwise a fixed number of frames at 60 fps worth of time steps without input.
+int runSoftware(const Options &opts, InputReplay &replay, const InputState &initialState, const Scenario &scenario)
+{
+    int pn = opts.n;
+    TraceScope startup("startup");
+    pos = glm::vec3(0, 0, 0);
+    angle = 0;
+    if (replay.isOpen())
+        loadState(initialState);
+
+    // The ray tracer intersects the prism analytically and needs no mesh
+    bool raster = opts.backend == BACKEND_SOFT;
+    TraceScope geometry("geometry");
+    std::vector<float> vertices;
+    if (raster)
+    {
+        vertices.resize(prismVertexCount(pn, false) * prismVertexSize(PRISM_FLOAT) / sizeof(float));
+        prismGenerate(pn, PRISM_FLOAT, false, vertices.data(), NULL);
+    }
+    geometry.end();
+    if (!raster && scenario.maxInstances() > 1)
+        std::cout << "The ray tracer draws a single prism, ignoring the scenario's instances" << std::endl;
+
+    ThreadPool pool(opts.threads);
+    SoftRasterizer rasterizer(pool);
+    PrismTracer tracer(pool);
+    Framebuffer framebuffer(SCR_WIDTH, SCR_HEIGHT);
+    startup.end();
+
+    Stats stats;
+    int frameTime = stats.channel("cpu.frame");
+    int renderTime = stats.channel(raster ? "cpu.raster" : "cpu.trace");
+    // GLFW isn't initialized here, so time with the standard clock
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double last = 0;
+    int frames = 0;
+    size_t covered = 0;
+    std::unique_ptr<ScenarioRunner> runner;
+    if (!opts.scenario.empty())
+        runner.reset(new ScenarioRunner(scenario));
+    float drift = 0;
+    std::vector<glm::mat4> instanceModels;
+    while (replay.isOpen() || runner || frames < opts.frames)
+    {
+        TRACE_SCOPE("frame");
+        uint32_t keys = 0;
+        deltaTime = 1.0f / 60.0f;
+        if (replay.isOpen() && !replay.next(deltaTime, keys))
+            break;
+        if (runner)
+        {
+            ScenarioFrame step;
+            if (!runner->next(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), step))
+                break;
+            deltaTime = scenario.step();
+            if (step.n != pn && raster)
+            {
+                TRACE_SCOPE("geometry");
+                vertices.resize(prismVertexCount(step.n, false) * prismVertexSize(PRISM_FLOAT) / sizeof(float));
+                prismGenerate(step.n, PRISM_FLOAT, false, vertices.data(), NULL);
+            }
+            pn = step.n;
+            if (raster && step.instances > 1 && ((int)scene.size() != step.instances || step.drift != drift))
+            {
+                drift = step.drift;
+                scene.grid(step.instances, pn, 1.5f, drift);
+                instanceModels.resize(step.instances);
+            }
+            else if (step.instances <= 1)
+                scene.clear();
+            modelSpin = step.modelSpin;
+            camSpin = step.camSpin;
+            if (step.moveCamera)
+            {
+                camera.Position = step.position;
+                camera.Target = step.target;
+            }
+        }
+        {
+            TRACE_SCOPE("input");
+            processInput(NULL, keys);
+        }
+        {
+            TRACE_SCOPE("matrices");
+            updateMatrices();
+        }
+        {
+            TRACE_SCOPE(raster ? "raster" : "trace");
+            CpuScope t(stats, renderTime);
+            if (raster && scene.size() > 1)
+            {
+                // One draw per instance into the same frame
+                scene.update(pool, deltaTime, modelSpin);
+                scene.writeMatrices(pool, pos, glm::value_ptr(instanceModels[0]));
+                for (size_t i = 0; i < scene.size(); i++)
+                {
+                    rasterizer.draw(vertices.data(), prismVertexCount(pn, false), projection * view * instanceModels[i],
+                                    framebuffer, i == 0);
+                    covered += rasterizer.trianglesDrawn();
+                }
+            }
+            else if (raster)
+            {
+                rasterizer.draw(vertices.data(), prismVertexCount(pn, false), projection * view * model, framebuffer);
+                covered += rasterizer.trianglesDrawn();
+            }
+            else
+            {
+                tracer.render(pn, model, view, projection, framebuffer);
+                covered += tracer.pixelsHit();
+            }
+        }
+        frames++;
+
+        double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        stats.add(frameTime, (now - last) * 1000.0);
+        last = now;
+        if (opts.stats && stats.due(now))
+            stats.print();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Rendered " << frames << " frames on " << pool.size() << " threads in " << elapsed << " s ("
+              << 1000.0 * elapsed / std::max(frames, 1) << " ms/frame, "
+              << covered / std::max(frames, 1) << (raster ? " binned triangles" : " pixels covered") << "/frame)" << std::endl;
+    if (!opts.output.empty() && !framebuffer.writePPM(opts.output))
+        std::cout << "Failed to write " << opts.output << std::endl;
+    if (!opts.trace.empty() && !Tracer::get().write(opts.trace))
+        std::cout << "Failed to write trace " << opts.trace << std::endl;
+    return 0;
 }
 
 void resetState()
@@ -393,4 +1195,36 @@ void resetState()
     pos = glm::vec3(0, 0, 0);
     angle = 0;
     camera.Position = glm::vec3(0, 0, 3);
+}
+InputState saveState(int n)
+{
+    InputState state;
+    memset(&state, 0, sizeof(state));
+    state.n = n;
+    state.cameraPosition[0] = camera.Position.x;
+    state.cameraPosition[1] = camera.Position.y;
+    state.cameraPosition[2] = camera.Position.z;
+    state.cameraYaw = camera.Yaw;
+    state.cameraPitch = camera.Pitch;
+    state.cameraZoom = camera.Zoom;
+    state.pos[0] = pos.x;
+    state.pos[1] = pos.y;
+    state.pos[2] = pos.z;
+    state.angle = angle;
+    state.outOfPlace = outOfPlace;
+    state.modelSpin = modelSpin;
+    state.camSpin = camSpin;
+    return state;
+}
+
+void loadState(const InputState &state)
+{
+    glm::vec3 position(state.cameraPosition[0], state.cameraPosition[1], state.cameraPosition[2]);
+    camera = Camera(position, camera.WorldUp, state.cameraYaw, state.cameraPitch);
+    camera.Zoom = state.cameraZoom;
+    pos = glm::vec3(state.pos[0], state.pos[1], state.pos[2]);
+    angle = state.angle;
+    outOfPlace = state.outOfPlace;
+    modelSpin = state.modelSpin;
+    camSpin = state.camSpin;
 }
\ No newline at end of file
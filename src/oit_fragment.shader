@@ -0,0 +1,17 @@
+#version 330 core
+// Resolves the weighted blended transparency targets into one color, blended over the background with its coverage
+out vec4 FragColor;
+
+uniform sampler2D accumTexture;  // color * alpha * weight summed, product of (1 - alpha) in alpha
+uniform sampler2D weightTexture; // alpha * weight summed
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, pixel, 0);
+    float revealage = accum.a;
+    if (revealage == 1.0)
+        discard; // nothing was drawn here
+    float weight = texelFetch(weightTexture, pixel, 0).r;
+    FragColor = vec4(accum.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
\ No newline at end of file
@@ -1,15 +1,75 @@
 #version 330 core
+// Built in variants by include/shadervariants.h, which defines a subset of:
+//   INSTANCED       the model matrix comes from a per-instance attribute instead of the uniform
+//   COMPUTED_COLOR  the color is derived from the vertex index of the unindexed mesh instead of read from the buffer
+//   PACKED          the color attribute is the normalized RGBA8 of the packed layout
+//   MULTIVIEW       every instance is one view of include/multiview.h, not combined with INSTANCED
+//   VIEWPORT_INDEX  with MULTIVIEW, send each view to its viewport instead of squeezing it into its tile
+#ifdef VIEWPORT_INDEX
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+#endif
 layout (location = 0) in vec3 aPos;
+#ifdef PACKED
+layout (location = 1) in vec4 aColor;
+#else
 layout (location = 1) in vec3 aColor;
+#endif
+#ifdef INSTANCED
+layout (location = 2) in vec4 aModel[3]; // rows of the affine model matrix, locations 2 to 4
+layout (location = 5) in vec4 aTint;     // the prism's normalized RGBA8 color, multiplies the mesh's
+#endif
 
-out vec3 ourColor;
+out vec4 ourColor;
 
+#ifndef INSTANCED
 uniform mat4 model;
+#endif
+#ifdef MULTIVIEW
+uniform mat4 viewProjection[16]; // MAX_VIEWS, indexed by the instance
+#ifndef VIEWPORT_INDEX
+uniform vec4 tiles[16]; // scale in xy and offset in zw from a view's clip space to its tile of the framebuffer
+#endif
+#else
 uniform mat4 view;
 uniform mat4 projection;
+#endif
+#ifdef COMPUTED_COLOR
+uniform float sides;
+uniform int firstVertex; // of the mesh in the vertex arena, which gl_VertexID counts from
+#endif
 
 void main()
 {
+#ifdef INSTANCED
+    mat4 model = transpose(mat4(aModel[0], aModel[1], aModel[2], vec4(0.0, 0.0, 0.0, 1.0)));
+#endif
+#if defined(MULTIVIEW) && defined(VIEWPORT_INDEX)
+    gl_Position = viewProjection[gl_InstanceID] * model * vec4(aPos, 1.0);
+    gl_ViewportIndex = gl_InstanceID;
+#elif defined(MULTIVIEW)
+    // Clip to the view's own frustum, so nothing spills into the neighbouring tiles, then move into the tile
+    vec4 clip = viewProjection[gl_InstanceID] * model * vec4(aPos, 1.0);
+    gl_ClipDistance[0] = clip.w + clip.x;
+    gl_ClipDistance[1] = clip.w - clip.x;
+    gl_ClipDistance[2] = clip.w + clip.y;
+    gl_ClipDistance[3] = clip.w - clip.y;
+    vec4 tile = tiles[gl_InstanceID];
+    gl_Position = vec4(clip.xy * tile.xy + tile.zw * clip.w, clip.zw);
+#else
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-    ourColor = aColor;
+#endif
+#ifdef COMPUTED_COLOR
+    // 12 vertices per side: the top cap slice, the bottom cap slice and the side quad, colored like prismSides()
+    int vertex = gl_VertexID - firstVertex;
+    int corner = vertex % 12;
+    float c = (1.0 / sides) * float(vertex / 12);
+    ourColor.rgb = corner < 3 ? vec3(1.0, 1.0, 0.0) : corner < 6 ? vec3(0.0, 1.0, 1.0) : vec3(c, 0.0, c);
+#else
+    ourColor.rgb = aColor.rgb;
+#endif
+    ourColor.a = 1.0;
+#ifdef INSTANCED
+    ourColor *= aTint;
+#endif
 }
\ No newline at end of file